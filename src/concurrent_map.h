@@ -1,60 +1,310 @@
 #pragma once
 
+#include <algorithm>
+#include <atomic>
 #include <cstddef>
 #include <cstdint>
+#include <functional>
 #include <map>
+#include <memory>
 #include <mutex>
+#include <shared_mutex>
+#include <thread>
 #include <type_traits>
+#include <utility>
 #include <vector>
 
-template <typename Key, typename Value>
+// Hash map sharded by key, every shard is an open addressing table behind its own lock.
+// Arithmetic values are stored as atomics, which lets FetchAdd update an existing key
+// under a shared lock, so concurrent adds to the same shard do not serialize.
+template <typename Key, typename Value, typename Hash = std::hash<Key>>
 class ConcurrentMap {
 private:
-	struct Bucket {
-		std::mutex mutex;
-		std::map<Key, Value> map;
+	static constexpr std::size_t CACHE_LINE_SIZE = 64;
+	static constexpr std::size_t SHARDS_PER_THREAD = 4;
+	static constexpr std::size_t MIN_SLOT_COUNT = 8;
+
+	template <typename T>
+	struct IsLockFreeAtomic : std::bool_constant<std::atomic<T>::is_always_lock_free> {};
+
+	static constexpr bool HAS_ATOMIC_VALUES = std::conjunction_v<
+		std::is_arithmetic<Value>, std::negation<std::is_same<Value, bool>>, IsLockFreeAtomic<Value>>;
+	using StoredValue = std::conditional_t<HAS_ATOMIC_VALUES, std::atomic<Value>, Value>;
+
+	struct Slot {
+		bool is_occupied = false;
+		uint64_t hash = 0;
+		Key key{};
+		StoredValue value{};
 	};
 
-	static const std::size_t DEFAULT_BUCKET_COUNT = 8;
-public:
-	static_assert(std::is_integral_v<Key>, "ConcurrentMap supports only integer keys");
+	// Padding keeps the locks of neighbouring shards on different cache lines
+	struct alignas(CACHE_LINE_SIZE) Shard {
+		mutable std::shared_mutex mutex;
+		std::unique_ptr<Slot[]> slots;
+		std::size_t slot_count = 0;
+		std::size_t size = 0;
+	};
+
+	// Proxy giving the Access interface of a plain reference to an atomic value
+	class AtomicValueRef {
+	public:
+		explicit AtomicValueRef(std::atomic<Value>& value)
+			: value_(value)
+		{}
+
+		operator Value() const { return value_.load(std::memory_order_relaxed); }
+
+		AtomicValueRef& operator=(Value value) {
+			value_.store(value, std::memory_order_relaxed);
+			return *this;
+		}
 
+		AtomicValueRef& operator+=(Value delta) {
+			return *this = *this + delta;
+		}
+
+		AtomicValueRef& operator-=(Value delta) {
+			return *this = *this - delta;
+		}
+
+	private:
+		std::atomic<Value>& value_;
+	};
+
+	using ValueRef = std::conditional_t<HAS_ATOMIC_VALUES, AtomicValueRef, Value&>;
+
+public:
 	struct Access {
-		std::lock_guard<std::mutex> guard;
-		Value& ref_to_value;
-		Access(const Key& key, Bucket& bucket)
-			: guard(bucket.mutex)
-			, ref_to_value(bucket.map[key])
+		std::unique_lock<std::shared_mutex> guard;
+		ValueRef ref_to_value;
+
+		Access(std::unique_lock<std::shared_mutex> lock, StoredValue& value)
+			: guard(std::move(lock))
+			, ref_to_value(value)
 		{}
 	};
 
-	explicit ConcurrentMap(std::size_t bucket_count = DEFAULT_BUCKET_COUNT)
-		: buckets_(bucket_count)
+	static std::size_t DefaultShardCount() {
+		return std::max<std::size_t>(1, std::thread::hardware_concurrency()) * SHARDS_PER_THREAD;
+	}
+
+	explicit ConcurrentMap(std::size_t shard_count = DefaultShardCount())
+		: shards_(RoundUpToPowerOfTwo(std::max<std::size_t>(1, shard_count)))
 	{}
 
 	Access operator[](const Key& key) {
-		return Access(key, GetBucket(key));
+		const uint64_t hash = HashKey(key);
+		Shard& shard = GetShard(hash);
+		std::unique_lock lock(shard.mutex);
+		return Access(std::move(lock), FindOrInsert(shard, key, hash).value);
+	}
+
+	// Adds delta to the value of the key and returns the previous value
+	Value FetchAdd(const Key& key, Value delta) {
+		static_assert(HAS_ATOMIC_VALUES, "FetchAdd requires lock-free atomic values");
+		const uint64_t hash = HashKey(key);
+		Shard& shard = GetShard(hash);
+		{
+			std::shared_lock lock(shard.mutex);
+			if (Slot* slot = Find(shard, key, hash)) {
+				return AtomicAdd(slot->value, delta);
+			}
+		}
+		std::unique_lock lock(shard.mutex);
+		return AtomicAdd(FindOrInsert(shard, key, hash).value, delta);
 	}
 
 	void Erase(const Key& key) {
-		Bucket& bucket = GetBucket(key);
-		std::lock_guard guard(bucket.mutex);
-		bucket.map.erase(key);
+		const uint64_t hash = HashKey(key);
+		Shard& shard = GetShard(hash);
+		std::unique_lock lock(shard.mutex);
+		Slot* slot = Find(shard, key, hash);
+		if (slot == nullptr) {
+			return;
+		}
+		// Backward shift deletion keeps probe sequences intact without tombstones
+		const std::size_t mask = shard.slot_count - 1;
+		std::size_t hole = static_cast<std::size_t>(slot - shard.slots.get());
+		for (std::size_t next = (hole + 1) & mask; shard.slots[next].is_occupied; next = (next + 1) & mask) {
+			const std::size_t home = shard.slots[next].hash & mask;
+			if (((next - home) & mask) >= ((next - hole) & mask)) {
+				MoveSlot(shard.slots[next], shard.slots[hole]);
+				hole = next;
+			}
+		}
+		shard.slots[hole].is_occupied = false;
+		--shard.size;
+	}
+
+	std::size_t size() const {
+		std::size_t result = 0;
+		for (const Shard& shard : shards_) {
+			std::shared_lock lock(shard.mutex);
+			result += shard.size;
+		}
+		return result;
+	}
+
+	// Visits every entry in place, locking one shard at a time
+	template <typename Function>
+	void ForEach(Function function) const {
+		for (const Shard& shard : shards_) {
+			std::shared_lock lock(shard.mutex);
+			for (std::size_t i = 0; i < shard.slot_count; ++i) {
+				const Slot& slot = shard.slots[i];
+				if (slot.is_occupied) {
+					function(slot.key, LoadValue(slot.value));
+				}
+			}
+		}
+	}
+
+	// Moves every entry out into the function and leaves the map empty
+	template <typename Function>
+	void Drain(Function function) {
+		for (Shard& shard : shards_) {
+			std::unique_lock lock(shard.mutex);
+			for (std::size_t i = 0; i < shard.slot_count; ++i) {
+				Slot& slot = shard.slots[i];
+				if (slot.is_occupied) {
+					function(std::move(slot.key), TakeValue(slot.value));
+					slot.is_occupied = false;
+				}
+			}
+			shard.size = 0;
+		}
 	}
 
 	std::map<Key, Value> BuildOrdinaryMap() {
 		std::map<Key, Value> result;
-		for (auto& [mutex, map] : buckets_) {
-			std::lock_guard guard(mutex);
-			result.insert(map.begin(), map.end());
-		}
+		ForEach([&result](const Key& key, const Value& value) {
+			result.emplace(key, value);
+		});
 		return result;
 	}
 
 private:
-	std::vector<Bucket> buckets_;
+	std::vector<Shard> shards_;
+	Hash hasher_;
 
-	Bucket& GetBucket(const Key& key) {
-		return buckets_[static_cast<uint64_t>(key) % buckets_.size()];
+	static std::size_t RoundUpToPowerOfTwo(std::size_t value) {
+		std::size_t result = 1;
+		while (result < value) {
+			result *= 2;
+		}
+		return result;
+	}
+
+	uint64_t HashKey(const Key& key) const {
+		// Murmur3 finalizer, std::hash of integers is usually the identity
+		uint64_t hash = static_cast<uint64_t>(hasher_(key));
+		hash ^= hash >> 33;
+		hash *= 0xff51afd7ed558ccdULL;
+		hash ^= hash >> 33;
+		hash *= 0xc4ceb9fe1a85ec53ULL;
+		hash ^= hash >> 33;
+		return hash;
+	}
+
+	Shard& GetShard(uint64_t hash) {
+		return shards_[(hash >> 40) & (shards_.size() - 1)];
+	}
+
+	static Slot* Find(Shard& shard, const Key& key, uint64_t hash) {
+		if (shard.slot_count == 0) {
+			return nullptr;
+		}
+		const std::size_t mask = shard.slot_count - 1;
+		for (std::size_t i = hash & mask; shard.slots[i].is_occupied; i = (i + 1) & mask) {
+			if (shard.slots[i].hash == hash && shard.slots[i].key == key) {
+				return &shard.slots[i];
+			}
+		}
+		return nullptr;
+	}
+
+	static Slot& FindOrInsert(Shard& shard, const Key& key, uint64_t hash) {
+		if (Slot* slot = Find(shard, key, hash)) {
+			return *slot;
+		}
+		if ((shard.size + 1) * 2 > shard.slot_count) {
+			Rehash(shard, std::max(MIN_SLOT_COUNT, shard.slot_count * 2));
+		}
+		const std::size_t mask = shard.slot_count - 1;
+		std::size_t i = hash & mask;
+		while (shard.slots[i].is_occupied) {
+			i = (i + 1) & mask;
+		}
+		Slot& slot = shard.slots[i];
+		slot.is_occupied = true;
+		slot.hash = hash;
+		slot.key = key;
+		StoreValue(slot.value, Value{});
+		++shard.size;
+		return slot;
+	}
+
+	static void Rehash(Shard& shard, std::size_t slot_count) {
+		std::unique_ptr<Slot[]> old_slots = std::exchange(shard.slots, std::make_unique<Slot[]>(slot_count));
+		const std::size_t old_slot_count = std::exchange(shard.slot_count, slot_count);
+		const std::size_t mask = slot_count - 1;
+		for (std::size_t i = 0; i < old_slot_count; ++i) {
+			if (!old_slots[i].is_occupied) {
+				continue;
+			}
+			std::size_t j = old_slots[i].hash & mask;
+			while (shard.slots[j].is_occupied) {
+				j = (j + 1) & mask;
+			}
+			MoveSlot(old_slots[i], shard.slots[j]);
+		}
+	}
+
+	static void MoveSlot(Slot& from, Slot& to) {
+		to.is_occupied = true;
+		to.hash = from.hash;
+		to.key = std::move(from.key);
+		StoreValue(to.value, TakeValue(from.value));
+		from.is_occupied = false;
+	}
+
+	static Value LoadValue(const StoredValue& value) {
+		if constexpr (HAS_ATOMIC_VALUES) {
+			return value.load(std::memory_order_relaxed);
+		}
+		else {
+			return value;
+		}
+	}
+
+	static Value TakeValue(StoredValue& value) {
+		if constexpr (HAS_ATOMIC_VALUES) {
+			return value.load(std::memory_order_relaxed);
+		}
+		else {
+			return std::move(value);
+		}
+	}
+
+	static void StoreValue(StoredValue& to, Value value) {
+		if constexpr (HAS_ATOMIC_VALUES) {
+			to.store(value, std::memory_order_relaxed);
+		}
+		else {
+			to = std::move(value);
+		}
+	}
+
+	static Value AtomicAdd(StoredValue& value, Value delta) {
+		if constexpr (std::is_integral_v<Value>) {
+			return value.fetch_add(delta, std::memory_order_relaxed);
+		}
+		else {
+			Value expected = value.load(std::memory_order_relaxed);
+			while (!value.compare_exchange_weak(expected, expected + delta, std::memory_order_relaxed)) {
+			}
+			return expected;
+		}
 	}
-};
\ No newline at end of file
+};
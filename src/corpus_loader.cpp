@@ -0,0 +1,168 @@
+#include <algorithm>
+#include <charconv>
+#include <exception>
+#include <execution>
+#include <iterator>
+#include <numeric>
+#include <stdexcept>
+#include <thread>
+
+#include "corpus_loader.h"
+#include "mapped_file.h"
+
+namespace {
+
+// Chunks end at the first line break after this many bytes
+const std::size_t CORPUS_CHUNK_SIZE = 4 << 20;
+const std::size_t CHUNKS_PER_THREAD = 2;
+
+[[noreturn]] void ThrowInvalidLine(std::size_t line_number, const std::string& reason) {
+	throw std::invalid_argument("Invalid corpus line " + std::to_string(line_number) + ": " + reason);
+}
+
+bool ParseInt(std::string_view text, int& value) {
+	const char* const last = text.data() + text.size();
+	const auto [end, error] = std::from_chars(text.data(), last, value);
+	return !text.empty() && error == std::errc() && end == last;
+}
+
+bool ParseStatus(std::string_view text, DocumentStatus& status) {
+	static const std::pair<std::string_view, DocumentStatus> statuses[] = {
+		{ "ACTUAL", DocumentStatus::ACTUAL },
+		{ "IRRELEVANT", DocumentStatus::IRRELEVANT },
+		{ "BANNED", DocumentStatus::BANNED },
+		{ "REMOVED", DocumentStatus::REMOVED },
+	};
+	for (const auto& [name, value] : statuses) {
+		if (text == name) {
+			status = value;
+			return true;
+		}
+	}
+	return false;
+}
+
+DocumentInput ParseCorpusLine(std::string_view line, std::size_t line_number) {
+	std::string_view fields[3];
+	for (std::string_view& field : fields) {
+		const std::size_t tab = line.find('\t');
+		if (tab == std::string_view::npos) {
+			ThrowInvalidLine(line_number, "expected id, status, ratings and text separated by tabs");
+		}
+		field = line.substr(0, tab);
+		line.remove_prefix(tab + 1);
+	}
+
+	DocumentInput document;
+	if (!ParseInt(fields[0], document.id)) {
+		ThrowInvalidLine(line_number, "invalid id " + std::string(fields[0]));
+	}
+	if (!ParseStatus(fields[1], document.status)) {
+		ThrowInvalidLine(line_number, "invalid status " + std::string(fields[1]));
+	}
+	for (std::string_view ratings = fields[2]; !ratings.empty();) {
+		const std::size_t space = std::min(ratings.find(' '), ratings.size());
+		if (space > 0) {
+			int rating = 0;
+			if (!ParseInt(ratings.substr(0, space), rating)) {
+				ThrowInvalidLine(line_number, "invalid rating " + std::string(ratings.substr(0, space)));
+			}
+			document.ratings.push_back(rating);
+		}
+		ratings.remove_prefix(std::min(space + 1, ratings.size()));
+	}
+	if (document.ratings.empty()) {
+		ThrowInvalidLine(line_number, "no ratings");
+	}
+	document.text = line;
+	return document;
+}
+
+// Appends the documents of the lines, so the ones before a malformed line stay when it throws
+void ParseCorpusLines(std::string_view corpus, std::size_t line_number, std::vector<DocumentInput>& documents) {
+	for (; !corpus.empty(); ++line_number) {
+		const std::size_t line_end = std::min(corpus.find('\n'), corpus.size());
+		std::string_view line = corpus.substr(0, line_end);
+		corpus.remove_prefix(std::min(line_end + 1, corpus.size()));
+		if (!line.empty() && line.back() == '\r') {
+			line.remove_suffix(1);
+		}
+		if (!line.empty()) {
+			documents.push_back(ParseCorpusLine(line, line_number));
+		}
+	}
+}
+
+std::vector<std::string_view> SplitIntoChunks(std::string_view corpus) {
+	std::vector<std::string_view> chunks;
+	while (!corpus.empty()) {
+		const std::size_t line_break = corpus.size() > CORPUS_CHUNK_SIZE
+			? corpus.find('\n', CORPUS_CHUNK_SIZE - 1)
+			: std::string_view::npos;
+		const std::size_t chunk_size = line_break == std::string_view::npos ? corpus.size() : line_break + 1;
+		chunks.push_back(corpus.substr(0, chunk_size));
+		corpus.remove_prefix(chunk_size);
+	}
+	return chunks;
+}
+
+}  // namespace
+
+std::vector<DocumentInput> ParseCorpus(std::string_view corpus, std::size_t first_line_number) {
+	std::vector<DocumentInput> documents;
+	ParseCorpusLines(corpus, first_line_number, documents);
+	return documents;
+}
+
+CorpusLoadStats LoadCorpus(SearchServer& search_server, const std::string& path) {
+	const MappedFile file(path);
+	const std::string_view corpus(file.data(), file.size());
+	const std::vector<std::string_view> chunks = SplitIntoChunks(corpus);
+	const std::size_t wave_size = std::max<std::size_t>(std::thread::hardware_concurrency(), 1) * CHUNKS_PER_THREAD;
+
+	CorpusLoadStats stats;
+	stats.byte_count = corpus.size();
+	std::size_t line_number = 1;
+	for (std::size_t first_chunk = 0; first_chunk < chunks.size(); first_chunk += wave_size) {
+		const std::size_t chunk_count = std::min(wave_size, chunks.size() - first_chunk);
+		std::vector<std::size_t> first_line_numbers(chunk_count);
+		std::transform(std::execution::par, chunks.begin() + first_chunk, chunks.begin() + first_chunk + chunk_count,
+			first_line_numbers.begin(), [](std::string_view chunk) {
+				return static_cast<std::size_t>(std::count(chunk.begin(), chunk.end(), '\n'));
+			});
+		for (std::size_t& count : first_line_numbers) {
+			line_number += count;
+			count = line_number - count;
+		}
+
+		// Exceptions must not leave a parallel algorithm, every chunk keeps its own
+		std::vector<std::vector<DocumentInput>> chunk_documents(chunk_count);
+		std::vector<std::exception_ptr> errors(chunk_count);
+		std::vector<std::size_t> indexes(chunk_count);
+		std::iota(indexes.begin(), indexes.end(), 0);
+		std::for_each(std::execution::par, indexes.begin(), indexes.end(),
+			[&chunks, first_chunk, &first_line_numbers, &chunk_documents, &errors](std::size_t i) {
+				try {
+					ParseCorpusLines(chunks[first_chunk + i], first_line_numbers[i], chunk_documents[i]);
+				}
+				catch (...) {
+					errors[i] = std::current_exception();
+				}
+			});
+
+		std::vector<DocumentInput> documents;
+		std::exception_ptr error;
+		for (std::size_t i = 0; i < chunk_count && !error; ++i) {
+			std::move(chunk_documents[i].begin(), chunk_documents[i].end(), std::back_inserter(documents));
+			error = errors[i];
+		}
+		// Counts the documents the server took, so nothing is counted when the batch throws
+		const std::size_t document_count = search_server.GetDocumentCount();
+		search_server.AddDocuments(std::execution::par, documents);
+		stats.document_count += search_server.GetDocumentCount() - document_count;
+		if (error) {
+			std::rethrow_exception(error);
+		}
+	}
+	return stats;
+}
@@ -0,0 +1,25 @@
+#pragma once
+
+#include <cstddef>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "document.h"
+#include "search_server.h"
+
+struct CorpusLoadStats {
+	std::size_t byte_count = 0;
+	std::size_t document_count = 0;
+};
+
+// Parses the lines of a corpus, one document per line: id, status, ratings and text separated by
+// tabs. The status is ACTUAL, IRRELEVANT, BANNED or REMOVED, the ratings are integers separated by
+// spaces, and the text is the rest of the line. Empty lines are skipped. The texts of the documents
+// point into corpus. Throws std::invalid_argument naming the first malformed line
+std::vector<DocumentInput> ParseCorpus(std::string_view corpus, std::size_t first_line_number = 1);
+
+// Maps the corpus file into memory, splits it into chunks on line boundaries and adds the documents
+// of a wave of chunks parsed in parallel to the server at once. As with AddDocuments, the documents
+// before the first malformed line or invalid document are added when it throws
+CorpusLoadStats LoadCorpus(SearchServer& search_server, const std::string& path);
@@ -1,6 +1,8 @@
 ﻿#pragma once
 
 #include <iostream>
+#include <string_view>
+#include <vector>
 
 enum class DocumentStatus {
 	ACTUAL,
@@ -18,4 +20,12 @@ struct Document {
 	int rating;
 };
 
+// Document passed to SearchServer::AddDocuments, the text must outlive the call
+struct DocumentInput {
+	int id;
+	std::string_view text;
+	DocumentStatus status;
+	std::vector<int> ratings;
+};
+
 std::ostream& operator<<(std::ostream& out, const Document& doc);
\ No newline at end of file
@@ -0,0 +1,140 @@
+#include <algorithm>
+#include <cmath>
+
+#include "document_id_index.h"
+
+namespace {
+
+bool IsLessId(const DocumentEntry& lhs, const DocumentEntry& rhs) {
+	return lhs.id < rhs.id;
+}
+
+DocumentEntry* FindInRun(std::vector<DocumentEntry>& entries, int id) {
+	const auto it = std::lower_bound(entries.begin(), entries.end(), DocumentEntry{ id, 0 }, IsLessId);
+	return it == entries.end() || it->id != id ? nullptr : &*it;
+}
+
+void EraseFromRun(std::vector<DocumentEntry>& entries, const std::vector<int>& ids) {
+	auto id = ids.begin();
+	const auto last = std::remove_if(entries.begin(), entries.end(), [&id, &ids](const DocumentEntry& entry) {
+		id = std::lower_bound(id, ids.end(), entry.id);
+		return id != ids.end() && *id == entry.id;
+	});
+	entries.erase(last, entries.end());
+}
+
+}  // namespace
+
+DocumentIdIterator::DocumentIdIterator(const DocumentEntry* main, const DocumentEntry* main_end,
+	const DocumentEntry* recent, const DocumentEntry* recent_end, const int* external_ids)
+	: main_(main)
+	, main_end_(main_end)
+	, recent_(recent)
+	, recent_end_(recent_end)
+	, external_ids_(external_ids)
+{
+	SkipRemoved();
+}
+
+DocumentIdIterator& DocumentIdIterator::operator++() {
+	if (IsMainCurrent()) {
+		++main_;
+	}
+	else {
+		++recent_;
+	}
+	SkipRemoved();
+	return *this;
+}
+
+DocumentIdIterator DocumentIdIterator::operator++(int) {
+	DocumentIdIterator result = *this;
+	++*this;
+	return result;
+}
+
+void DocumentIdIterator::SkipRemoved() {
+	while (!IsAtEnd()) {
+		const DocumentEntry& entry = GetCurrent();
+		if (external_ids_[entry.internal_id] == entry.id) {
+			return;
+		}
+		if (IsMainCurrent()) {
+			++main_;
+		}
+		else {
+			++recent_;
+		}
+	}
+}
+
+const DocumentEntry* DocumentIdIndex::Find(int id) const {
+	return const_cast<DocumentIdIndex*>(this)->Find(id);
+}
+
+DocumentEntry* DocumentIdIndex::Find(int id) {
+	DocumentEntry* entry = FindInRun(main_entries_, id);
+	return entry ? entry : FindInRun(recent_entries_, id);
+}
+
+void DocumentIdIndex::Insert(const DocumentEntry& entry) {
+	if (main_entries_.empty() || main_entries_.back().id < entry.id) {
+		main_entries_.push_back(entry);
+		return;
+	}
+	recent_entries_.insert(std::upper_bound(recent_entries_.begin(), recent_entries_.end(), entry, IsLessId), entry);
+	const auto max_recent_entry_count = static_cast<std::size_t>(std::sqrt(static_cast<double>(main_entries_.size())));
+	if (recent_entries_.size() > std::max(MIN_RECENT_ENTRY_COUNT, max_recent_entry_count)) {
+		MergeRecentEntries();
+	}
+}
+
+void DocumentIdIndex::InsertSorted(const std::vector<DocumentEntry>& entries) {
+	if (entries.empty()) {
+		return;
+	}
+	if (main_entries_.empty() || main_entries_.back().id < entries.front().id) {
+		main_entries_.insert(main_entries_.end(), entries.begin(), entries.end());
+		return;
+	}
+	MergeRecentEntries();
+	std::vector<DocumentEntry> merged;
+	merged.reserve(main_entries_.size() + entries.size());
+	std::merge(main_entries_.begin(), main_entries_.end(), entries.begin(), entries.end(),
+		std::back_inserter(merged), IsLessId);
+	main_entries_ = std::move(merged);
+}
+
+void DocumentIdIndex::EraseSorted(const std::vector<int>& ids) {
+	if (ids.empty()) {
+		return;
+	}
+	EraseFromRun(main_entries_, ids);
+	EraseFromRun(recent_entries_, ids);
+}
+
+void DocumentIdIndex::Assign(const DocumentEntry* first, const DocumentEntry* last) {
+	main_entries_.assign(first, last);
+	recent_entries_.clear();
+}
+
+DocumentIdIterator DocumentIdIndex::begin(const int* external_ids) const {
+	return DocumentIdIterator(main_entries_.data(), main_entries_.data() + main_entries_.size(),
+		recent_entries_.data(), recent_entries_.data() + recent_entries_.size(), external_ids);
+}
+
+DocumentIdIterator DocumentIdIndex::end() const {
+	const DocumentEntry* const main_end = main_entries_.data() + main_entries_.size();
+	const DocumentEntry* const recent_end = recent_entries_.data() + recent_entries_.size();
+	return DocumentIdIterator(main_end, main_end, recent_end, recent_end, nullptr);
+}
+
+void DocumentIdIndex::MergeRecentEntries() {
+	if (recent_entries_.empty()) {
+		return;
+	}
+	const std::size_t middle = main_entries_.size();
+	main_entries_.insert(main_entries_.end(), recent_entries_.begin(), recent_entries_.end());
+	std::inplace_merge(main_entries_.begin(), main_entries_.begin() + middle, main_entries_.end(), IsLessId);
+	recent_entries_.clear();
+}
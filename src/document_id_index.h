@@ -0,0 +1,95 @@
+#pragma once
+
+#include <cstddef>
+#include <iterator>
+#include <vector>
+
+// Document id and the internal id its columns are stored under
+struct DocumentEntry {
+	int id;
+	int internal_id;
+};
+
+// Ascending ids of the documents held in two sorted runs of entries. Entries of removed documents,
+// whose id the external id column no longer holds, are skipped
+class DocumentIdIterator {
+public:
+	using iterator_category = std::forward_iterator_tag;
+	using value_type = int;
+	using difference_type = std::ptrdiff_t;
+	using pointer = const int*;
+	using reference = const int&;
+
+	DocumentIdIterator() = default;
+
+	DocumentIdIterator(const DocumentEntry* main, const DocumentEntry* main_end,
+		const DocumentEntry* recent, const DocumentEntry* recent_end, const int* external_ids);
+
+	reference operator*() const { return GetCurrent().id; }
+
+	pointer operator->() const { return &GetCurrent().id; }
+
+	DocumentIdIterator& operator++();
+
+	DocumentIdIterator operator++(int);
+
+	bool operator==(const DocumentIdIterator& other) const {
+		return main_ == other.main_ && recent_ == other.recent_;
+	}
+
+	bool operator!=(const DocumentIdIterator& other) const { return !(*this == other); }
+
+private:
+	const DocumentEntry* main_ = nullptr;
+	const DocumentEntry* main_end_ = nullptr;
+	const DocumentEntry* recent_ = nullptr;
+	const DocumentEntry* recent_end_ = nullptr;
+	const int* external_ids_ = nullptr;
+
+	bool IsAtEnd() const { return main_ == main_end_ && recent_ == recent_end_; }
+
+	bool IsMainCurrent() const { return recent_ == recent_end_ || (main_ != main_end_ && main_->id < recent_->id); }
+
+	const DocumentEntry& GetCurrent() const { return IsMainCurrent() ? *main_ : *recent_; }
+
+	void SkipRemoved();
+};
+
+// Entries of the documents ordered by id. Ids above the present ones, the usual case, are appended
+// to the main run. Others are inserted into a small sorted run of recent entries, which is merged
+// into the main one once it outgrows the square root of its size, so an insertion moves O(sqrt(N))
+// entries on average. Both runs are flat arrays, a copy of the index is two array copies.
+class DocumentIdIndex {
+public:
+	// Entry of the id, nullptr if there is none
+	const DocumentEntry* Find(int id) const;
+
+	DocumentEntry* Find(int id);
+
+	// The id must be absent
+	void Insert(const DocumentEntry& entry);
+
+	// The entries are sorted by id and absent, the runs are merged in a single pass
+	void InsertSorted(const std::vector<DocumentEntry>& entries);
+
+	// Erases the entries of the sorted ids in a single pass over the runs, absent ids are ignored
+	void EraseSorted(const std::vector<int>& ids);
+
+	// Replaces the entries with the sorted ones
+	void Assign(const DocumentEntry* first, const DocumentEntry* last);
+
+	// Entries held, removed documents included
+	std::size_t size() const { return main_entries_.size() + recent_entries_.size(); }
+
+	DocumentIdIterator begin(const int* external_ids) const;
+
+	DocumentIdIterator end() const;
+
+private:
+	static constexpr std::size_t MIN_RECENT_ENTRY_COUNT = 64;
+
+	std::vector<DocumentEntry> main_entries_;
+	std::vector<DocumentEntry> recent_entries_;
+
+	void MergeRecentEntries();
+};
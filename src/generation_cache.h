@@ -0,0 +1,53 @@
+#pragma once
+
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <utility>
+
+// Holds a table derived from an index and valid for one generation of it, Table has a generation
+// member. The table is rebuilt by the first reader that finds it stale, later readers of the same
+// generation share it. Copies share the table until one of them needs a newer generation.
+template <typename Table>
+class GenerationCache {
+public:
+	GenerationCache() = default;
+
+	GenerationCache(const GenerationCache& other)
+		: table_(other.Load())
+	{}
+
+	GenerationCache& operator=(const GenerationCache& other) {
+		std::atomic_store(&table_, other.Load());
+		return *this;
+	}
+
+	// build(table) fills the table when it is missing or belongs to another generation
+	template <typename Build>
+	std::shared_ptr<const Table> Get(uint64_t generation, Build build) const {
+		std::shared_ptr<const Table> table = Load();
+		if (table && table->generation == generation) {
+			return table;
+		}
+		std::lock_guard<std::mutex> guard(mutex_);
+		table = Load();
+		if (table && table->generation == generation) {
+			return table;
+		}
+		auto new_table = std::make_shared<Table>();
+		new_table->generation = generation;
+		build(*new_table);
+		table = std::move(new_table);
+		std::atomic_store(&table_, table);
+		return table;
+	}
+
+private:
+	mutable std::mutex mutex_;
+	// Accessed through std::atomic_load and std::atomic_store only
+	mutable std::shared_ptr<const Table> table_;
+
+	std::shared_ptr<const Table> Load() const {
+		return std::atomic_load(&table_);
+	}
+};
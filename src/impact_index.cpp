@@ -0,0 +1,117 @@
+#include <algorithm>
+#include <array>
+#include <cmath>
+
+#if defined(__AVX2__) || defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define SEARCH_SERVER_SSE2
+#include <immintrin.h>
+#endif
+
+#include "impact_index.h"
+#include "posting_cursor.h"
+
+namespace {
+
+#if defined(SEARCH_SERVER_SSE2)
+// Every score takes two bits of the byte mask
+void EmitCandidates(unsigned int mask, int lane_count, int first_id, std::vector<int>& internal_ids) {
+	if (mask == 0) {
+		return;
+	}
+	for (int k = 0; k < lane_count; ++k) {
+		if ((mask >> (2 * k)) & 1) {
+			internal_ids.push_back(first_id + k);
+		}
+	}
+}
+#endif
+
+}  // namespace
+
+const TermImpacts& ImpactTable::GetTermImpacts(int term_id, const PostingListView& postings,
+	double inverse_document_freq) const {
+	TermEntry* entry = nullptr;
+	{
+		std::lock_guard<std::mutex> guard(terms_mutex_);
+		std::unique_ptr<TermEntry>& stored_entry = terms_[term_id];
+		if (!stored_entry) {
+			stored_entry = std::make_unique<TermEntry>();
+		}
+		entry = stored_entry.get();
+	}
+	TermImpacts& term = entry->impacts;
+	std::call_once(entry->flag, [this, &term, &postings, inverse_document_freq]() {
+		std::vector<uint8_t> impacts;
+		impacts.reserve(postings.size());
+		std::array<uint32_t, MAX_IMPACT + 1> impact_counts{};
+		for (PostingCursor cursor(postings); !cursor.IsAtEnd(); cursor.Next()) {
+			const double steps = step_ > 0.0 ? cursor.GetTermFreq() * inverse_document_freq / step_ : 0.0;
+			const uint8_t impact = static_cast<uint8_t>(std::min<long>(std::lround(steps), MAX_IMPACT));
+			impacts.push_back(impact);
+			++impact_counts[impact];
+		}
+
+		// Counting sort by decreasing impact keeps the ids of a segment ascending
+		std::array<uint32_t, MAX_IMPACT + 1> next_positions{};
+		uint32_t position = 0;
+		for (int impact = MAX_IMPACT; impact >= 0; --impact) {
+			if (impact_counts[impact] == 0) {
+				continue;
+			}
+			next_positions[impact] = position;
+			term.segment_begins.push_back(position);
+			term.segment_impacts.push_back(static_cast<uint8_t>(impact));
+			position += impact_counts[impact];
+		}
+		term.segment_begins.push_back(position);
+		term.document_ids.resize(impacts.size());
+		std::size_t i = 0;
+		for (PostingCursor cursor(postings); !cursor.IsAtEnd(); cursor.Next()) {
+			term.document_ids[next_positions[impacts[i++]]++] = cursor.GetDocumentId();
+		}
+	});
+	return term;
+}
+
+ImpactAccumulator::ImpactAccumulator(std::size_t document_count, std::size_t term_count, std::size_t max_count)
+	: max_count_(max_count)
+	, scores_(document_count)
+	, states_(document_count)
+	, histogram_(std::min(term_count, MAX_TERM_COUNT) * MAX_IMPACT + 1)
+{}
+
+void ImpactAccumulator::CollectCandidates(uint16_t min_score, std::vector<int>& internal_ids) const {
+	const int document_count = static_cast<int>(scores_.size());
+	int first_id = 0;
+	if (min_score == 0) {
+		for (; first_id < document_count; ++first_id) {
+			if (states_[first_id] == ACCEPTED) {
+				internal_ids.push_back(first_id);
+			}
+		}
+		return;
+	}
+	// Only accepted documents score above zero. A saturating subtraction of min_score - 1 leaves
+	// zero exactly in the lanes below min_score
+#if defined(__AVX2__)
+	const __m256i wide_bound = _mm256_set1_epi16(static_cast<short>(min_score - 1));
+	for (; first_id + 16 <= document_count; first_id += 16) {
+		const __m256i scores = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(scores_.data() + first_id));
+		const __m256i is_below = _mm256_cmpeq_epi16(_mm256_subs_epu16(scores, wide_bound), _mm256_setzero_si256());
+		EmitCandidates(~static_cast<unsigned int>(_mm256_movemask_epi8(is_below)), 16, first_id, internal_ids);
+	}
+#endif
+#if defined(SEARCH_SERVER_SSE2)
+	const __m128i bound = _mm_set1_epi16(static_cast<short>(min_score - 1));
+	for (; first_id + 8 <= document_count; first_id += 8) {
+		const __m128i scores = _mm_loadu_si128(reinterpret_cast<const __m128i*>(scores_.data() + first_id));
+		const __m128i is_below = _mm_cmpeq_epi16(_mm_subs_epu16(scores, bound), _mm_setzero_si128());
+		EmitCandidates(~static_cast<unsigned int>(_mm_movemask_epi8(is_below)) & 0xFFFFu, 8, first_id, internal_ids);
+	}
+#endif
+	for (; first_id < document_count; ++first_id) {
+		if (scores_[first_id] >= min_score) {
+			internal_ids.push_back(first_id);
+		}
+	}
+}
@@ -0,0 +1,142 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+#include <vector>
+
+#include "generation_cache.h"
+#include "inverted_index.h"
+
+// Impacts fit a byte
+const int MAX_IMPACT = 255;
+
+// Rescoring a document exactly fetches its forward index from memory, which costs about as much as
+// scoring this many postings
+const std::size_t POSTINGS_PER_RESCORED_DOCUMENT = 256;
+
+// Postings of a term by decreasing impact, the score of a posting rounded to a whole number of
+// steps of its table. Postings of equal impact form a segment and keep ascending ids within it
+struct TermImpacts {
+	std::vector<int> document_ids;
+	// Segment i holds the postings [segment_begins[i], segment_begins[i + 1])
+	std::vector<uint32_t> segment_begins;
+	std::vector<uint8_t> segment_impacts;
+};
+
+// Impacts of the terms of an index for one generation. A term is quantized on its first request,
+// so only the terms queried pay for it, and a new generation costs nothing until then. The step is
+// the score of impact 1, every score of the index is at most MAX_IMPACT steps, so rounding moves a
+// score by at most half a step
+class ImpactTable {
+public:
+	uint64_t generation = 0;
+
+	void SetStep(double step) { step_ = step; }
+
+	double GetStep() const { return step_; }
+
+	// The postings and the inverse document frequency of the term are read on its first request only
+	const TermImpacts& GetTermImpacts(int term_id, const PostingListView& postings,
+		double inverse_document_freq) const;
+
+private:
+	struct TermEntry {
+		std::once_flag flag;
+		TermImpacts impacts;
+	};
+
+	double step_ = 0.0;
+	// Guards the map only, a term is quantized once outside of it
+	mutable std::mutex terms_mutex_;
+	mutable std::unordered_map<int, std::unique_ptr<TermEntry>> terms_;
+};
+
+using ImpactTableCache = GenerationCache<ImpactTable>;
+
+// Sums of quantized impacts of the documents with internal ids below document_count in dense 16-bit
+// counters. Documents are accepted or rejected on their first posting, only accepted ones are
+// scored. The score of the max_count-th best document is tracked as the scores grow
+class ImpactAccumulator {
+public:
+	// Sums of up to this many impacts fit the counters
+	static constexpr std::size_t MAX_TERM_COUNT = UINT16_MAX / MAX_IMPACT;
+
+	ImpactAccumulator(std::size_t document_count, std::size_t term_count, std::size_t max_count);
+
+	bool IsSeen(int internal_id) const { return states_[internal_id] != UNSEEN; }
+
+	void Accept(int internal_id) {
+		states_[internal_id] = ACCEPTED;
+		++histogram_[0];
+		++accepted_count_;
+		if (threshold_ == 0) {
+			++at_threshold_count_;
+			RaiseThreshold();
+		}
+	}
+
+	void Reject(int internal_id) { states_[internal_id] = REJECTED; }
+
+	// Ignored for documents that are not accepted
+	void Add(int internal_id, uint8_t impact) {
+		if (states_[internal_id] != ACCEPTED) {
+			return;
+		}
+		const uint16_t score = scores_[internal_id];
+		const uint16_t new_score = static_cast<uint16_t>(score + impact);
+		scores_[internal_id] = new_score;
+		--histogram_[score];
+		++histogram_[new_score];
+		if (score < threshold_ && threshold_ <= new_score) {
+			++at_threshold_count_;
+			RaiseThreshold();
+		}
+	}
+
+	// max_count documents are accepted
+	bool IsFull() const { return accepted_count_ >= max_count_; }
+
+	// Score of the max_count-th best accepted document once the accumulator is full
+	uint16_t GetThreshold() const { return threshold_; }
+
+	// Accepted documents scoring at least min_score, which is not above the threshold
+	std::size_t CountAtLeast(uint16_t min_score) const {
+		std::size_t count = at_threshold_count_;
+		for (int score = min_score; score < threshold_; ++score) {
+			count += histogram_[score];
+		}
+		return count;
+	}
+
+	// Appends the ids of the accepted documents scoring at least min_score in ascending order.
+	// Scores are compared with the bound several at a time with SIMD instructions
+	void CollectCandidates(uint16_t min_score, std::vector<int>& internal_ids) const;
+
+private:
+	enum State : uint8_t {
+		UNSEEN,
+		ACCEPTED,
+		REJECTED,
+	};
+
+	std::size_t max_count_;
+	std::vector<uint16_t> scores_;
+	std::vector<uint8_t> states_;
+	// Number of accepted documents by score
+	std::vector<uint32_t> histogram_;
+	std::size_t accepted_count_ = 0;
+	uint16_t threshold_ = 0;
+	// Accepted documents scoring at least the threshold
+	std::size_t at_threshold_count_ = 0;
+
+	// Scores only grow, so the threshold does too
+	void RaiseThreshold() {
+		while (at_threshold_count_ - histogram_[threshold_] >= max_count_) {
+			at_threshold_count_ -= histogram_[threshold_];
+			++threshold_;
+		}
+	}
+};
@@ -0,0 +1,294 @@
+#include <algorithm>
+#include <cstring>
+#include <filesystem>
+#include <stdexcept>
+
+#include "index_snapshot.h"
+
+namespace {
+
+const char SNAPSHOT_MAGIC[8] = { 'S', 'R', 'C', 'H', 'S', 'N', 'A', 'P' };
+const uint32_t BYTE_ORDER_MARK = 0x01020304;
+const uint64_t SECTION_ALIGNMENT = 8;
+
+}  // namespace
+
+IndexSnapshot::IndexSnapshot(const std::string& path)
+	: file_(path)
+{
+	if (file_.size() < sizeof(SnapshotHeader)) {
+		throw std::runtime_error("Not a search server snapshot: " + path);
+	}
+	header_ = reinterpret_cast<const SnapshotHeader*>(file_.data());
+	if (std::memcmp(header_->magic, SNAPSHOT_MAGIC, sizeof(SNAPSHOT_MAGIC)) != 0
+		|| header_->byte_order != BYTE_ORDER_MARK) {
+		throw std::runtime_error("Not a search server snapshot: " + path);
+	}
+	if (header_->version != VERSION) {
+		throw std::runtime_error("Unsupported snapshot version " + std::to_string(header_->version) + ": " + path);
+	}
+	if (header_->file_size != file_.size() || header_->index_mode > static_cast<uint32_t>(IndexMode::COMPRESSED)) {
+		throw std::runtime_error("Damaged snapshot: " + path);
+	}
+
+	stop_word_offsets_ = GetSection<uint64_t>(header_->stop_word_offsets, header_->stop_word_count + 1);
+	stop_word_chars_ = GetSection<char>(header_->stop_word_chars, stop_word_offsets_[header_->stop_word_count]);
+	term_offsets_ = GetSection<uint64_t>(header_->term_offsets, header_->term_count + 1);
+	term_chars_ = GetSection<char>(header_->term_chars, term_offsets_[header_->term_count]);
+	term_postings_ = GetSection<SnapshotPostings>(header_->term_postings, header_->term_count);
+	document_entries_ = GetSection<DocumentEntry>(header_->document_entries, header_->document_count);
+	document_external_ids_ = GetSection<int>(header_->document_external_ids, header_->internal_id_count);
+	document_ratings_ = GetSection<int>(header_->document_ratings, header_->internal_id_count);
+	document_statuses_ = GetSection<int>(header_->document_statuses, header_->internal_id_count);
+	document_lengths_ = GetSection<int>(header_->document_lengths, header_->internal_id_count);
+	document_word_offsets_ = GetSection<uint64_t>(header_->document_word_offsets, header_->internal_id_count + 1);
+	document_word_term_ids_ = GetSection<int>(header_->document_word_term_ids, header_->document_word_count);
+	document_word_freqs_ = GetSection<double>(header_->document_word_freqs, header_->document_word_count);
+	if (document_word_offsets_[header_->internal_id_count] > header_->document_word_count
+		|| header_->document_count > header_->internal_id_count
+		|| !std::is_sorted(stop_word_offsets_, stop_word_offsets_ + header_->stop_word_count + 1)
+		|| !std::is_sorted(term_offsets_, term_offsets_ + header_->term_count + 1)) {
+		throw std::runtime_error("Damaged snapshot: " + path);
+	}
+	for (uint64_t i = 0; i < header_->document_count; ++i) {
+		const auto [document_id, internal_id] = document_entries_[i];
+		if (internal_id < 0 || static_cast<uint64_t>(internal_id) >= header_->internal_id_count
+			|| document_external_ids_[internal_id] != document_id
+			|| (i > 0 && document_entries_[i - 1].id >= document_id)) {
+			throw std::runtime_error("Damaged snapshot: " + path);
+		}
+	}
+
+	for (uint64_t term_id = 0; term_id < header_->term_count; ++term_id) {
+		const SnapshotPostings& postings = term_postings_[term_id];
+		if (GetIndexMode() == IndexMode::FLAT) {
+			GetSection<int>(postings.primary_offset, postings.primary_count);
+			GetSection<double>(postings.secondary_offset, postings.secondary_count);
+			if (postings.primary_count != postings.size || postings.secondary_count != postings.size) {
+				throw std::runtime_error("Damaged snapshot: " + path);
+			}
+			continue;
+		}
+		const PostingBlock* blocks = GetSection<PostingBlock>(postings.primary_offset, postings.primary_count);
+		GetSection<uint8_t>(postings.secondary_offset, postings.secondary_count);
+		uint64_t size = 0;
+		for (uint64_t i = 0; i < postings.primary_count; ++i) {
+			if (blocks[i].size == 0 || blocks[i].size > PostingList::BLOCK_SIZE
+				|| blocks[i].offset >= postings.secondary_count) {
+				throw std::runtime_error("Damaged snapshot: " + path);
+			}
+			size += blocks[i].size;
+		}
+		if (size != postings.size) {
+			throw std::runtime_error("Damaged snapshot: " + path);
+		}
+	}
+}
+
+IndexMode IndexSnapshot::GetIndexMode() const {
+	return static_cast<IndexMode>(header_->index_mode);
+}
+
+std::vector<std::string_view> IndexSnapshot::GetStopWords() const {
+	std::vector<std::string_view> result;
+	result.reserve(header_->stop_word_count);
+	for (uint64_t i = 0; i < header_->stop_word_count; ++i) {
+		result.emplace_back(stop_word_chars_ + stop_word_offsets_[i], stop_word_offsets_[i + 1] - stop_word_offsets_[i]);
+	}
+	return result;
+}
+
+std::string_view IndexSnapshot::GetTerm(int term_id) const {
+	return { term_chars_ + term_offsets_[term_id], term_offsets_[term_id + 1] - term_offsets_[term_id] };
+}
+
+int IndexSnapshot::FindTermId(std::string_view term) const {
+	int first = 0;
+	int last = static_cast<int>(header_->term_count);
+	while (first < last) {
+		const int middle = first + (last - first) / 2;
+		if (GetTerm(middle) < term) {
+			first = middle + 1;
+		}
+		else {
+			last = middle;
+		}
+	}
+	return first < static_cast<int>(header_->term_count) && GetTerm(first) == term ? first : InvertedIndex::NO_TERM;
+}
+
+PostingListView IndexSnapshot::GetPostings(int term_id) const {
+	const SnapshotPostings& postings = term_postings_[term_id];
+	const char* data = file_.data();
+	if (GetIndexMode() == IndexMode::FLAT) {
+		return PostingListView(postings.size, postings.max_term_freq,
+			reinterpret_cast<const int*>(data + postings.primary_offset),
+			reinterpret_cast<const double*>(data + postings.secondary_offset));
+	}
+	return PostingListView(postings.size, postings.max_term_freq,
+		reinterpret_cast<const PostingBlock*>(data + postings.primary_offset), postings.primary_count,
+		reinterpret_cast<const uint8_t*>(data + postings.secondary_offset), postings.secondary_count);
+}
+
+int IndexSnapshot::FindDocument(int document_id) const {
+	const DocumentEntry* last = document_entries_ + header_->document_count;
+	const DocumentEntry* it = std::lower_bound(document_entries_, last, document_id,
+		[](const DocumentEntry& entry, int id) { return entry.id < id; });
+	return it == last || it->id != document_id ? NO_DOCUMENT : it->internal_id;
+}
+
+const std::map<std::string_view, double>& IndexSnapshot::GetWordFrequencies(int internal_id) const {
+	std::lock_guard guard(word_frequencies_mutex_);
+	const auto [it, inserted] = word_frequencies_.try_emplace(internal_id);
+	if (inserted) {
+		ForEachWord(internal_id, [&word_to_freq = it->second](std::string_view term, double term_freq) {
+			word_to_freq.emplace_hint(word_to_freq.end(), term, term_freq);
+		});
+	}
+	return it->second;
+}
+
+template <typename T>
+const T* IndexSnapshot::GetSection(uint64_t offset, uint64_t count) const {
+	if (offset % alignof(T) != 0 || offset > file_.size() || count > (file_.size() - offset) / sizeof(T)) {
+		throw std::runtime_error("Damaged snapshot section at offset " + std::to_string(offset));
+	}
+	return reinterpret_cast<const T*>(file_.data() + offset);
+}
+
+SnapshotWriter::SnapshotWriter(const std::string& path, IndexMode mode)
+	: path_(path)
+	, output_(path + ".tmp", std::ios::binary | std::ios::trunc)
+{
+	if (!output_) {
+		throw std::runtime_error("Can't create snapshot: " + path);
+	}
+	std::memcpy(header_.magic, SNAPSHOT_MAGIC, sizeof(SNAPSHOT_MAGIC));
+	header_.version = IndexSnapshot::VERSION;
+	header_.byte_order = BYTE_ORDER_MARK;
+	header_.index_mode = static_cast<uint32_t>(mode);
+	// The header is rewritten with the final offsets by Finish
+	WriteArray(&header_, 1);
+}
+
+void SnapshotWriter::AddStopWord(std::string_view word) {
+	stop_word_chars_ += word;
+	stop_word_offsets_.push_back(stop_word_chars_.size());
+}
+
+void SnapshotWriter::AddTerm(std::string_view term, const PostingListView& postings) {
+	if (!term_postings_.empty()) {
+		const std::string_view previous_term = std::string_view(term_chars_).substr(term_offsets_.end()[-2]);
+		if (previous_term >= term) {
+			throw std::invalid_argument("Snapshot terms must be added in ascending order: " + std::string(term));
+		}
+	}
+	term_chars_ += term;
+	term_offsets_.push_back(term_chars_.size());
+
+	SnapshotPostings entry{ postings.size(), postings.GetMaxTermFreq(), 0, 0, 0, 0 };
+	if (postings.GetMode() == IndexMode::FLAT) {
+		entry.primary_offset = WriteArray(postings.GetDocumentIds(), postings.size());
+		entry.primary_count = postings.size();
+		entry.secondary_offset = WriteArray(postings.GetTermFreqs(), postings.size());
+		entry.secondary_count = postings.size();
+	}
+	else {
+		entry.primary_offset = WriteArray(postings.GetBlocks(), postings.GetBlockCount());
+		entry.primary_count = postings.GetBlockCount();
+		entry.secondary_offset = WriteArray(postings.GetBlockBytes(), postings.GetBlockByteCount());
+		entry.secondary_count = postings.GetBlockByteCount();
+	}
+	term_postings_.push_back(entry);
+}
+
+void SnapshotWriter::AddDocument(int document_id, int rating, DocumentStatus status, int length) {
+	if (document_id < 0) {
+		throw std::invalid_argument("Invalid snapshot document id: " + std::to_string(document_id));
+	}
+	document_external_ids_.push_back(document_id);
+	document_ratings_.push_back(rating);
+	document_statuses_.push_back(static_cast<int>(status));
+	document_lengths_.push_back(length);
+	document_word_offsets_.push_back(document_word_term_ids_.size());
+}
+
+void SnapshotWriter::AddFreeInternalId() {
+	document_external_ids_.push_back(IndexSnapshot::NO_DOCUMENT);
+	document_ratings_.push_back(0);
+	document_statuses_.push_back(0);
+	document_lengths_.push_back(0);
+	document_word_offsets_.push_back(document_word_term_ids_.size());
+}
+
+void SnapshotWriter::AddDocumentWord(int term_id, double term_freq) {
+	if (document_word_offsets_.end()[-2] != document_word_offsets_.back() && document_word_term_ids_.back() >= term_id) {
+		throw std::invalid_argument("Snapshot document words must be added in term order: " + std::to_string(term_id));
+	}
+	document_word_term_ids_.push_back(term_id);
+	document_word_freqs_.push_back(term_freq);
+	++document_word_offsets_.back();
+}
+
+void SnapshotWriter::Finish() {
+	header_.stop_word_count = stop_word_offsets_.size() - 1;
+	header_.stop_word_offsets = WriteArray(stop_word_offsets_.data(), stop_word_offsets_.size());
+	header_.stop_word_chars = WriteArray(stop_word_chars_.data(), stop_word_chars_.size());
+	header_.term_count = term_postings_.size();
+	header_.term_offsets = WriteArray(term_offsets_.data(), term_offsets_.size());
+	header_.term_chars = WriteArray(term_chars_.data(), term_chars_.size());
+	header_.term_postings = WriteArray(term_postings_.data(), term_postings_.size());
+	std::vector<DocumentEntry> document_entries;
+	for (std::size_t internal_id = 0; internal_id < document_external_ids_.size(); ++internal_id) {
+		if (document_external_ids_[internal_id] != IndexSnapshot::NO_DOCUMENT) {
+			document_entries.push_back({ document_external_ids_[internal_id], static_cast<int>(internal_id) });
+		}
+	}
+	std::sort(document_entries.begin(), document_entries.end(), [](const DocumentEntry& lhs, const DocumentEntry& rhs) {
+		return lhs.id < rhs.id;
+	});
+	for (std::size_t i = 1; i < document_entries.size(); ++i) {
+		if (document_entries[i - 1].id == document_entries[i].id) {
+			throw std::invalid_argument("Duplicate snapshot document id: " + std::to_string(document_entries[i].id));
+		}
+	}
+	header_.document_count = document_entries.size();
+	header_.document_entries = WriteArray(document_entries.data(), document_entries.size());
+	header_.internal_id_count = document_external_ids_.size();
+	header_.document_external_ids = WriteArray(document_external_ids_.data(), document_external_ids_.size());
+	header_.document_ratings = WriteArray(document_ratings_.data(), document_ratings_.size());
+	header_.document_statuses = WriteArray(document_statuses_.data(), document_statuses_.size());
+	header_.document_lengths = WriteArray(document_lengths_.data(), document_lengths_.size());
+	header_.document_word_offsets = WriteArray(document_word_offsets_.data(), document_word_offsets_.size());
+	header_.document_word_count = document_word_term_ids_.size();
+	header_.document_word_term_ids = WriteArray(document_word_term_ids_.data(), document_word_term_ids_.size());
+	header_.document_word_freqs = WriteArray(document_word_freqs_.data(), document_word_freqs_.size());
+	header_.file_size = offset_;
+
+	output_.seekp(0);
+	output_.write(reinterpret_cast<const char*>(&header_), sizeof(header_));
+	output_.close();
+	if (!output_) {
+		throw std::runtime_error("Can't write snapshot: " + path_);
+	}
+	// Servers may still map the previous file, it has to be replaced rather than overwritten
+	std::error_code error;
+	std::filesystem::rename(path_ + ".tmp", path_, error);
+	if (error) {
+		throw std::runtime_error("Can't write snapshot: " + path_ + ": " + error.message());
+	}
+}
+
+template <typename T>
+uint64_t SnapshotWriter::WriteArray(const T* data, std::size_t count) {
+	static const char padding[SECTION_ALIGNMENT] = {};
+	const uint64_t padding_size = (SECTION_ALIGNMENT - offset_ % SECTION_ALIGNMENT) % SECTION_ALIGNMENT;
+	output_.write(padding, static_cast<std::streamsize>(padding_size));
+	const uint64_t offset = offset_ + padding_size;
+	output_.write(reinterpret_cast<const char*>(data), static_cast<std::streamsize>(count * sizeof(T)));
+	offset_ = offset + count * sizeof(T);
+	if (!output_) {
+		throw std::runtime_error("Can't write snapshot: " + path_);
+	}
+	return offset;
+}
@@ -0,0 +1,211 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <fstream>
+#include <map>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "document.h"
+#include "document_id_index.h"
+#include "inverted_index.h"
+#include "mapped_file.h"
+
+// Snapshot file layout. Every section is an array aligned to 8 bytes and addressed by its
+// offset from the start of the file, so a mapped snapshot is read in place. Terms are stored
+// sorted, and the id of a term is its rank.
+struct SnapshotHeader {
+	char magic[8];
+	uint32_t version;
+	uint32_t byte_order;
+	uint32_t index_mode;
+	uint32_t reserved;
+	uint64_t file_size;
+
+	uint64_t stop_word_count;
+	uint64_t stop_word_offsets;  // uint64_t[stop_word_count + 1] into stop_word_chars
+	uint64_t stop_word_chars;
+
+	uint64_t term_count;
+	uint64_t term_offsets;  // uint64_t[term_count + 1] into term_chars
+	uint64_t term_chars;
+	uint64_t term_postings;  // SnapshotPostings[term_count]
+	// Bound of the term frequencies of every posting the index held, the scale of its impacts
+	double max_term_freq;
+
+	uint64_t document_count;
+	uint64_t document_entries;  // DocumentEntry[document_count], ascending ids
+
+	// Documents by internal id, the ids postings refer to
+	uint64_t internal_id_count;
+	uint64_t document_external_ids;  // int[internal_id_count], NO_DOCUMENT for free ids
+	uint64_t document_ratings;  // int[internal_id_count]
+	uint64_t document_statuses;  // int[internal_id_count]
+	uint64_t document_lengths;  // int[internal_id_count]
+	uint64_t document_word_offsets;  // uint64_t[internal_id_count + 1] into the word arrays
+	uint64_t document_word_count;
+	uint64_t document_word_term_ids;  // int[document_word_count]
+	uint64_t document_word_freqs;  // double[document_word_count]
+};
+
+// Posting list of a term. Flat lists keep size document ids in the primary array and
+// size term frequencies in the secondary one, compressed lists keep PostingBlock entries
+// and their varint payload.
+struct SnapshotPostings {
+	uint64_t size;
+	double max_term_freq;
+	uint64_t primary_offset;
+	uint64_t primary_count;
+	uint64_t secondary_offset;
+	uint64_t secondary_count;
+};
+
+// SearchServer state mapped from a snapshot file. The checks made on opening reject
+// truncated, foreign and outdated files, the posting payloads themselves are trusted.
+class IndexSnapshot {
+public:
+	static const uint32_t VERSION = 6;
+	static constexpr int NO_DOCUMENT = -1;
+
+	explicit IndexSnapshot(const std::string& path);
+
+	IndexMode GetIndexMode() const;
+
+	std::vector<std::string_view> GetStopWords() const;
+
+	std::size_t GetTermCount() const { return header_->term_count; }
+
+	double GetMaxTermFreq() const { return header_->max_term_freq; }
+
+	std::string_view GetTerm(int term_id) const;
+
+	int FindTermId(std::string_view term) const;
+
+	PostingListView GetPostings(int term_id) const;
+
+	std::size_t GetDocumentCount() const { return header_->document_count; }
+
+	// Entries of all documents sorted by id
+	const DocumentEntry* GetDocumentEntries() const { return document_entries_; }
+
+	std::size_t GetInternalIdCount() const { return header_->internal_id_count; }
+
+	// Internal id of the document, NO_DOCUMENT if it is absent
+	int FindDocument(int document_id) const;
+
+	// Columns indexed by internal id
+	const int* GetExternalIds() const { return document_external_ids_; }
+
+	const int* GetRatings() const { return document_ratings_; }
+
+	const int* GetStatuses() const { return document_statuses_; }
+
+	const int* GetLengths() const { return document_lengths_; }
+
+	// Term ids of the words of the document in ascending order, as many as GetWordCount tells
+	const int* GetTermIds(int internal_id) const {
+		return document_word_term_ids_ + document_word_offsets_[internal_id];
+	}
+
+	// Term frequencies in the order of GetTermIds
+	const double* GetTermFreqs(int internal_id) const {
+		return document_word_freqs_ + document_word_offsets_[internal_id];
+	}
+
+	std::size_t GetWordCount(int internal_id) const {
+		return document_word_offsets_[internal_id + 1] - document_word_offsets_[internal_id];
+	}
+
+	// Calls function(term, term_freq) for every word of the document in term order
+	template <typename Function>
+	void ForEachWord(int internal_id, Function function) const {
+		for (uint64_t i = document_word_offsets_[internal_id]; i < document_word_offsets_[internal_id + 1]; ++i) {
+			function(GetTerm(document_word_term_ids_[i]), document_word_freqs_[i]);
+		}
+	}
+
+	// Calls function(term_id, term_freq) for every word of the document in term order
+	template <typename Function>
+	void ForEachTermId(int internal_id, Function function) const {
+		for (uint64_t i = document_word_offsets_[internal_id]; i < document_word_offsets_[internal_id + 1]; ++i) {
+			function(document_word_term_ids_[i], document_word_freqs_[i]);
+		}
+	}
+
+	// Built on first request and kept while the snapshot is alive
+	const std::map<std::string_view, double>& GetWordFrequencies(int internal_id) const;
+
+private:
+	MappedFile file_;
+	const SnapshotHeader* header_;
+	const uint64_t* stop_word_offsets_;
+	const char* stop_word_chars_;
+	const uint64_t* term_offsets_;
+	const char* term_chars_;
+	const SnapshotPostings* term_postings_;
+	const DocumentEntry* document_entries_;
+	const int* document_external_ids_;
+	const int* document_ratings_;
+	const int* document_statuses_;
+	const int* document_lengths_;
+	const uint64_t* document_word_offsets_;
+	const int* document_word_term_ids_;
+	const double* document_word_freqs_;
+
+	mutable std::mutex word_frequencies_mutex_;
+	mutable std::map<int, std::map<std::string_view, double>> word_frequencies_;
+
+	template <typename T>
+	const T* GetSection(uint64_t offset, uint64_t count) const;
+};
+
+// Writes a snapshot file section by section. Terms must be added in ascending order and
+// documents in internal id order, every document followed by its words in term order. The file
+// appears at its path only once Finish succeeds.
+class SnapshotWriter {
+public:
+	SnapshotWriter(const std::string& path, IndexMode mode);
+
+	void AddStopWord(std::string_view word);
+
+	void AddTerm(std::string_view term, const PostingListView& postings);
+
+	// Term statistics are derived from the postings, only this index-wide bound is stored
+	void SetMaxTermFreq(double max_term_freq) { header_.max_term_freq = max_term_freq; }
+
+	// The document gets the next internal id
+	void AddDocument(int document_id, int rating, DocumentStatus status, int length);
+
+	// Skips an internal id no document holds
+	void AddFreeInternalId();
+
+	void AddDocumentWord(int term_id, double term_freq);
+
+	void Finish();
+
+private:
+	std::string path_;
+	std::ofstream output_;
+	SnapshotHeader header_{};
+	uint64_t offset_ = 0;
+
+	std::vector<uint64_t> stop_word_offsets_ = { 0 };
+	std::string stop_word_chars_;
+	std::vector<uint64_t> term_offsets_ = { 0 };
+	std::string term_chars_;
+	std::vector<SnapshotPostings> term_postings_;
+	std::vector<int> document_external_ids_;
+	std::vector<int> document_ratings_;
+	std::vector<int> document_statuses_;
+	std::vector<int> document_lengths_;
+	std::vector<uint64_t> document_word_offsets_ = { 0 };
+	std::vector<int> document_word_term_ids_;
+	std::vector<double> document_word_freqs_;
+
+	// Appends the array at the next 8 byte boundary and returns its offset
+	template <typename T>
+	uint64_t WriteArray(const T* data, std::size_t count);
+};
@@ -0,0 +1,506 @@
+#include <algorithm>
+#include <atomic>
+#include <iterator>
+
+#include "index_snapshot.h"
+#include "inverted_index.h"
+
+namespace {
+
+// Owners of a shared object never change it, so a count of one can't grow concurrently. The
+// fence orders the reads made by released owners before the changes of the remaining one
+template <typename T>
+bool IsSoleOwner(const std::shared_ptr<T>& pointer) {
+	if (pointer.use_count() != 1) {
+		return false;
+	}
+	std::atomic_thread_fence(std::memory_order_acquire);
+	return true;
+}
+
+void WriteVarint(std::vector<uint8_t>& bytes, uint32_t value) {
+	while (value >= 0x80) {
+		bytes.push_back(static_cast<uint8_t>(value | 0x80));
+		value >>= 7;
+	}
+	bytes.push_back(static_cast<uint8_t>(value));
+}
+
+uint32_t ReadVarint(const uint8_t*& data) {
+	uint32_t value = 0;
+	int shift = 0;
+	while (*data & 0x80) {
+		value |= static_cast<uint32_t>(*data++ & 0x7f) << shift;
+		shift += 7;
+	}
+	value |= static_cast<uint32_t>(*data++) << shift;
+	return value;
+}
+
+// Index of the first block whose last id is not less than document_id
+std::size_t FindBlockIndex(const PostingBlock* blocks, std::size_t block_count, int document_id) {
+	const PostingBlock* it = std::lower_bound(blocks, blocks + block_count, document_id,
+		[](const PostingBlock& block, int document_id) { return block.last_id < document_id; });
+	return static_cast<std::size_t>(it - blocks);
+}
+
+// Calls function(document_id, count, document_length) for every posting of the block
+template <typename Function>
+void DecodePostings(const PostingBlock& block, const uint8_t* bytes, Function function) {
+	const uint8_t* data = bytes + block.offset;
+	int document_id = block.first_id;
+	for (uint32_t i = 0; i < block.size; ++i) {
+		document_id += static_cast<int>(ReadVarint(data));
+		const int count = static_cast<int>(ReadVarint(data));
+		const int document_length = static_cast<int>(ReadVarint(data));
+		function(document_id, count, document_length);
+	}
+}
+
+}  // namespace
+
+double ComputeTermFreq(int count, int document_length) {
+	return static_cast<double>(count) / document_length;
+}
+
+PostingListView::PostingListView(std::size_t size, double max_term_freq, const int* document_ids,
+	const double* term_freqs)
+	: mode_(IndexMode::FLAT)
+	, size_(size)
+	, max_term_freq_(max_term_freq)
+	, document_ids_(document_ids)
+	, term_freqs_(term_freqs)
+{}
+
+PostingListView::PostingListView(std::size_t size, double max_term_freq, const PostingBlock* blocks,
+	std::size_t block_count, const uint8_t* bytes, std::size_t byte_count)
+	: mode_(IndexMode::COMPRESSED)
+	, size_(size)
+	, max_term_freq_(max_term_freq)
+	, blocks_(blocks)
+	, block_count_(block_count)
+	, bytes_(bytes)
+	, byte_count_(byte_count)
+{}
+
+int PostingListView::GetLastDocumentId() const {
+	return mode_ == IndexMode::FLAT ? document_ids_[size_ - 1] : blocks_[block_count_ - 1].last_id;
+}
+
+int PostingListView::GetDocumentIdAt(std::size_t position) const {
+	if (mode_ == IndexMode::FLAT) {
+		return document_ids_[position];
+	}
+	std::size_t block_index = 0;
+	while (position >= blocks_[block_index].size) {
+		position -= blocks_[block_index].size;
+		++block_index;
+	}
+	int result = 0;
+	DecodePostings(blocks_[block_index], bytes_, [&position, &result](int document_id, int, int) {
+		if (position-- == 0) {
+			result = document_id;
+		}
+	});
+	return result;
+}
+
+bool PostingListView::Contains(int document_id) const {
+	if (mode_ == IndexMode::FLAT) {
+		return std::binary_search(document_ids_, document_ids_ + size_, document_id);
+	}
+	const std::size_t block_index = FindBlock(document_id);
+	if (block_index == block_count_ || blocks_[block_index].first_id > document_id) {
+		return false;
+	}
+	bool result = false;
+	DecodePostings(blocks_[block_index], bytes_, [document_id, &result](int id, int, int) {
+		result = result || id == document_id;
+	});
+	return result;
+}
+
+std::size_t PostingListView::CountInRange(int first_id, int last_id) const {
+	if (mode_ == IndexMode::FLAT) {
+		const int* first = std::lower_bound(document_ids_, document_ids_ + size_, first_id);
+		return static_cast<std::size_t>(std::upper_bound(first, document_ids_ + size_, last_id) - first);
+	}
+	std::size_t result = 0;
+	for (std::size_t i = FindBlock(first_id); i < block_count_ && blocks_[i].first_id <= last_id; ++i) {
+		result += blocks_[i].size;
+	}
+	return result;
+}
+
+std::size_t PostingListView::FindBlock(int document_id) const {
+	return FindBlockIndex(blocks_, block_count_, document_id);
+}
+
+std::size_t PostingListView::DecodeBlock(std::size_t block_index, int* document_ids, double* term_freqs) const {
+	std::size_t i = 0;
+	DecodePostings(blocks_[block_index], bytes_,
+		[document_ids, term_freqs, &i](int document_id, int count, int document_length) {
+			document_ids[i] = document_id;
+			term_freqs[i] = ComputeTermFreq(count, document_length);
+			++i;
+		});
+	return i;
+}
+
+PostingList::PostingList(IndexMode mode)
+	: mode_(mode)
+{}
+
+PostingList::PostingList(const PostingListView& postings)
+	: mode_(postings.GetMode())
+	, size_(postings.size())
+	, max_term_freq_(postings.GetMaxTermFreq())
+{
+	if (mode_ == IndexMode::FLAT) {
+		document_ids_.assign(postings.GetDocumentIds(), postings.GetDocumentIds() + size_);
+		term_freqs_.assign(postings.GetTermFreqs(), postings.GetTermFreqs() + size_);
+	}
+	else {
+		blocks_.assign(postings.GetBlocks(), postings.GetBlocks() + postings.GetBlockCount());
+		bytes_.assign(postings.GetBlockBytes(), postings.GetBlockBytes() + postings.GetBlockByteCount());
+	}
+}
+
+PostingListView PostingList::GetView() const {
+	if (mode_ == IndexMode::FLAT) {
+		return PostingListView(size_, max_term_freq_, document_ids_.data(), term_freqs_.data());
+	}
+	return PostingListView(size_, max_term_freq_, blocks_.data(), blocks_.size(), bytes_.data(), bytes_.size());
+}
+
+void PostingList::Add(int document_id, int count, int document_length) {
+	const double term_freq = ComputeTermFreq(count, document_length);
+	max_term_freq_ = std::max(max_term_freq_, term_freq);
+	++size_;
+
+	if (mode_ == IndexMode::FLAT) {
+		// Documents usually arrive with growing ids, so appending is the common case
+		if (document_ids_.empty() || document_ids_.back() < document_id) {
+			document_ids_.push_back(document_id);
+			term_freqs_.push_back(term_freq);
+			return;
+		}
+		const auto it = std::lower_bound(document_ids_.begin(), document_ids_.end(), document_id);
+		term_freqs_.insert(std::next(term_freqs_.begin(), std::distance(document_ids_.begin(), it)), term_freq);
+		document_ids_.insert(it, document_id);
+		return;
+	}
+
+	const RawPosting posting{ document_id, count, document_length };
+	if (blocks_.empty() || blocks_.back().last_id < document_id) {
+		if (blocks_.empty() || blocks_.back().size == BLOCK_SIZE) {
+			blocks_.push_back({ document_id, document_id, 0, 0, bytes_.size() });
+		}
+		AppendToBlock(blocks_.back(), bytes_, posting);
+		return;
+	}
+
+	// Out of order ids re-encode the single block they fall into
+	const std::size_t block_index = FindBlock(document_id);
+	std::vector<RawPosting> postings = DecodeRawBlock(block_index);
+	const auto it = std::lower_bound(postings.begin(), postings.end(), document_id,
+		[](const RawPosting& lhs, int rhs) { return lhs.document_id < rhs; });
+	postings.insert(it, posting);
+	ReplaceBlock(block_index, postings);
+}
+
+void PostingList::Remove(int document_id) {
+	if (mode_ == IndexMode::FLAT) {
+		const auto it = std::lower_bound(document_ids_.begin(), document_ids_.end(), document_id);
+		if (it == document_ids_.end() || *it != document_id) {
+			return;
+		}
+		term_freqs_.erase(std::next(term_freqs_.begin(), std::distance(document_ids_.begin(), it)));
+		document_ids_.erase(it);
+		--size_;
+		return;
+	}
+
+	const std::size_t block_index = FindBlock(document_id);
+	if (block_index == blocks_.size() || blocks_[block_index].first_id > document_id) {
+		return;
+	}
+	std::vector<RawPosting> postings = DecodeRawBlock(block_index);
+	const auto it = std::find_if(postings.begin(), postings.end(), [document_id](const RawPosting& posting) {
+		return posting.document_id == document_id;
+	});
+	if (it == postings.end()) {
+		return;
+	}
+	postings.erase(it);
+	ReplaceBlock(block_index, postings);
+	--size_;
+}
+
+void PostingList::Remove(const std::vector<int>& document_ids) {
+	auto removed = document_ids.begin();
+	const auto is_removed = [&removed, &document_ids](int document_id) {
+		removed = std::lower_bound(removed, document_ids.end(), document_id);
+		return removed != document_ids.end() && *removed == document_id;
+	};
+	if (mode_ == IndexMode::FLAT) {
+		std::size_t kept = 0;
+		for (std::size_t i = 0; i < size_; ++i) {
+			if (!is_removed(document_ids_[i])) {
+				document_ids_[kept] = document_ids_[i];
+				term_freqs_[kept] = term_freqs_[i];
+				++kept;
+			}
+		}
+		document_ids_.resize(kept);
+		term_freqs_.resize(kept);
+		size_ = kept;
+		return;
+	}
+
+	// Blocks without removed postings are copied as they are, the others are re-encoded
+	std::vector<PostingBlock> blocks;
+	std::vector<uint8_t> bytes;
+	blocks.reserve(blocks_.size());
+	bytes.reserve(bytes_.size());
+	for (std::size_t i = 0; i < blocks_.size(); ++i) {
+		const PostingBlock& block = blocks_[i];
+		removed = std::lower_bound(removed, document_ids.end(), block.first_id);
+		if (removed == document_ids.end() || *removed > block.last_id) {
+			const uint64_t last_byte = i + 1 < blocks_.size() ? blocks_[i + 1].offset : bytes_.size();
+			blocks.push_back(block);
+			blocks.back().offset = bytes.size();
+			bytes.insert(bytes.end(), std::next(bytes_.begin(), block.offset), std::next(bytes_.begin(), last_byte));
+			continue;
+		}
+		bool is_block_started = false;
+		for (const RawPosting& posting : DecodeRawBlock(i)) {
+			if (is_removed(posting.document_id)) {
+				--size_;
+				continue;
+			}
+			if (!is_block_started) {
+				blocks.push_back({ posting.document_id, posting.document_id, 0, 0, bytes.size() });
+				is_block_started = true;
+			}
+			AppendToBlock(blocks.back(), bytes, posting);
+		}
+	}
+	blocks_ = std::move(blocks);
+	bytes_ = std::move(bytes);
+}
+
+std::size_t PostingList::GetMemoryUsage() const {
+	return document_ids_.capacity() * sizeof(int) + term_freqs_.capacity() * sizeof(double)
+		+ blocks_.capacity() * sizeof(PostingBlock) + bytes_.capacity();
+}
+
+std::size_t PostingList::FindBlock(int document_id) const {
+	return FindBlockIndex(blocks_.data(), blocks_.size(), document_id);
+}
+
+std::vector<PostingList::RawPosting> PostingList::DecodeRawBlock(std::size_t block_index) const {
+	std::vector<RawPosting> postings;
+	postings.reserve(blocks_[block_index].size);
+	DecodePostings(blocks_[block_index], bytes_.data(), [&postings](int document_id, int count, int document_length) {
+		postings.push_back({ document_id, count, document_length });
+	});
+	return postings;
+}
+
+void PostingList::ReplaceBlock(std::size_t block_index, const std::vector<RawPosting>& postings) {
+	const uint64_t first_byte = blocks_[block_index].offset;
+	const uint64_t last_byte = block_index + 1 < blocks_.size() ? blocks_[block_index + 1].offset : bytes_.size();
+
+	const std::size_t part_count = (postings.size() + BLOCK_SIZE - 1) / BLOCK_SIZE;
+	std::vector<PostingBlock> blocks;
+	std::vector<uint8_t> bytes;
+	for (std::size_t part = 0; part < part_count; ++part) {
+		const std::size_t first = postings.size() * part / part_count;
+		const std::size_t last = postings.size() * (part + 1) / part_count;
+		blocks.push_back({ postings[first].document_id, postings[first].document_id, 0, 0, first_byte + bytes.size() });
+		for (std::size_t i = first; i < last; ++i) {
+			AppendToBlock(blocks.back(), bytes, postings[i]);
+		}
+	}
+
+	// The payloads of the following blocks move by the change in size
+	const uint64_t old_byte_count = last_byte - first_byte;
+	for (std::size_t i = block_index + 1; i < blocks_.size(); ++i) {
+		blocks_[i].offset = blocks_[i].offset - old_byte_count + bytes.size();
+	}
+	bytes_.erase(std::next(bytes_.begin(), first_byte), std::next(bytes_.begin(), last_byte));
+	bytes_.insert(std::next(bytes_.begin(), first_byte), bytes.begin(), bytes.end());
+	blocks_.erase(std::next(blocks_.begin(), block_index));
+	blocks_.insert(std::next(blocks_.begin(), block_index), blocks.begin(), blocks.end());
+}
+
+void PostingList::AppendToBlock(PostingBlock& block, std::vector<uint8_t>& bytes, const RawPosting& posting) {
+	WriteVarint(bytes, static_cast<uint32_t>(posting.document_id - block.last_id));
+	WriteVarint(bytes, static_cast<uint32_t>(posting.count));
+	WriteVarint(bytes, static_cast<uint32_t>(posting.document_length));
+	block.last_id = posting.document_id;
+	++block.size;
+}
+
+InvertedIndex::InvertedIndex(IndexMode mode)
+	: mode_(mode)
+	, dictionary_(std::make_shared<TermDictionary>())
+{}
+
+InvertedIndex::InvertedIndex(std::shared_ptr<const IndexSnapshot> snapshot)
+	: mode_(snapshot->GetIndexMode())
+	, snapshot_(std::move(snapshot))
+	, dictionary_(std::make_shared<TermDictionary>())
+	, max_term_freq_(snapshot_->GetMaxTermFreq())
+{}
+
+int InvertedIndex::FindTermId(std::string_view term) const {
+	if (snapshot_) {
+		return snapshot_->FindTermId(term);
+	}
+	const auto it = dictionary_->term_to_id.find(term);
+	return it == dictionary_->term_to_id.end() ? NO_TERM : it->second;
+}
+
+int InvertedIndex::AddTerm(std::string_view term) {
+	Materialize();
+	const int term_id = FindTermId(term);
+	if (term_id != NO_TERM) {
+		return term_id;
+	}
+	TermDictionary& dictionary = GetMutableDictionary();
+	const std::string_view stored_term = dictionary.pool.Add(term);
+	int new_term_id = static_cast<int>(postings_.size());
+	if (dictionary.free_term_ids.empty()) {
+		dictionary.terms.push_back(stored_term);
+		postings_.push_back(std::make_shared<PostingList>(mode_));
+		removed_posting_counts_.push_back(0);
+	}
+	else {
+		new_term_id = dictionary.free_term_ids.back();
+		dictionary.free_term_ids.pop_back();
+		dictionary.terms[new_term_id] = stored_term;
+	}
+	dictionary.term_to_id.emplace(stored_term, new_term_id);
+	return new_term_id;
+}
+
+std::string_view InvertedIndex::GetTerm(int term_id) const {
+	return snapshot_ ? snapshot_->GetTerm(term_id) : dictionary_->terms[term_id];
+}
+
+PostingListView InvertedIndex::GetPostings(int term_id) const {
+	return snapshot_ ? snapshot_->GetPostings(term_id) : postings_[term_id]->GetView();
+}
+
+void InvertedIndex::AddPosting(int term_id, int document_id, int count, int document_length) {
+	Materialize();
+	PostingList& postings = GetMutablePostings(term_id);
+	postings.Add(document_id, count, document_length);
+	max_term_freq_ = std::max(max_term_freq_, postings.GetMaxTermFreq());
+}
+
+void InvertedIndex::RemovePosting(int term_id, int document_id) {
+	Materialize();
+	GetMutablePostings(term_id).Remove(document_id);
+}
+
+void InvertedIndex::MarkPostingRemoved(int term_id) {
+	Materialize();
+	++removed_posting_counts_[term_id];
+}
+
+std::size_t InvertedIndex::GetLivePostingCount(int term_id) const {
+	const std::size_t posting_count = GetPostings(term_id).size();
+	return snapshot_ ? posting_count : posting_count - removed_posting_counts_[term_id];
+}
+
+void InvertedIndex::PurgePostings(int term_id, const std::vector<int>& document_ids) {
+	Materialize();
+	GetMutablePostings(term_id).Remove(document_ids);
+	removed_posting_counts_[term_id] -= static_cast<int>(document_ids.size());
+}
+
+void InvertedIndex::RemoveTerm(int term_id) {
+	Materialize();
+	TermDictionary& dictionary = GetMutableDictionary();
+	dictionary.term_to_id.erase(dictionary.terms[term_id]);
+	dictionary.removed_term_size += dictionary.terms[term_id].size();
+	dictionary.terms[term_id] = {};
+	dictionary.free_term_ids.push_back(term_id);
+	// Releases the blocks of the list, versions still reading it keep their own reference
+	postings_[term_id] = std::make_shared<PostingList>(mode_);
+}
+
+bool InvertedIndex::ReclaimTerms() {
+	if (snapshot_ || dictionary_->removed_term_size * 2 <= dictionary_->pool.GetSize()) {
+		return false;
+	}
+	auto dictionary = std::make_shared<TermDictionary>();
+	dictionary->terms.resize(dictionary_->terms.size());
+	dictionary->term_to_id.reserve(dictionary_->term_to_id.size());
+	for (const auto& [term, term_id] : dictionary_->term_to_id) {
+		const std::string_view stored_term = dictionary->pool.Add(term);
+		dictionary->terms[term_id] = stored_term;
+		dictionary->term_to_id.emplace(stored_term, term_id);
+	}
+	dictionary->free_term_ids = dictionary_->free_term_ids;
+	// Copies of the index sharing the old dictionary keep its pool
+	dictionary_ = std::move(dictionary);
+	return true;
+}
+
+std::size_t InvertedIndex::GetTermCount() const {
+	return snapshot_ ? snapshot_->GetTermCount() : postings_.size();
+}
+
+std::size_t InvertedIndex::GetPostingCount() const {
+	std::size_t result = 0;
+	for (std::size_t term_id = 0; term_id < GetTermCount(); ++term_id) {
+		result += GetPostings(static_cast<int>(term_id)).size();
+	}
+	return result;
+}
+
+std::size_t InvertedIndex::GetPostingsMemoryUsage() const {
+	std::size_t result = postings_.capacity() * sizeof(std::shared_ptr<PostingList>);
+	for (const std::shared_ptr<PostingList>& postings : postings_) {
+		result += sizeof(PostingList) + postings->GetMemoryUsage();
+	}
+	return result;
+}
+
+InvertedIndex::TermDictionary& InvertedIndex::GetMutableDictionary() {
+	if (!IsSoleOwner(dictionary_)) {
+		dictionary_ = std::make_shared<TermDictionary>(*dictionary_);
+	}
+	return *dictionary_;
+}
+
+PostingList& InvertedIndex::GetMutablePostings(int term_id) {
+	std::shared_ptr<PostingList>& postings = postings_[term_id];
+	if (!IsSoleOwner(postings)) {
+		postings = std::make_shared<PostingList>(*postings);
+	}
+	return *postings;
+}
+
+void InvertedIndex::Materialize() {
+	if (!snapshot_) {
+		return;
+	}
+	const std::size_t term_count = snapshot_->GetTermCount();
+	TermDictionary& dictionary = GetMutableDictionary();
+	postings_.reserve(term_count);
+	removed_posting_counts_.assign(term_count, 0);
+	dictionary.terms.reserve(term_count);
+	dictionary.term_to_id.reserve(term_count);
+	for (std::size_t term_id = 0; term_id < term_count; ++term_id) {
+		const std::string_view stored_term = dictionary.terms.emplace_back(
+			dictionary.pool.Add(snapshot_->GetTerm(static_cast<int>(term_id))));
+		dictionary.term_to_id.emplace(stored_term, static_cast<int>(term_id));
+		postings_.push_back(std::make_shared<PostingList>(snapshot_->GetPostings(static_cast<int>(term_id))));
+	}
+	snapshot_.reset();
+}
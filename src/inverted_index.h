@@ -0,0 +1,233 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+#include "term_pool.h"
+
+class IndexSnapshot;
+
+enum class IndexMode {
+	// Plain arrays of document ids and term frequencies
+	FLAT,
+	// Blocks of delta encoded varints, decoded block at a time while querying
+	COMPRESSED,
+};
+
+// Term frequency of a word met count times among document_length words, a single rounded division,
+// so compressed postings rebuild the flat value exactly in O(1) per posting.
+double ComputeTermFreq(int count, int document_length);
+
+// Skip entry of up to BLOCK_SIZE compressed postings. The payload starting at offset holds
+// the id delta, occurrence count and document length of every posting as varints.
+struct PostingBlock {
+	int first_id;
+	int last_id;
+	uint32_t size;
+	uint32_t reserved;
+	uint64_t offset;
+};
+
+// Read-only postings of a single term sorted by document id, stored either in a PostingList
+// or in a mapped snapshot. Read them through PostingCursor.
+class PostingListView {
+public:
+	PostingListView() = default;
+
+	PostingListView(std::size_t size, double max_term_freq, const int* document_ids, const double* term_freqs);
+
+	PostingListView(std::size_t size, double max_term_freq, const PostingBlock* blocks, std::size_t block_count,
+		const uint8_t* bytes, std::size_t byte_count);
+
+	IndexMode GetMode() const { return mode_; }
+
+	std::size_t size() const { return size_; }
+
+	bool empty() const { return size_ == 0; }
+
+	// Upper bound of the term frequencies, removals do not lower it
+	double GetMaxTermFreq() const { return max_term_freq_; }
+
+	int GetLastDocumentId() const;
+
+	int GetDocumentIdAt(std::size_t position) const;
+
+	bool Contains(int document_id) const;
+
+	// Number of postings with ids in [first_id, last_id], compressed lists count whole blocks
+	std::size_t CountInRange(int first_id, int last_id) const;
+
+	const int* GetDocumentIds() const { return document_ids_; }
+
+	const double* GetTermFreqs() const { return term_freqs_; }
+
+	const PostingBlock* GetBlocks() const { return blocks_; }
+
+	std::size_t GetBlockCount() const { return block_count_; }
+
+	const uint8_t* GetBlockBytes() const { return bytes_; }
+
+	std::size_t GetBlockByteCount() const { return byte_count_; }
+
+private:
+	friend class PostingCursor;
+
+	IndexMode mode_ = IndexMode::FLAT;
+	std::size_t size_ = 0;
+	double max_term_freq_ = 0.0;
+
+	const int* document_ids_ = nullptr;
+	const double* term_freqs_ = nullptr;
+
+	const PostingBlock* blocks_ = nullptr;
+	std::size_t block_count_ = 0;
+	const uint8_t* bytes_ = nullptr;
+	std::size_t byte_count_ = 0;
+
+	std::size_t FindBlock(int document_id) const;
+
+	std::size_t DecodeBlock(std::size_t block_index, int* document_ids, double* term_freqs) const;
+};
+
+// Modifiable postings of a single term
+class PostingList {
+public:
+	static const std::size_t BLOCK_SIZE = 128;
+
+	explicit PostingList(IndexMode mode = IndexMode::FLAT);
+
+	// Copies the postings of the view, keeping their representation
+	explicit PostingList(const PostingListView& postings);
+
+	PostingListView GetView() const;
+
+	std::size_t size() const { return size_; }
+
+	bool empty() const { return size_ == 0; }
+
+	double GetMaxTermFreq() const { return max_term_freq_; }
+
+	void Add(int document_id, int count, int document_length);
+
+	void Remove(int document_id);
+
+	// Removes the postings of the sorted document ids in a single pass over the list
+	void Remove(const std::vector<int>& document_ids);
+
+	std::size_t GetMemoryUsage() const;
+
+private:
+	struct RawPosting {
+		int document_id;
+		int count;
+		int document_length;
+	};
+
+	IndexMode mode_;
+	std::size_t size_ = 0;
+	double max_term_freq_ = 0.0;
+
+	std::vector<int> document_ids_;
+	std::vector<double> term_freqs_;
+
+	std::vector<PostingBlock> blocks_;
+	std::vector<uint8_t> bytes_;
+
+	std::size_t FindBlock(int document_id) const;
+
+	std::vector<RawPosting> DecodeRawBlock(std::size_t block_index) const;
+
+	// Re-encodes the postings in place of the block, splitting it in two when it overflows
+	// and dropping it when they are empty
+	void ReplaceBlock(std::size_t block_index, const std::vector<RawPosting>& postings);
+
+	static void AppendToBlock(PostingBlock& block, std::vector<uint8_t>& bytes, const RawPosting& posting);
+};
+
+// Term dictionary mapping every term to a dense id and its posting list. An index opened
+// from a snapshot serves both straight from the mapping until its first modification.
+class InvertedIndex {
+public:
+	static constexpr int NO_TERM = -1;
+
+	explicit InvertedIndex(IndexMode mode = IndexMode::FLAT);
+
+	explicit InvertedIndex(std::shared_ptr<const IndexSnapshot> snapshot);
+
+	IndexMode GetMode() const { return mode_; }
+
+	int FindTermId(std::string_view term) const;
+
+	int AddTerm(std::string_view term);
+
+	std::string_view GetTerm(int term_id) const;
+
+	PostingListView GetPostings(int term_id) const;
+
+	void AddPosting(int term_id, int document_id, int count, int document_length);
+
+	void RemovePosting(int term_id, int document_id);
+
+	// Counts a posting of the term as removed, GetPostings keeps returning it until it is purged
+	void MarkPostingRemoved(int term_id);
+
+	// Postings of the term not marked as removed
+	std::size_t GetLivePostingCount(int term_id) const;
+
+	// Bound of the term frequencies of every posting, it only grows
+	double GetMaxTermFreq() const { return max_term_freq_; }
+
+	// Deletes the marked postings of the sorted document ids
+	void PurgePostings(int term_id, const std::vector<int>& document_ids);
+
+	// Drops a term without postings from the dictionary, a later AddTerm reuses its id
+	void RemoveTerm(int term_id);
+
+	// Moves the terms to a pool of their own once removed terms fill most of the pool. Term ids
+	// are kept, views returned by GetTerm before it dangle. Returns whether the terms were moved
+	bool ReclaimTerms();
+
+	// Bound of the term ids, ids of removed terms included
+	std::size_t GetTermCount() const;
+
+	std::size_t GetPostingCount() const;
+
+	// Heap memory held by the postings, mapped snapshot pages are not counted
+	std::size_t GetPostingsMemoryUsage() const;
+
+	// Heap memory held by the term strings
+	std::size_t GetTermsMemoryUsage() const { return dictionary_->pool.GetMemoryUsage(); }
+
+	// Copies the snapshot into the heap structures, term ids are kept. Every modification does it
+	// first, after it GetTerm returns views into the heap that don't depend on the mapping
+	void Materialize();
+
+private:
+	// Shared between copies of the index until one of them adds a term
+	struct TermDictionary {
+		// Copies share the strings of the pool, so the views stay valid in both
+		TermPool pool;
+		std::vector<std::string_view> terms;
+		std::unordered_map<std::string_view, int> term_to_id;
+		std::vector<int> free_term_ids;
+		// Total length of the removed terms, their strings stay in the pool
+		std::size_t removed_term_size = 0;
+	};
+
+	IndexMode mode_;
+	std::shared_ptr<const IndexSnapshot> snapshot_;
+	std::shared_ptr<TermDictionary> dictionary_;
+	// Copies of the index share posting lists, a list is copied before its first change
+	std::vector<std::shared_ptr<PostingList>> postings_;
+	std::vector<int> removed_posting_counts_;
+	double max_term_freq_ = 0.0;
+
+	TermDictionary& GetMutableDictionary();
+
+	PostingList& GetMutablePostings(int term_id);
+};
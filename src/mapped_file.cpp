@@ -0,0 +1,86 @@
+#include <stdexcept>
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#include "mapped_file.h"
+
+#ifdef _WIN32
+
+MappedFile::MappedFile(const std::string& path) {
+	file_handle_ = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING,
+		FILE_ATTRIBUTE_NORMAL, nullptr);
+	if (file_handle_ == INVALID_HANDLE_VALUE) {
+		file_handle_ = nullptr;
+		throw std::runtime_error("Can't open file: " + path);
+	}
+	LARGE_INTEGER file_size;
+	if (!GetFileSizeEx(file_handle_, &file_size)) {
+		CloseHandle(file_handle_);
+		throw std::runtime_error("Can't get size of file: " + path);
+	}
+	size_ = static_cast<std::size_t>(file_size.QuadPart);
+	if (size_ == 0) {
+		return;
+	}
+	mapping_handle_ = CreateFileMappingA(file_handle_, nullptr, PAGE_READONLY, 0, 0, nullptr);
+	if (mapping_handle_ != nullptr) {
+		data_ = static_cast<const char*>(MapViewOfFile(mapping_handle_, FILE_MAP_READ, 0, 0, 0));
+	}
+	if (data_ == nullptr) {
+		if (mapping_handle_ != nullptr) {
+			CloseHandle(mapping_handle_);
+		}
+		CloseHandle(file_handle_);
+		throw std::runtime_error("Can't map file: " + path);
+	}
+}
+
+MappedFile::~MappedFile() {
+	if (data_ != nullptr) {
+		UnmapViewOfFile(data_);
+		CloseHandle(mapping_handle_);
+	}
+	if (file_handle_ != nullptr) {
+		CloseHandle(file_handle_);
+	}
+}
+
+#else
+
+MappedFile::MappedFile(const std::string& path) {
+	const int fd = open(path.c_str(), O_RDONLY);
+	if (fd < 0) {
+		throw std::runtime_error("Can't open file: " + path);
+	}
+	struct stat file_stat;
+	if (fstat(fd, &file_stat) != 0) {
+		close(fd);
+		throw std::runtime_error("Can't get size of file: " + path);
+	}
+	size_ = static_cast<std::size_t>(file_stat.st_size);
+	if (size_ > 0) {
+		void* data = mmap(nullptr, size_, PROT_READ, MAP_PRIVATE, fd, 0);
+		if (data == MAP_FAILED) {
+			close(fd);
+			throw std::runtime_error("Can't map file: " + path);
+		}
+		data_ = static_cast<const char*>(data);
+	}
+	// The mapping keeps the file contents available after the descriptor is closed
+	close(fd);
+}
+
+MappedFile::~MappedFile() {
+	if (data_ != nullptr) {
+		munmap(const_cast<char*>(data_), size_);
+	}
+}
+
+#endif
@@ -0,0 +1,51 @@
+#include "posting_cursor.h"
+
+PostingCursor::PostingCursor(const PostingListView& postings, int first_id, int last_id)
+	: postings_(postings)
+	, last_id_(last_id)
+{
+	if (postings.mode_ == IndexMode::FLAT) {
+		const int* ids = postings.document_ids_;
+		const int* first = std::lower_bound(ids, ids + postings.size_, first_id);
+		const int* last = std::upper_bound(first, ids + postings.size_, last_id);
+		document_ids_ = first;
+		term_freqs_ = postings.term_freqs_ + (first - ids);
+		size_ = static_cast<std::size_t>(last - first);
+		return;
+	}
+
+	buffer_ = std::make_unique<Buffer>();
+	const PostingBlock* blocks = postings.blocks_;
+	end_block_ = static_cast<std::size_t>(std::upper_bound(blocks, blocks + postings.block_count_, last_id,
+		[](int document_id, const PostingBlock& block) { return document_id < block.first_id; }) - blocks);
+	const std::size_t first_block = postings.FindBlock(first_id);
+	if (first_block < end_block_) {
+		LoadBlock(first_block);
+		position_ = static_cast<std::size_t>(
+			std::lower_bound(document_ids_, document_ids_ + size_, first_id) - document_ids_);
+	}
+}
+
+void PostingCursor::LoadBlock(std::size_t block_index) {
+	size_ = postings_.DecodeBlock(block_index, buffer_->document_ids, buffer_->term_freqs);
+	document_ids_ = buffer_->document_ids;
+	term_freqs_ = buffer_->term_freqs;
+	if (postings_.blocks_[block_index].last_id > last_id_) {
+		size_ = static_cast<std::size_t>(std::upper_bound(document_ids_, document_ids_ + size_, last_id_) - document_ids_);
+	}
+	position_ = 0;
+	next_block_ = block_index + 1;
+}
+
+bool PostingCursor::SkipToBlock(int document_id) {
+	const PostingBlock* blocks = postings_.blocks_;
+	const PostingBlock* it = std::lower_bound(blocks + next_block_, blocks + end_block_, document_id,
+		[](const PostingBlock& block, int document_id) { return block.last_id < document_id; });
+	const std::size_t block_index = static_cast<std::size_t>(it - blocks);
+	if (block_index == end_block_) {
+		position_ = size_;
+		return false;
+	}
+	LoadBlock(block_index);
+	return position_ < size_;
+}
@@ -0,0 +1,71 @@
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <limits>
+#include <memory>
+
+#include "inverted_index.h"
+
+// Forward iterator over the postings of a posting list with ids in [first_id, last_id].
+// Compressed lists are decoded one block at a time into a buffer owned by the cursor.
+class PostingCursor {
+public:
+	explicit PostingCursor(const PostingListView& postings, int first_id = 0,
+		int last_id = std::numeric_limits<int>::max());
+
+	bool IsAtEnd() const { return position_ == size_; }
+
+	int GetDocumentId() const { return document_ids_[position_]; }
+
+	double GetTermFreq() const { return term_freqs_[position_]; }
+
+	void Next() {
+		if (++position_ == size_ && next_block_ < end_block_) {
+			LoadBlock(next_block_);
+		}
+	}
+
+	// Moves to the first posting with id not less than document_id, galloping from the current one
+	bool SkipTo(int document_id) {
+		if (IsAtEnd() || document_ids_[position_] >= document_id) {
+			return !IsAtEnd();
+		}
+		if (document_ids_[size_ - 1] < document_id) {
+			if (!SkipToBlock(document_id)) {
+				return false;
+			}
+		}
+		std::size_t low = position_;
+		std::size_t step = 1;
+		while (low + step < size_ && document_ids_[low + step] < document_id) {
+			low += step;
+			step *= 2;
+		}
+		const std::size_t high = std::min(low + step, size_);
+		position_ = static_cast<std::size_t>(
+			std::lower_bound(document_ids_ + low, document_ids_ + high, document_id) - document_ids_);
+		return position_ < size_;
+	}
+
+private:
+	struct Buffer {
+		int document_ids[PostingList::BLOCK_SIZE];
+		double term_freqs[PostingList::BLOCK_SIZE];
+	};
+
+	PostingListView postings_;
+	std::unique_ptr<Buffer> buffer_;
+	const int* document_ids_ = nullptr;
+	const double* term_freqs_ = nullptr;
+	std::size_t position_ = 0;
+	std::size_t size_ = 0;
+	std::size_t next_block_ = 0;
+	std::size_t end_block_ = 0;
+	int last_id_;
+
+	void LoadBlock(std::size_t block_index);
+
+	// Loads the first remaining block that may hold document_id, false if there is none
+	bool SkipToBlock(int document_id);
+};
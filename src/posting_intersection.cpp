@@ -0,0 +1,147 @@
+#include <algorithm>
+
+#if defined(__AVX2__) || defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define SEARCH_SERVER_SSE2
+#include <immintrin.h>
+#endif
+
+#include "posting_cursor.h"
+#include "posting_intersection.h"
+
+namespace {
+
+// Galloping beats comparing whole blocks once one array is this many times longer than the other
+const std::size_t GALLOP_LENGTH_RATIO = 32;
+
+// Looks up every id of the short array in the long one, galloping from the previous match
+std::size_t GallopDocumentIds(const int* short_ids, std::size_t short_size, const int* long_ids,
+	std::size_t long_size, int* out) {
+	std::size_t count = 0;
+	std::size_t low = 0;
+	for (std::size_t i = 0; i < short_size && low < long_size; ++i) {
+		const int document_id = short_ids[i];
+		std::size_t step = 1;
+		while (low + step < long_size && long_ids[low + step] < document_id) {
+			low += step;
+			step *= 2;
+		}
+		const std::size_t high = std::min(low + step, long_size);
+		low = static_cast<std::size_t>(std::lower_bound(long_ids + low, long_ids + high, document_id) - long_ids);
+		if (low < long_size && long_ids[low] == document_id) {
+			out[count++] = document_id;
+		}
+	}
+	return count;
+}
+
+#if defined(SEARCH_SERVER_SSE2)
+// Copies the ids of the block whose bits are set in the mask
+void EmitMatches(const int* block, unsigned int mask, int block_size, int* out, std::size_t& count) {
+	for (int k = 0; k < block_size; ++k) {
+		if ((mask >> k) & 1) {
+			out[count++] = block[k];
+		}
+	}
+}
+#endif
+
+// Every id of a block is compared with every id of a block of the other array at once, then the
+// block with the smaller last id is passed. An id matches at most once, so matches come out sorted
+std::size_t IntersectBlocks(const int* lhs, std::size_t lhs_size, const int* rhs, std::size_t rhs_size, int* out) {
+	std::size_t count = 0;
+	std::size_t i = 0;
+	std::size_t j = 0;
+#if defined(__AVX2__)
+	const __m256i rotation = _mm256_set_epi32(0, 7, 6, 5, 4, 3, 2, 1);
+	while (i + 8 <= lhs_size && j + 8 <= rhs_size) {
+		const __m256i lhs_block = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(lhs + i));
+		__m256i rhs_block = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(rhs + j));
+		__m256i matches = _mm256_cmpeq_epi32(lhs_block, rhs_block);
+		for (int r = 1; r < 8; ++r) {
+			rhs_block = _mm256_permutevar8x32_epi32(rhs_block, rotation);
+			matches = _mm256_or_si256(matches, _mm256_cmpeq_epi32(lhs_block, rhs_block));
+		}
+		EmitMatches(lhs + i, static_cast<unsigned int>(_mm256_movemask_ps(_mm256_castsi256_ps(matches))), 8, out, count);
+		const int lhs_last = lhs[i + 7];
+		const int rhs_last = rhs[j + 7];
+		i += lhs_last <= rhs_last ? 8 : 0;
+		j += rhs_last <= lhs_last ? 8 : 0;
+	}
+#endif
+#if defined(SEARCH_SERVER_SSE2)
+	while (i + 4 <= lhs_size && j + 4 <= rhs_size) {
+		const __m128i lhs_block = _mm_loadu_si128(reinterpret_cast<const __m128i*>(lhs + i));
+		__m128i rhs_block = _mm_loadu_si128(reinterpret_cast<const __m128i*>(rhs + j));
+		__m128i matches = _mm_cmpeq_epi32(lhs_block, rhs_block);
+		for (int r = 1; r < 4; ++r) {
+			rhs_block = _mm_shuffle_epi32(rhs_block, _MM_SHUFFLE(0, 3, 2, 1));
+			matches = _mm_or_si128(matches, _mm_cmpeq_epi32(lhs_block, rhs_block));
+		}
+		EmitMatches(lhs + i, static_cast<unsigned int>(_mm_movemask_ps(_mm_castsi128_ps(matches))), 4, out, count);
+		const int lhs_last = lhs[i + 3];
+		const int rhs_last = rhs[j + 3];
+		i += lhs_last <= rhs_last ? 4 : 0;
+		j += rhs_last <= lhs_last ? 4 : 0;
+	}
+#endif
+	while (i < lhs_size && j < rhs_size) {
+		if (lhs[i] < rhs[j]) {
+			++i;
+		}
+		else if (rhs[j] < lhs[i]) {
+			++j;
+		}
+		else {
+			out[count++] = lhs[i];
+			++i;
+			++j;
+		}
+	}
+	return count;
+}
+
+}  // namespace
+
+std::size_t IntersectDocumentIds(const int* lhs, std::size_t lhs_size, const int* rhs, std::size_t rhs_size,
+	int* out) {
+	if (lhs_size > rhs_size) {
+		std::swap(lhs, rhs);
+		std::swap(lhs_size, rhs_size);
+	}
+	if (lhs_size == 0) {
+		return 0;
+	}
+	if (rhs_size / lhs_size >= GALLOP_LENGTH_RATIO) {
+		return GallopDocumentIds(lhs, lhs_size, rhs, rhs_size, out);
+	}
+	return IntersectBlocks(lhs, lhs_size, rhs, rhs_size, out);
+}
+
+void IntersectWithPostings(const PostingListView& postings, std::vector<int>& document_ids,
+	std::vector<int>& buffer) {
+	if (document_ids.empty()) {
+		return;
+	}
+	if (postings.GetMode() == IndexMode::FLAT) {
+		const int* const ids = postings.GetDocumentIds();
+		const int* const first = std::lower_bound(ids, ids + postings.size(), document_ids.front());
+		const int* const last = std::upper_bound(first, ids + postings.size(), document_ids.back());
+		const std::size_t size = static_cast<std::size_t>(last - first);
+		buffer.resize(std::min(document_ids.size(), size));
+		buffer.resize(IntersectDocumentIds(document_ids.data(), document_ids.size(), first, size, buffer.data()));
+		document_ids.swap(buffer);
+		return;
+	}
+
+	PostingCursor cursor(postings, document_ids.front(), document_ids.back());
+	std::size_t count = 0;
+	for (const int document_id : document_ids) {
+		if (!cursor.SkipTo(document_id)) {
+			break;
+		}
+		if (cursor.GetDocumentId() == document_id) {
+			document_ids[count++] = document_id;
+		}
+	}
+	document_ids.resize(count);
+}
@@ -0,0 +1,19 @@
+#pragma once
+
+#include <cstddef>
+#include <vector>
+
+#include "inverted_index.h"
+
+// Writes the ids present in both sorted arrays to out in ascending order and returns their count.
+// out must hold min(lhs_size, rhs_size) ids and must not overlap the inputs. Arrays of similar
+// length are compared block by block with SIMD instructions, a much shorter one gallops through
+// the longer one.
+std::size_t IntersectDocumentIds(const int* lhs, std::size_t lhs_size, const int* rhs, std::size_t rhs_size,
+	int* out);
+
+// Keeps the sorted document ids the posting list holds. Flat lists are intersected with
+// IntersectDocumentIds, compressed ones are probed by galloping over their blocks. buffer is
+// scratch space the caller may reuse between calls
+void IntersectWithPostings(const PostingListView& postings, std::vector<int>& document_ids,
+	std::vector<int>& buffer);
@@ -1,43 +1,72 @@
-#include <algorithm>
-#include <cstddef>
 #include <execution>
+#include <utility>
 
 #include "process_queries.h"
 
+JoinedDocuments::Iterator::Iterator(const std::vector<Document>* queries_results, std::size_t query_count,
+	std::size_t query_index)
+	: queries_results_(queries_results)
+	, query_count_(query_count)
+	, query_index_(query_index)
+{
+	SkipEmptyQueries();
+}
+
+JoinedDocuments::Iterator& JoinedDocuments::Iterator::operator++() {
+	++document_index_;
+	SkipEmptyQueries();
+	return *this;
+}
+
+JoinedDocuments::Iterator JoinedDocuments::Iterator::operator++(int) {
+	Iterator result = *this;
+	++*this;
+	return result;
+}
+
+void JoinedDocuments::Iterator::SkipEmptyQueries() {
+	while (query_index_ < query_count_ && document_index_ == queries_results_[query_index_].size()) {
+		++query_index_;
+		document_index_ = 0;
+	}
+}
+
+JoinedDocuments::JoinedDocuments(std::vector<std::vector<Document>> queries_results)
+	: queries_results_(std::move(queries_results))
+{
+	for (const std::vector<Document>& documents : queries_results_) {
+		size_ += documents.size();
+	}
+}
+
+JoinedDocuments::Iterator JoinedDocuments::begin() const {
+	return Iterator(queries_results_.data(), queries_results_.size(), 0);
+}
+
+JoinedDocuments::Iterator JoinedDocuments::end() const {
+	return Iterator(queries_results_.data(), queries_results_.size(), queries_results_.size());
+}
+
 std::vector<std::vector<Document>> ProcessQueries(
 	const SearchServer& search_server,
 	const std::vector<std::string>& queries) {
-	std::vector<std::vector<Document>> queries_results(queries.size());
-	std::transform(
-		std::execution::par,
-		queries.begin(),
-		queries.end(),
-		queries_results.begin(),
-		[&search_server](const std::string& query) {
-			return search_server.FindTopDocuments(query);
-		}
-	);
-	return queries_results;
-}
-
-std::vector<Document> ProcessQueriesJoined(
+	return search_server.FindTopDocumentsBatch(std::execution::par, queries);
+}
+
+JoinedDocuments ProcessQueriesJoined(
 	const SearchServer& search_server,
 	const std::vector<std::string>& queries) {
-	const auto queries_results = ProcessQueries(search_server, queries);
-	const std::size_t result_size = std::transform_reduce(
-		std::execution::par,
-		queries_results.begin(),
-		queries_results.end(),
-		std::size_t(0),
-		std::plus<>{},
-		[](const std::vector<Document>& documents) {
-			return documents.size();
-		}
-	);
-	std::vector<Document> result;
-	result.reserve(result_size);
-	for (const auto& documents : queries_results) {
-		result.insert(result.end(), documents.begin(), documents.end());
-	}
-	return result;
+	return JoinedDocuments(ProcessQueries(search_server, queries));
+}
+
+std::vector<std::vector<Document>> ProcessQueries(
+	const VersionedSearchServer& search_server,
+	const std::vector<std::string>& queries) {
+	return ProcessQueries(*search_server.Acquire(), queries);
+}
+
+JoinedDocuments ProcessQueriesJoined(
+	const VersionedSearchServer& search_server,
+	const std::vector<std::string>& queries) {
+	return ProcessQueriesJoined(*search_server.Acquire(), queries);
 }
\ No newline at end of file
@@ -1,14 +1,84 @@
 #pragma once
 
+#include <cstddef>
+#include <iterator>
 #include <string>
 #include <vector>
 
+#include "document.h"
 #include "search_server.h"
+#include "versioned_search_server.h"
 
+// Documents found for a batch of queries, in query order. Iterates the results of the queries
+// in place instead of copying them into one vector. Iterators point into the heap array of the
+// results, which moves with the range, so they stay valid when the range is moved
+class JoinedDocuments {
+public:
+	class Iterator {
+	public:
+		using iterator_category = std::forward_iterator_tag;
+		using value_type = Document;
+		using difference_type = std::ptrdiff_t;
+		using pointer = const Document*;
+		using reference = const Document&;
+
+		Iterator() = default;
+
+		Iterator(const std::vector<Document>* queries_results, std::size_t query_count, std::size_t query_index);
+
+		reference operator*() const { return queries_results_[query_index_][document_index_]; }
+
+		pointer operator->() const { return &**this; }
+
+		Iterator& operator++();
+
+		Iterator operator++(int);
+
+		bool operator==(const Iterator& other) const {
+			return query_index_ == other.query_index_ && document_index_ == other.document_index_;
+		}
+
+		bool operator!=(const Iterator& other) const { return !(*this == other); }
+
+	private:
+		const std::vector<Document>* queries_results_ = nullptr;
+		std::size_t query_count_ = 0;
+		std::size_t query_index_ = 0;
+		std::size_t document_index_ = 0;
+
+		// Moves past the queries without documents
+		void SkipEmptyQueries();
+	};
+
+	explicit JoinedDocuments(std::vector<std::vector<Document>> queries_results);
+
+	Iterator begin() const;
+
+	Iterator end() const;
+
+	std::size_t size() const { return size_; }
+
+	bool empty() const { return size_ == 0; }
+
+private:
+	std::vector<std::vector<Document>> queries_results_;
+	std::size_t size_ = 0;
+};
+
+// Queries are evaluated as one batch, see SearchServer::FindTopDocumentsBatch
 std::vector<std::vector<Document>> ProcessQueries(
 	const SearchServer& search_server,
 	const std::vector<std::string>& queries);
 
-std::vector<Document> ProcessQueriesJoined(
+JoinedDocuments ProcessQueriesJoined(
 	const SearchServer& search_server,
 	const std::vector<std::string>& queries);
+
+// All queries are answered by the version current at the call
+std::vector<std::vector<Document>> ProcessQueries(
+	const VersionedSearchServer& search_server,
+	const std::vector<std::string>& queries);
+
+JoinedDocuments ProcessQueriesJoined(
+	const VersionedSearchServer& search_server,
+	const std::vector<std::string>& queries);
@@ -0,0 +1,65 @@
+#include <algorithm>
+#include <functional>
+#include <utility>
+
+#include "query_cache.h"
+
+double QueryCacheStats::GetHitRate() const {
+	const uint64_t request_count = hit_count + miss_count;
+	return request_count == 0 ? 0.0 : static_cast<double>(hit_count) / request_count;
+}
+
+QueryCache::QueryCache(std::size_t capacity)
+	: capacity_(capacity)
+	, shard_count_(std::clamp<std::size_t>(capacity, 1, MAX_SHARD_COUNT))
+	, shards_(std::make_unique<Shard[]>(shard_count_))
+{
+	for (std::size_t shard = 0; shard < shard_count_; ++shard) {
+		shards_[shard].capacity = capacity_ * (shard + 1) / shard_count_ - capacity_ * shard / shard_count_;
+	}
+}
+
+std::optional<std::vector<Document>> QueryCache::Find(const std::string& key, uint64_t generation) {
+	Shard& shard = GetShard(key);
+	std::lock_guard<std::mutex> guard(shard.mutex);
+	const auto it = shard.key_to_entry.find(key);
+	if (it == shard.key_to_entry.end() || it->second->generation != generation) {
+		miss_count_.fetch_add(1, std::memory_order_relaxed);
+		return std::nullopt;
+	}
+	hit_count_.fetch_add(1, std::memory_order_relaxed);
+	shard.entries.splice(shard.entries.begin(), shard.entries, it->second);
+	return it->second->documents;
+}
+
+void QueryCache::Insert(std::string key, uint64_t generation, std::vector<Document> documents) {
+	Shard& shard = GetShard(key);
+	if (shard.capacity == 0) {
+		return;
+	}
+	std::lock_guard<std::mutex> guard(shard.mutex);
+	const auto it = shard.key_to_entry.find(key);
+	if (it != shard.key_to_entry.end()) {
+		// Readers of different versions may store the same query, the newest generation is kept
+		if (it->second->generation <= generation) {
+			it->second->generation = generation;
+			it->second->documents = std::move(documents);
+		}
+		shard.entries.splice(shard.entries.begin(), shard.entries, it->second);
+		return;
+	}
+	shard.entries.push_front({ std::move(key), generation, std::move(documents) });
+	shard.key_to_entry.emplace(shard.entries.front().key, shard.entries.begin());
+	if (shard.entries.size() > shard.capacity) {
+		shard.key_to_entry.erase(shard.entries.back().key);
+		shard.entries.pop_back();
+	}
+}
+
+QueryCacheStats QueryCache::GetStats() const {
+	return { hit_count_.load(std::memory_order_relaxed), miss_count_.load(std::memory_order_relaxed) };
+}
+
+QueryCache::Shard& QueryCache::GetShard(std::string_view key) {
+	return shards_[std::hash<std::string_view>{}(key) % shard_count_];
+}
@@ -0,0 +1,64 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+#include "document.h"
+
+struct QueryCacheStats {
+	uint64_t hit_count = 0;
+	uint64_t miss_count = 0;
+
+	double GetHitRate() const;
+};
+
+// Size-bounded LRU cache of query results. Keys are spread over shards, and every shard keeps
+// its own recency list behind its own lock. An entry is only returned for the index generation
+// it was computed at, entries of other generations age out.
+class QueryCache {
+public:
+	explicit QueryCache(std::size_t capacity);
+
+	std::optional<std::vector<Document>> Find(const std::string& key, uint64_t generation);
+
+	void Insert(std::string key, uint64_t generation, std::vector<Document> documents);
+
+	std::size_t GetCapacity() const { return capacity_; }
+
+	QueryCacheStats GetStats() const;
+
+private:
+	static constexpr std::size_t CACHE_LINE_SIZE = 64;
+	static constexpr std::size_t MAX_SHARD_COUNT = 16;
+
+	struct Entry {
+		std::string key;
+		uint64_t generation;
+		std::vector<Document> documents;
+	};
+
+	struct alignas(CACHE_LINE_SIZE) Shard {
+		std::mutex mutex;
+		// Most recently used first, the keys of the index point into the entries
+		std::list<Entry> entries;
+		std::unordered_map<std::string_view, std::list<Entry>::iterator> key_to_entry;
+		std::size_t capacity = 0;
+	};
+
+	std::size_t capacity_;
+	std::size_t shard_count_;
+	std::unique_ptr<Shard[]> shards_;
+	std::atomic<uint64_t> hit_count_ = 0;
+	std::atomic<uint64_t> miss_count_ = 0;
+
+	Shard& GetShard(std::string_view key);
+};
@@ -0,0 +1,53 @@
+#pragma once
+
+#include <cstddef>
+#include <functional>
+#include <string_view>
+#include <vector>
+
+#include "search_options.h"
+
+// Execution policy letting the query planner choose between sequential, parallel and
+// minus-words-first evaluation from the lengths of the posting lists of the query
+struct AdaptiveExecutionPolicy {};
+
+inline constexpr AdaptiveExecutionPolicy adaptive_execution{};
+
+struct QueryPlannerThresholds {
+	// Plus postings of a query from which its evaluation is split between threads
+	std::size_t min_parallel_posting_count = 1 << 16;
+	// Share of the documents holding minus words from which they are excluded before scoring, so
+	// their plus postings skip the document lookups
+	double min_minus_first_document_share = 0.1;
+	// Query words from which MatchDocument checks the words in parallel
+	std::size_t min_parallel_match_word_count = 256;
+	// Plus postings every shard of the document ids of a parallel query gets at least
+	std::size_t min_postings_per_shard = 16384;
+	// Shards a parallel query is split into at most. Zero gives four per hardware thread, and none
+	// on a single one
+	std::size_t max_shard_count = 0;
+};
+
+struct PlannedTerm {
+	// Points into the query text
+	std::string_view word;
+	// Zero for words missing from the index
+	std::size_t posting_count;
+	bool is_minus;
+};
+
+struct QueryPlan {
+	// Plus words rarest first, the order their scores are summed in, then minus words
+	std::vector<PlannedTerm> terms;
+	std::size_t plus_posting_count = 0;
+	std::size_t minus_posting_count = 0;
+	EvaluationStrategy strategy = EvaluationStrategy::EXHAUSTIVE;
+	QueryMode mode = QueryMode::DISJUNCTIVE;
+	bool is_parallel = false;
+	// Documents with minus words are collected first and never scored
+	bool is_minus_first = false;
+};
+
+// Called with the plan of every query FindTopDocuments evaluates with adaptive_execution, possibly
+// from several threads at once. Results served by the query cache are not planned
+using QueryPlanObserver = std::function<void(const QueryPlan&)>;
@@ -0,0 +1,99 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+// Relevance sums of the documents whose ids fall into [min_id, max_id].
+// Small id spans are backed by a dense array, wide ones by a hash table.
+// Excluded documents are never reported, callers check IsExcluded to skip scoring them at all.
+class RelevanceAccumulator {
+public:
+	RelevanceAccumulator(int min_id, int max_id, std::size_t posting_count)
+		: min_id_(min_id)
+		, dense_(static_cast<int64_t>(max_id) - min_id < static_cast<int64_t>(posting_count) * DENSE_SPAN_FACTOR + MIN_DENSE_SPAN)
+	{
+		if (dense_) {
+			relevance_.resize(static_cast<std::size_t>(static_cast<int64_t>(max_id) - min_id + 1));
+			is_matched_.resize(relevance_.size());
+			matched_ids_.reserve(posting_count);
+		}
+		else {
+			sparse_relevance_.reserve(posting_count);
+		}
+	}
+
+	void Add(int document_id, double relevance) {
+		if (!dense_) {
+			sparse_relevance_[document_id] += relevance;
+			return;
+		}
+		const std::size_t index = static_cast<std::size_t>(document_id - min_id_);
+		if (!is_matched_[index]) {
+			is_matched_[index] = true;
+			matched_ids_.push_back(document_id);
+		}
+		relevance_[index] += relevance;
+	}
+
+	bool IsDense() const { return dense_; }
+
+	void Exclude(int document_id) {
+		if (!dense_) {
+			sparse_excluded_ids_.insert(document_id);
+			return;
+		}
+		if (is_excluded_.empty()) {
+			is_excluded_.resize(relevance_.size());
+		}
+		is_excluded_[static_cast<std::size_t>(document_id - min_id_)] = true;
+	}
+
+	bool IsExcluded(int document_id) const {
+		if (!dense_) {
+			return !sparse_excluded_ids_.empty() && sparse_excluded_ids_.count(document_id) > 0;
+		}
+		return !is_excluded_.empty() && is_excluded_[static_cast<std::size_t>(document_id - min_id_)];
+	}
+
+	void Erase(int document_id) {
+		if (dense_) {
+			is_matched_[static_cast<std::size_t>(document_id - min_id_)] = false;
+		}
+		else {
+			sparse_relevance_.erase(document_id);
+		}
+	}
+
+	template <typename Function>
+	void ForEach(Function function) const {
+		if (!dense_) {
+			for (const auto [document_id, relevance] : sparse_relevance_) {
+				function(document_id, relevance);
+			}
+			return;
+		}
+		for (const int document_id : matched_ids_) {
+			const std::size_t index = static_cast<std::size_t>(document_id - min_id_);
+			if (is_matched_[index]) {
+				function(document_id, relevance_[index]);
+			}
+		}
+	}
+
+private:
+	static const int64_t DENSE_SPAN_FACTOR = 8;
+	static const int64_t MIN_DENSE_SPAN = 4096;
+
+	int min_id_;
+	bool dense_;
+	std::vector<double> relevance_;
+	std::vector<char> is_matched_;
+	// Sized on the first Exclude call
+	std::vector<char> is_excluded_;
+	std::vector<int> matched_ids_;
+	std::unordered_map<int, double> sparse_relevance_;
+	std::unordered_set<int> sparse_excluded_ids_;
+};
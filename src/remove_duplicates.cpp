@@ -1,31 +1,179 @@
-﻿#include <iostream>
-#include <iterator>
-#include <map>
-#include <set>
+﻿#include <algorithm>
+#include <cstdint>
+#include <execution>
+#include <iostream>
+#include <limits>
+#include <numeric>
 #include <string>
-#include <string_view>
+#include <tuple>
+#include <unordered_map>
 #include <vector>
 
 #include "remove_duplicates.h"
 
-void RemoveDuplicates(SearchServer& search_server) {
-	using namespace std::literals;
-	std::map<std::vector<std::string_view>, std::set<int>> words_to_document_ids;
-	for (const int document_id : search_server) {
-		const auto& word_to_freq = search_server.GetWordFrequencies(document_id);
-		std::vector<std::string_view> words;
-		words.reserve(word_to_freq.size());
-		for (const auto& [word, freq] : word_to_freq) {
-			words.push_back(word);
-		}
-		words_to_document_ids[words].insert(document_id);
+namespace {
+
+const uint64_t GOLDEN_GAMMA = 0x9e3779b97f4a7c15ULL;
+
+// Finalizer of SplitMix64
+uint64_t MixHash(uint64_t x) {
+	x = (x ^ (x >> 30)) * 0xbf58476d1ce4e5b9ULL;
+	x = (x ^ (x >> 27)) * 0x94d049bb133111ebULL;
+	return x ^ (x >> 31);
+}
+
+std::vector<int> GetSortedTermIds(const SearchServer& search_server, int document_id) {
+	std::vector<int> term_ids;
+	search_server.ForEachDocumentTermId(document_id, [&term_ids](int term_id) {
+		term_ids.push_back(term_id);
+	});
+	return term_ids;
+}
+
+double ComputeJaccardSimilarity(const std::vector<int>& lhs, const std::vector<int>& rhs) {
+	if (lhs.empty() && rhs.empty()) {
+		return 1.0;
+	}
+	std::size_t common_count = 0;
+	for (auto left = lhs.begin(), right = rhs.begin(); left != lhs.end() && right != rhs.end();) {
+		if (*left < *right) {
+			++left;
+		}
+		else if (*right < *left) {
+			++right;
+		}
+		else {
+			++common_count;
+			++left;
+			++right;
+		}
+	}
+	return static_cast<double>(common_count) / (lhs.size() + rhs.size() - common_count);
+}
+
+std::vector<int> FindExactDuplicates(const SearchServer& search_server) {
+	const std::vector<int> document_ids(search_server.begin(), search_server.end());
+	std::vector<std::size_t> indexes(document_ids.size());
+	std::iota(indexes.begin(), indexes.end(), 0);
+
+	// 128-bit hashes of the term ids in ascending order, which is the same for equal sets of words
+	std::vector<std::tuple<uint64_t, uint64_t, int>> fingerprints(document_ids.size());
+	std::for_each(std::execution::par, indexes.begin(), indexes.end(),
+		[&search_server, &document_ids, &fingerprints](std::size_t i) {
+			uint64_t low = 0;
+			uint64_t high = GOLDEN_GAMMA;
+			search_server.ForEachDocumentTermId(document_ids[i], [&low, &high](int term_id) {
+				low = MixHash(low + static_cast<uint64_t>(term_id) + GOLDEN_GAMMA);
+				high = MixHash(high ^ (static_cast<uint64_t>(term_id) * GOLDEN_GAMMA));
+			});
+			fingerprints[i] = { low, high, document_ids[i] };
+		}
+	);
+	std::sort(std::execution::par, fingerprints.begin(), fingerprints.end());
+
+	// Runs of equal fingerprints are in id order, their words are still compared so that a
+	// collision never removes a document
+	std::vector<int> duplicates;
+	for (auto first = fingerprints.begin(); first != fingerprints.end();) {
+		const auto last = std::find_if(first, fingerprints.end(), [first](const auto& fingerprint) {
+			return std::get<0>(fingerprint) != std::get<0>(*first) || std::get<1>(fingerprint) != std::get<1>(*first);
+		});
+		if (last - first > 1) {
+			std::vector<std::vector<int>> kept_term_ids;
+			for (auto it = first; it != last; ++it) {
+				std::vector<int> term_ids = GetSortedTermIds(search_server, std::get<2>(*it));
+				if (std::find(kept_term_ids.begin(), kept_term_ids.end(), term_ids) != kept_term_ids.end()) {
+					duplicates.push_back(std::get<2>(*it));
+				}
+				else {
+					kept_term_ids.push_back(std::move(term_ids));
+				}
+			}
+		}
+		first = last;
 	}
-	for (auto& [words, document_ids] : words_to_document_ids) {
-		if (document_ids.size() > 1) {
-			for (auto it = std::next(document_ids.begin()); it != document_ids.end(); ++it) {
-				search_server.RemoveDocument(*it);
-				std::cout << "Found duplicate document id "s << *it << std::endl;
+	std::sort(duplicates.begin(), duplicates.end());
+	return duplicates;
+}
+
+std::vector<int> FindNearDuplicates(const SearchServer& search_server, const DuplicateOptions& options) {
+	const std::vector<int> document_ids(search_server.begin(), search_server.end());
+	std::vector<std::size_t> indexes(document_ids.size());
+	std::iota(indexes.begin(), indexes.end(), 0);
+	const std::size_t band_count = static_cast<std::size_t>(std::max(options.band_count, 1));
+	const std::size_t rows_per_band = static_cast<std::size_t>(std::max(options.rows_per_band, 1));
+
+	// Only the hashes of the bands of the MinHash signatures are kept
+	std::vector<uint64_t> band_keys(document_ids.size() * band_count);
+	std::for_each(std::execution::par, indexes.begin(), indexes.end(),
+		[&search_server, &document_ids, &band_keys, band_count, rows_per_band](std::size_t i) {
+			std::vector<uint64_t> signature(band_count * rows_per_band, std::numeric_limits<uint64_t>::max());
+			search_server.ForEachDocumentTermId(document_ids[i], [&signature](int term_id) {
+				const uint64_t term_hash = MixHash(static_cast<uint64_t>(term_id));
+				for (std::size_t k = 0; k < signature.size(); ++k) {
+					signature[k] = std::min(signature[k], MixHash(term_hash + (k + 1) * GOLDEN_GAMMA));
+				}
+			});
+			for (std::size_t band = 0; band < band_count; ++band) {
+				uint64_t key = band;
+				for (std::size_t row = 0; row < rows_per_band; ++row) {
+					key = MixHash(key ^ signature[band * rows_per_band + row]);
+				}
+				band_keys[i * band_count + band] = key;
+			}
+		}
+	);
+
+	// Documents go in id order and are compared with the kept documents sharing a band with them
+	std::vector<std::unordered_map<uint64_t, std::vector<std::size_t>>> bands(band_count);
+	std::vector<int> duplicates;
+	std::vector<std::size_t> candidates;
+	for (std::size_t i = 0; i < document_ids.size(); ++i) {
+		candidates.clear();
+		for (std::size_t band = 0; band < band_count; ++band) {
+			const auto it = bands[band].find(band_keys[i * band_count + band]);
+			if (it != bands[band].end()) {
+				candidates.insert(candidates.end(), it->second.begin(), it->second.end());
 			}
 		}
+		std::sort(candidates.begin(), candidates.end());
+		candidates.erase(std::unique(candidates.begin(), candidates.end()), candidates.end());
+
+		bool is_duplicate = false;
+		if (!candidates.empty()) {
+			const std::vector<int> term_ids = GetSortedTermIds(search_server, document_ids[i]);
+			is_duplicate = std::any_of(candidates.begin(), candidates.end(),
+				[&search_server, &document_ids, &term_ids, &options](std::size_t candidate) {
+					return ComputeJaccardSimilarity(term_ids, GetSortedTermIds(search_server, document_ids[candidate]))
+						>= options.similarity_threshold;
+				});
+		}
+		if (is_duplicate) {
+			duplicates.push_back(document_ids[i]);
+			continue;
+		}
+		for (std::size_t band = 0; band < band_count; ++band) {
+			bands[band][band_keys[i * band_count + band]].push_back(i);
+		}
+	}
+	return duplicates;
+}
+
+}  // namespace
+
+std::vector<int> FindDuplicates(const SearchServer& search_server, const DuplicateOptions& options) {
+	return options.mode == DuplicateMode::EXACT
+		? FindExactDuplicates(search_server)
+		: FindNearDuplicates(search_server, options);
+}
+
+void RemoveDuplicates(SearchServer& search_server, const DuplicateOptions& options) {
+	using namespace std::literals;
+	const std::vector<int> duplicates = FindDuplicates(search_server, options);
+	search_server.RemoveDocuments(duplicates);
+	std::string report;
+	for (const int document_id : duplicates) {
+		report += "Found duplicate document id "s + std::to_string(document_id) + '\n';
 	}
-}
\ No newline at end of file
+	std::cout << report << std::flush;
+}
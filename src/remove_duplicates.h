@@ -1,5 +1,35 @@
 ﻿#pragma once
 
+#include <vector>
+
 #include "search_server.h"
 
-void RemoveDuplicates(SearchServer& search_server);
+enum class DuplicateMode {
+	// Documents with equal sets of words
+	EXACT,
+	// Documents whose sets of words have a Jaccard similarity of at least the threshold
+	NEAR,
+};
+
+struct DuplicateOptions {
+	DuplicateOptions(DuplicateMode mode = DuplicateMode::EXACT, double similarity_threshold = 0.8,
+		int band_count = 16, int rows_per_band = 4)
+		: mode(mode)
+		, similarity_threshold(similarity_threshold)
+		, band_count(band_count)
+		, rows_per_band(rows_per_band)
+	{}
+
+	DuplicateMode mode;
+	double similarity_threshold;
+	// Near duplicates are looked for among the documents sharing a band of rows_per_band MinHash
+	// values. More rows per band skip more dissimilar pairs, more bands miss fewer similar ones
+	int band_count;
+	int rows_per_band;
+};
+
+// Ids of the documents duplicating a document with a lower id, in ascending order
+std::vector<int> FindDuplicates(const SearchServer& search_server, const DuplicateOptions& options = {});
+
+// Removes the documents found by FindDuplicates in one batch and reports their ids
+void RemoveDuplicates(SearchServer& search_server, const DuplicateOptions& options = {});
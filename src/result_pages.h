@@ -0,0 +1,96 @@
+#pragma once
+
+#include <cstddef>
+#include <functional>
+#include <iterator>
+#include <optional>
+#include <utility>
+#include <vector>
+
+#include "document.h"
+#include "paginator.h"
+
+// Position in ranked results the next page starts after: the last document of the previous page.
+// Callers keep it as it is and hand it back, a page holds the documents ranked right after it
+struct SearchCursor {
+	double relevance = 0.0;
+	int rating = 0;
+	int document_id = -1;
+};
+
+struct ResultPage {
+	std::vector<Document> documents;
+	// Empty once the page is not full, as no document follows it
+	std::optional<SearchCursor> next;
+};
+
+// Pages of ranked results pulled on demand, so deep pages never hold the results before them.
+// Iterates like Paginator does: every page is an IteratorRange of documents. The source is
+// called with the cursor of the previous page, and iteration stops at the first empty page
+class ResultPages {
+public:
+	using PageSource = std::function<ResultPage(const std::optional<SearchCursor>& after)>;
+	using Page = IteratorRange<std::vector<Document>::const_iterator>;
+
+	class Iterator {
+	public:
+		using iterator_category = std::input_iterator_tag;
+		using value_type = Page;
+		using difference_type = std::ptrdiff_t;
+		using pointer = const Page*;
+		using reference = Page;
+
+		// The end of every range
+		Iterator() = default;
+
+		explicit Iterator(const PageSource* source)
+			: source_(source)
+		{
+			Fetch(std::nullopt);
+		}
+
+		// Valid until the iterator moves to the next page
+		Page operator*() const { return { documents_.begin(), documents_.end() }; }
+
+		Iterator& operator++() {
+			if (next_) {
+				Fetch(next_);
+			}
+			else {
+				source_ = nullptr;
+			}
+			return *this;
+		}
+
+		bool operator==(const Iterator& other) const { return source_ == other.source_; }
+
+		bool operator!=(const Iterator& other) const { return !(*this == other); }
+
+	private:
+		const PageSource* source_ = nullptr;
+		std::vector<Document> documents_;
+		std::optional<SearchCursor> next_;
+
+		void Fetch(const std::optional<SearchCursor>& after) {
+			ResultPage page = (*source_)(after);
+			if (page.documents.empty()) {
+				source_ = nullptr;
+				return;
+			}
+			documents_ = std::move(page.documents);
+			next_ = page.next;
+		}
+	};
+
+	explicit ResultPages(PageSource source)
+		: source_(std::move(source))
+	{}
+
+	// Every call starts over from the first page
+	Iterator begin() const { return Iterator(&source_); }
+
+	Iterator end() const { return {}; }
+
+private:
+	PageSource source_;
+};
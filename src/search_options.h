@@ -0,0 +1,46 @@
+#pragma once
+
+#include <cstddef>
+
+const std::size_t MAX_RESULT_DOCUMENT_COUNT = 5;
+
+enum class EvaluationStrategy {
+	// Scores every posting of every plus word
+	EXHAUSTIVE,
+	// Document-at-a-time evaluation skipping documents whose score bound cannot reach the top
+	MAX_SCORE,
+	// Sums precomputed 8-bit impacts of every posting, the score rounded to a multiple of the step:
+	// the largest score bound of the index divided by 255. The best documents by these sums are
+	// rescored exactly, so the relevance and order of the results are exact, but a document left
+	// out may be up to step times the number of plus words more relevant than the last result.
+	// Evaluated on a single thread with any execution policy
+	QUANTIZED,
+	// QUANTIZED taking the postings of the highest impacts first. It stops once the impacts left
+	// can't lift a document into the results, with the same error bound
+	IMPACT_ORDERED,
+};
+
+inline bool IsQuantized(EvaluationStrategy strategy) {
+	return strategy == EvaluationStrategy::QUANTIZED || strategy == EvaluationStrategy::IMPACT_ORDERED;
+}
+
+enum class QueryMode {
+	// Documents holding any of the plus words
+	DISJUNCTIVE,
+	// Documents holding every plus word. Posting lists are intersected from the shortest one and
+	// only the documents left are scored, so the evaluation strategy doesn't apply
+	CONJUNCTIVE,
+};
+
+struct SearchOptions {
+	SearchOptions(std::size_t max_result_count = MAX_RESULT_DOCUMENT_COUNT,
+		EvaluationStrategy strategy = EvaluationStrategy::EXHAUSTIVE, QueryMode mode = QueryMode::DISJUNCTIVE)
+		: max_result_count(max_result_count)
+		, strategy(strategy)
+		, mode(mode)
+	{}
+
+	std::size_t max_result_count;
+	EvaluationStrategy strategy;
+	QueryMode mode;
+};
@@ -1,79 +1,450 @@
-﻿#include <iostream>
+﻿#include <atomic>
+#include <iostream>
+#include <thread>
+#include <unordered_set>
 
 #include "string_processing.h"
 #include "search_server.h"
 
 const std::map<std::string_view, double> empty_map = {};
 
-SearchServer::SearchServer(std::string_view stop_words)
-	: SearchServer(SplitIntoWords(stop_words))
+std::atomic<uint64_t> last_generation = 0;
+
+const std::size_t SHARDS_PER_THREAD = 4;
+const std::size_t MIN_DOCUMENTS_PER_BATCH_CHUNK = 1024;
+const std::size_t MAX_POSTINGS_PER_QUERY_BATCH_RANGE = 1 << 20;
+
+SearchServer::SearchServer(std::string_view stop_words, IndexMode index_mode)
+	: stop_words_(GetValidWordsSet(stop_words))
+	, index_(index_mode)
+	, generation_(GetNextGeneration())
+{}
+
+SearchServer::SearchServer(const std::string& stop_words, IndexMode index_mode)
+	: SearchServer(std::string_view(stop_words), index_mode)
 {}
 
-SearchServer::SearchServer(const std::string& stop_words)
-	: SearchServer(std::string_view(stop_words))
+SearchServer::SearchServer(std::shared_ptr<const IndexSnapshot> snapshot)
+	: stop_words_(GetValidWordsSet(snapshot->GetStopWords()))
+	, index_(snapshot)
+	, snapshot_(std::move(snapshot))
+	, generation_(GetNextGeneration())
 {}
 
+SearchServer SearchServer::OpenSnapshot(const std::string& path) {
+	return SearchServer(std::make_shared<const IndexSnapshot>(path));
+}
+
+void SearchServer::SaveSnapshot(const std::string& path) const {
+	if (!removed_documents_.empty()) {
+		// Postings of removed documents are never written
+		SearchServer compacted = *this;
+		compacted.Compact();
+		compacted.SaveSnapshot(path);
+		return;
+	}
+	SnapshotWriter writer(path, index_.GetMode());
+	for (const std::string& stop_word : stop_words_) {
+		writer.AddStopWord(stop_word);
+	}
+
+	// Snapshot term ids are ranks among the sorted terms, emptied terms are dropped
+	std::vector<int> term_ids;
+	for (int term_id = 0; term_id < static_cast<int>(index_.GetTermCount()); ++term_id) {
+		if (!index_.GetPostings(term_id).empty()) {
+			term_ids.push_back(term_id);
+		}
+	}
+	std::sort(term_ids.begin(), term_ids.end(), [this](int lhs, int rhs) {
+		return index_.GetTerm(lhs) < index_.GetTerm(rhs);
+	});
+	std::vector<int> term_ranks(index_.GetTermCount(), InvertedIndex::NO_TERM);
+	writer.SetMaxTermFreq(index_.GetMaxTermFreq());
+	for (std::size_t rank = 0; rank < term_ids.size(); ++rank) {
+		term_ranks[term_ids[rank]] = static_cast<int>(rank);
+		writer.AddTerm(index_.GetTerm(term_ids[rank]), index_.GetPostings(term_ids[rank]));
+	}
+
+	// Internal ids are kept, so the postings are written as they are
+	const DocumentColumns columns = GetDocumentColumns();
+	const int* const lengths = snapshot_ ? snapshot_->GetLengths() : document_lengths_.data();
+	for (int internal_id = 0; internal_id < static_cast<int>(GetInternalIdCount()); ++internal_id) {
+		if (columns.external_ids[internal_id] == NO_DOCUMENT) {
+			writer.AddFreeInternalId();
+			continue;
+		}
+		writer.AddDocument(columns.external_ids[internal_id], columns.ratings[internal_id],
+			static_cast<DocumentStatus>(columns.statuses[internal_id]), lengths[internal_id]);
+		if (snapshot_) {
+			snapshot_->ForEachTermId(internal_id, [&writer, &term_ranks](int term_id, double freq) {
+				writer.AddDocumentWord(term_ranks[term_id], freq);
+			});
+			continue;
+		}
+		// Ranks order the words differently from the term ids of the index
+		const DocumentData& document_data = *documents_[internal_id];
+		std::vector<std::pair<int, double>> words;
+		words.reserve(document_data.term_ids.size());
+		for (std::size_t i = 0; i < document_data.term_ids.size(); ++i) {
+			words.push_back({ term_ranks[document_data.term_ids[i]], document_data.term_freqs[i] });
+		}
+		std::sort(words.begin(), words.end());
+		for (const auto& [term_rank, term_freq] : words) {
+			writer.AddDocumentWord(term_rank, term_freq);
+		}
+	}
+	writer.Finish();
+}
+
+void SearchServer::EnableQueryCache(std::size_t capacity) {
+	query_cache_ = capacity == 0 ? nullptr : std::make_shared<QueryCache>(capacity);
+}
+
+QueryCacheStats SearchServer::GetQueryCacheStats() const {
+	return query_cache_ ? query_cache_->GetStats() : QueryCacheStats{};
+}
+
 void SearchServer::AddDocument(int document_id, std::string_view document,
 	DocumentStatus status, const std::vector<int>& ratings) {
-	if (document_id < 0 || documents_.count(document_id)) {
+	if (document_id < 0 || FindInternalId(document_id) != NO_DOCUMENT) {
 		throw std::invalid_argument("Invalid document id: " + std::to_string(document_id));
 	}
-	const std::vector<std::string_view> words = SplitIntoWordsNoStop(document);
-	for (const std::string_view word : words) {
-		if (!IsValidWord(word)) {
-			throw std::invalid_argument("Invalid word in document: " + std::string(word));
-		}
+	PreparedDocument prepared = PrepareDocument(document);
+	if (!prepared.is_valid) {
+		throw std::invalid_argument("Invalid word in document: " + std::string(prepared.invalid_word));
 	}
-	const double inv_word_count = 1.0 / words.size();
-	const auto [it, success] = documents_.emplace(document_id, DocumentData{});
-	DocumentData& document_data = it->second;
-	for (const std::string_view word : words) {
-		const auto [it, success] = document_data.words.insert(std::string(word));
-		const std::string_view inserted_word(*it);
-		word_to_document_freqs_[inserted_word][document_id] += inv_word_count;
-		document_data.word_to_freq[inserted_word] += inv_word_count;
+	Materialize();
+	generation_ = GetNextGeneration();
+	PurgeRemovedDocument(document_id);
+	const int internal_id = AllocateInternalIds(1).front();
+	std::vector<int> term_ids;
+	term_ids.reserve(prepared.word_counts.size());
+	for (const auto& [word, count] : prepared.word_counts) {
+		term_ids.push_back(index_.AddTerm(word));
+		index_.AddPosting(term_ids.back(), internal_id, count, prepared.length);
+	}
+	StoreDocumentColumns(internal_id, document_id, status, ratings, prepared.length,
+		MakeDocumentData(prepared, std::move(term_ids)));
+	if (DocumentEntry* const entry = document_entries_.Find(document_id)) {
+		// The id was removed, its document is purged and the entry is taken over
+		entry->internal_id = internal_id;
+	}
+	else {
+		document_entries_.Insert({ document_id, internal_id });
 	}
-	document_data.rating = ComputeAverageRating(ratings);
-	document_data.status = status;
-	document_ids_.insert(document_id);
 }
 
-std::vector<Document> SearchServer::FindTopDocuments(std::string_view raw_query, DocumentStatus doc_status) const {
-	return FindTopDocuments(raw_query, [doc_status](int document_id, DocumentStatus status, int rating) {
-		return status == doc_status;
-	});
+void SearchServer::AddDocuments(const std::vector<DocumentInput>& documents) {
+	AddDocuments(std::execution::seq, documents);
+}
+
+std::vector<Document> SearchServer::FindTopDocuments(std::string_view raw_query, DocumentStatus doc_status,
+	const SearchOptions& options) const {
+	return FindTopDocuments(std::execution::seq, raw_query, doc_status, options);
 }
 
 std::vector<Document> SearchServer::FindTopDocuments(std::string_view raw_query) const {
 	return FindTopDocuments(raw_query, DocumentStatus::ACTUAL);
 }
 
-std::size_t SearchServer::GetDocumentCount() const { return documents_.size(); }
+ResultPage SearchServer::FindTopDocumentsPage(std::string_view raw_query, DocumentStatus doc_status,
+	std::size_t limit, const std::optional<SearchCursor>& after) const {
+	return FindTopDocumentsPage(std::execution::seq, raw_query, doc_status, limit, after);
+}
+
+ResultPages SearchServer::PaginateTopDocuments(std::string_view raw_query, DocumentStatus doc_status,
+	std::size_t page_size) const {
+	return ResultPages([this, query = std::string(raw_query), doc_status, page_size](
+		const std::optional<SearchCursor>& after) {
+		return FindTopDocumentsPage(query, doc_status, page_size, after);
+	});
+}
+
+std::size_t SearchServer::GetDocumentCount() const {
+	// Entries of removed documents stay until Compact
+	return snapshot_ ? snapshot_->GetDocumentCount() : document_entries_.size() - removed_documents_.size();
+}
 
 std::tuple<std::vector<std::string_view>, DocumentStatus> SearchServer::MatchDocument(std::string_view raw_query,
 	int document_id) const {
 	return MatchDocument(std::execution::seq, raw_query, document_id);
 }
 
-bool SearchServer::IsValidWord(std::string_view word) {
-	// A valid word must not contain special characters
-	return std::none_of(word.begin(), word.end(), [](char c) {
-		return c >= '\0' && c < ' ';
-	});
+std::tuple<std::vector<std::string_view>, DocumentStatus> SearchServer::MatchDocument(
+	[[maybe_unused]] AdaptiveExecutionPolicy policy, std::string_view raw_query, int document_id) const {
+	const Query query = ParseQuery(raw_query);
+	const bool is_parallel = std::thread::hardware_concurrency() > 1
+		&& query.plus_words.size() + query.minus_words.size() >= planner_thresholds_.min_parallel_match_word_count;
+	return is_parallel
+		? MatchDocument(std::execution::par, query, document_id)
+		: MatchDocument(std::execution::seq, query, document_id);
+}
+
+std::vector<std::tuple<std::vector<std::string_view>, DocumentStatus>> SearchServer::MatchDocuments(
+	std::string_view raw_query, const std::vector<int>& document_ids) const {
+	return MatchDocuments(std::execution::seq, raw_query, document_ids);
+}
+
+SearchServer::MatchQuery SearchServer::ResolveMatchQuery(const Query& query) const {
+	MatchQuery match_query;
+	match_query.plus_words.reserve(query.plus_words.size());
+	match_query.plus_term_ids.reserve(query.plus_words.size());
+	for (const std::string_view word : query.plus_words) {
+		const int term_id = index_.FindTermId(word);
+		if (term_id != InvertedIndex::NO_TERM) {
+			match_query.plus_words.push_back(word);
+			match_query.plus_term_ids.push_back(term_id);
+		}
+	}
+	for (const std::string_view word : query.minus_words) {
+		const int term_id = index_.FindTermId(word);
+		if (term_id != InvertedIndex::NO_TERM) {
+			match_query.minus_term_ids.push_back(term_id);
+		}
+	}
+	return match_query;
+}
+
+std::tuple<std::vector<std::string_view>, DocumentStatus> SearchServer::MatchDocumentTerms(
+	std::execution::sequenced_policy, const MatchQuery& query, int internal_id) const {
+	const DocumentStatus status = GetDocumentAttributesAt(internal_id).status;
+	const auto [first, last] = GetDocumentTermIds(internal_id);
+	for (const int term_id : query.minus_term_ids) {
+		if (std::binary_search(first, last, term_id)) {
+			return { std::vector<std::string_view>{}, status };
+		}
+	}
+
+	std::vector<std::string_view> matched_words;
+	for (std::size_t i = 0; i < query.plus_words.size(); ++i) {
+		if (std::binary_search(first, last, query.plus_term_ids[i])) {
+			matched_words.push_back(query.plus_words[i]);
+		}
+	}
+	return { matched_words, status };
+}
+
+std::tuple<std::vector<std::string_view>, DocumentStatus> SearchServer::MatchDocumentTerms(
+	std::execution::parallel_policy policy, const MatchQuery& query, int internal_id) const {
+	const DocumentStatus status = GetDocumentAttributesAt(internal_id).status;
+	const auto [first, last] = GetDocumentTermIds(internal_id);
+	const auto contains = [first = first, last = last](int term_id) {
+		return std::binary_search(first, last, term_id);
+	};
+	if (std::any_of(policy, query.minus_term_ids.begin(), query.minus_term_ids.end(), contains)) {
+		return { std::vector<std::string_view>{}, status };
+	}
+
+	std::vector<char> is_matched(query.plus_term_ids.size());
+	std::transform(policy, query.plus_term_ids.begin(), query.plus_term_ids.end(), is_matched.begin(), contains);
+	std::vector<std::string_view> matched_words;
+	for (std::size_t i = 0; i < query.plus_words.size(); ++i) {
+		if (is_matched[i]) {
+			matched_words.push_back(query.plus_words[i]);
+		}
+	}
+	return { matched_words, status };
+}
+
+ResultPage SearchServer::MakeResultPage(std::vector<Document> documents, std::size_t limit) {
+	ResultPage page;
+	if (limit > 0 && documents.size() == limit) {
+		const Document& last_document = documents.back();
+		page.next = SearchCursor{ last_document.relevance, last_document.rating, last_document.id };
+	}
+	page.documents = std::move(documents);
+	return page;
+}
+
+QueryPlan SearchServer::PlanQuery(std::string_view raw_query, const SearchOptions& options) const {
+	return PlanQuery(ParseQuery(raw_query), options);
+}
+
+std::set<std::string, std::less<>> SearchServer::GetValidWordsSet(std::string_view text) {
+	std::set<std::string, std::less<>> result;
+	for (WordTokenizer tokenizer(text); tokenizer.Next();) {
+		if (!tokenizer.IsWordValid()) {
+			throw std::invalid_argument("Invalid word: " + std::string(tokenizer.GetWord()));
+		}
+		result.insert(std::string(tokenizer.GetWord()));
+	}
+	return result;
+}
+
+uint64_t SearchServer::GetNextGeneration() {
+	return last_generation.fetch_add(1, std::memory_order_relaxed) + 1;
+}
+
+std::string SearchServer::GetQueryCacheKey(const Query& query, DocumentStatus status, const SearchOptions& options) {
+	// Words never contain spaces
+	std::string key = std::to_string(static_cast<int>(status)) + ' ' + std::to_string(options.max_result_count)
+		+ ' ' + std::to_string(static_cast<int>(options.mode));
+	if (IsQuantized(options.strategy)) {
+		key += " q" + std::to_string(static_cast<int>(options.strategy));
+	}
+	for (const std::string_view word : query.plus_words) {
+		key += " +";
+		key += word;
+	}
+	for (const std::string_view word : query.minus_words) {
+		key += " -";
+		key += word;
+	}
+	return key;
 }
 
 bool SearchServer::IsStopWord(std::string_view word) const {
 	return stop_words_.count(word) > 0;
 }
 
-std::vector<std::string_view> SearchServer::SplitIntoWordsNoStop(std::string_view text) const {
-	std::vector<std::string_view> words;
-	for (const std::string_view word : SplitIntoWords(text)) {
-		if (!IsStopWord(word)) {
-			words.push_back(word);
+std::string_view SearchServer::SplitIntoWordsNoStop(std::string_view text, std::vector<std::string_view>& words) const {
+	words.clear();
+	for (WordTokenizer tokenizer(text); tokenizer.Next();) {
+		if (!tokenizer.IsWordValid()) {
+			return tokenizer.GetWord();
+		}
+		if (!IsStopWord(tokenizer.GetWord())) {
+			words.push_back(tokenizer.GetWord());
+		}
+	}
+	return {};
+}
+
+int SearchServer::FindInternalId(int document_id) const {
+	if (snapshot_) {
+		return snapshot_->FindDocument(document_id);
+	}
+	// Entries of removed documents stay until they are erased in bulk
+	const DocumentEntry* entry = document_entries_.Find(document_id);
+	return entry == nullptr || external_ids_[entry->internal_id] != document_id ? NO_DOCUMENT : entry->internal_id;
+}
+
+int SearchServer::GetInternalId(int document_id) const {
+	const int internal_id = FindInternalId(document_id);
+	if (internal_id == NO_DOCUMENT) {
+		throw std::out_of_range("Invalid document id: " + std::to_string(document_id));
+	}
+	return internal_id;
+}
+
+double SearchServer::FindDocumentTermFreq(int internal_id, int term_id) const {
+	const auto [first, last] = GetDocumentTermIds(internal_id);
+	const int* const it = std::lower_bound(first, last, term_id);
+	if (it == last || *it != term_id) {
+		return 0.0;
+	}
+	const std::size_t position = static_cast<std::size_t>(it - first);
+	return snapshot_ ? snapshot_->GetTermFreqs(internal_id)[position] : documents_[internal_id]->term_freqs[position];
+}
+
+std::pair<const int*, const int*> SearchServer::GetDocumentTermIds(int internal_id) const {
+	if (snapshot_) {
+		const int* const term_ids = snapshot_->GetTermIds(internal_id);
+		return { term_ids, term_ids + snapshot_->GetWordCount(internal_id) };
+	}
+	const std::vector<int>& term_ids = documents_[internal_id]->term_ids;
+	return { term_ids.data(), term_ids.data() + term_ids.size() };
+}
+
+std::size_t SearchServer::GetInternalIdCount() const {
+	return snapshot_ ? snapshot_->GetInternalIdCount() : external_ids_.size();
+}
+
+SearchServer::DocumentColumns SearchServer::GetDocumentColumns() const {
+	if (snapshot_) {
+		return { snapshot_->GetExternalIds(), snapshot_->GetStatuses(), snapshot_->GetRatings() };
+	}
+	return { external_ids_.data(), document_statuses_.data(), document_ratings_.data() };
+}
+
+std::optional<SearchServer::DocumentAttributes> SearchServer::FindDocumentAttributes(int document_id) const {
+	const int internal_id = FindInternalId(document_id);
+	if (internal_id == NO_DOCUMENT) {
+		return std::nullopt;
+	}
+	return GetDocumentAttributesAt(internal_id);
+}
+
+SearchServer::DocumentAttributes SearchServer::GetDocumentAttributes(int document_id) const {
+	const std::optional<DocumentAttributes> attributes = FindDocumentAttributes(document_id);
+	if (!attributes) {
+		throw std::out_of_range("Invalid document id: " + std::to_string(document_id));
+	}
+	return *attributes;
+}
+
+void SearchServer::PurgeRemovedDocument(int document_id) {
+	const auto it = removed_documents_.find(document_id);
+	if (it == removed_documents_.end()) {
+		return;
+	}
+	const int internal_id = it->second;
+	removed_documents_.erase(it);
+	PurgeInternalIds({ internal_id });
+}
+
+void SearchServer::PurgeInternalIds(const std::vector<int>& internal_ids) {
+	// Postings to purge grouped by term, every term is then rewritten in one pass on its own
+	std::vector<std::pair<int, int>> term_postings;
+	for (const int internal_id : internal_ids) {
+		for (const int term_id : documents_[internal_id]->term_ids) {
+			term_postings.push_back({ term_id, internal_id });
+		}
+	}
+	std::sort(term_postings.begin(), term_postings.end());
+
+	std::vector<std::pair<int, std::vector<int>>> term_purges;
+	for (const auto& [term_id, internal_id] : term_postings) {
+		if (term_purges.empty() || term_purges.back().first != term_id) {
+			term_purges.push_back({ term_id, {} });
+		}
+		term_purges.back().second.push_back(internal_id);
+	}
+	std::for_each(std::execution::par, term_purges.begin(), term_purges.end(),
+		[this](const std::pair<int, std::vector<int>>& term_purge) {
+			index_.PurgePostings(term_purge.first, term_purge.second);
+		}
+	);
+	for (const auto& [term_id, purged_ids] : term_purges) {
+		if (index_.GetPostings(term_id).empty()) {
+			index_.RemoveTerm(term_id);
+		}
+	}
+	// No posting refers to the ids any more
+	for (const int internal_id : internal_ids) {
+		documents_[internal_id].reset();
+		free_internal_ids_.push_back(internal_id);
+	}
+}
+
+void SearchServer::Materialize() {
+	if (!snapshot_) {
+		return;
+	}
+	document_entries_.Assign(snapshot_->GetDocumentEntries(), snapshot_->GetDocumentEntries() + snapshot_->GetDocumentCount());
+	const std::size_t internal_id_count = snapshot_->GetInternalIdCount();
+	external_ids_.assign(snapshot_->GetExternalIds(), snapshot_->GetExternalIds() + internal_id_count);
+	document_statuses_.assign(snapshot_->GetStatuses(), snapshot_->GetStatuses() + internal_id_count);
+	document_ratings_.assign(snapshot_->GetRatings(), snapshot_->GetRatings() + internal_id_count);
+	document_lengths_.assign(snapshot_->GetLengths(), snapshot_->GetLengths() + internal_id_count);
+	documents_.resize(internal_id_count);
+	for (int internal_id = static_cast<int>(internal_id_count) - 1; internal_id >= 0; --internal_id) {
+		if (external_ids_[internal_id] == NO_DOCUMENT) {
+			free_internal_ids_.push_back(internal_id);
+			continue;
 		}
+		auto document_data = std::make_shared<DocumentData>();
+		// The index keeps the term ids of the snapshot
+		snapshot_->ForEachTermId(internal_id, [&document_data](int term_id, double freq) {
+			document_data->term_ids.push_back(term_id);
+			document_data->term_freqs.push_back(freq);
+		});
+		documents_[internal_id] = std::move(document_data);
 	}
-	return words;
+	// The index leaves the mapping too, so the term views GetWordFrequencies caches from now on
+	// point into the heap and outlive the snapshot
+	index_.Materialize();
+	snapshot_.reset();
 }
 
 int SearchServer::ComputeAverageRating(const std::vector<int>& ratings) {
@@ -84,12 +455,145 @@ int SearchServer::ComputeAverageRating(const std::vector<int>& ratings) {
 	return rating_sum / static_cast<int>(ratings.size());
 }
 
-SearchServer::QueryWord SearchServer::ParseQueryWord(std::string_view text) const {
-	if (!IsValidWord(text)) {
-		throw std::invalid_argument("Invalid query word: " + std::string(text));
+SearchServer::PreparedDocument SearchServer::PrepareDocument(std::string_view text) const {
+	PreparedDocument document;
+	// Every thread reuses its buffer for the documents it prepares
+	static thread_local std::vector<std::string_view> words;
+	const std::string_view invalid_word = SplitIntoWordsNoStop(text, words);
+	if (!invalid_word.empty()) {
+		document.is_valid = false;
+		document.invalid_word = invalid_word;
+		return document;
 	}
+	document.length = static_cast<int>(words.size());
+	// Equal words are counted as runs of the sorted list
+	std::sort(words.begin(), words.end());
+	for (auto it = words.begin(); it != words.end();) {
+		const auto run_end = std::upper_bound(it, words.end(), *it);
+		document.word_counts.push_back({ *it, static_cast<int>(run_end - it) });
+		it = run_end;
+	}
+	return document;
+}
+
+std::size_t SearchServer::CountValidDocuments(const std::vector<DocumentInput>& documents,
+	const std::vector<PreparedDocument>& prepared, std::exception_ptr& error) const {
+	std::unordered_set<int> batch_ids;
+	batch_ids.reserve(documents.size());
+	for (std::size_t i = 0; i < documents.size(); ++i) {
+		const int document_id = documents[i].id;
+		if (document_id < 0 || FindInternalId(document_id) != NO_DOCUMENT || !batch_ids.insert(document_id).second) {
+			error = std::make_exception_ptr(
+				std::invalid_argument("Invalid document id: " + std::to_string(document_id)));
+			return i;
+		}
+		if (!prepared[i].is_valid) {
+			error = std::make_exception_ptr(
+				std::invalid_argument("Invalid word in document: " + std::string(prepared[i].invalid_word)));
+			return i;
+		}
+	}
+	return documents.size();
+}
+
+std::size_t SearchServer::GetBatchChunkCount(std::size_t document_count) {
+	const std::size_t thread_count = std::thread::hardware_concurrency();
+	return std::max<std::size_t>(1,
+		std::min(thread_count * SHARDS_PER_THREAD, document_count / MIN_DOCUMENTS_PER_BATCH_CHUNK + 1));
+}
+
+std::vector<SearchServer::BatchTerm> SearchServer::RegisterBatchTerms(const std::vector<PartialIndex>& partial_indexes) {
+	std::vector<BatchTerm> batch_terms;
+	std::vector<int> term_to_batch_term;
+	for (const PartialIndex& partial_index : partial_indexes) {
+		for (const auto& [word, postings] : partial_index) {
+			const int term_id = index_.AddTerm(word);
+			if (term_to_batch_term.size() <= static_cast<std::size_t>(term_id)) {
+				term_to_batch_term.resize(index_.GetTermCount(), -1);
+			}
+			if (term_to_batch_term[term_id] < 0) {
+				term_to_batch_term[term_id] = static_cast<int>(batch_terms.size());
+				batch_terms.push_back({ term_id, {} });
+			}
+			batch_terms[term_to_batch_term[term_id]].parts.push_back(&postings);
+		}
+	}
+	return batch_terms;
+}
+
+std::shared_ptr<const SearchServer::DocumentData> SearchServer::MakeDocumentData(const PreparedDocument& prepared,
+	std::vector<int> term_ids) {
+	// Term ids follow the words, the forward index is sorted by id
+	std::vector<std::size_t> order(term_ids.size());
+	std::iota(order.begin(), order.end(), 0);
+	std::sort(order.begin(), order.end(), [&term_ids](std::size_t lhs, std::size_t rhs) {
+		return term_ids[lhs] < term_ids[rhs];
+	});
+	auto document_data = std::make_shared<DocumentData>();
+	document_data->term_ids.reserve(order.size());
+	document_data->term_freqs.reserve(order.size());
+	for (const std::size_t i : order) {
+		document_data->term_ids.push_back(term_ids[i]);
+		document_data->term_freqs.push_back(ComputeTermFreq(prepared.word_counts[i].second, prepared.length));
+	}
+	return document_data;
+}
+
+std::vector<int> SearchServer::AllocateInternalIds(std::size_t count) {
+	std::vector<int> internal_ids;
+	internal_ids.reserve(count);
+	while (internal_ids.size() < count && !free_internal_ids_.empty()) {
+		internal_ids.push_back(free_internal_ids_.back());
+		free_internal_ids_.pop_back();
+	}
+	std::sort(internal_ids.begin(), internal_ids.end());
+	const std::size_t first_new_id = external_ids_.size();
+	const std::size_t internal_id_count = first_new_id + count - internal_ids.size();
+	for (std::size_t internal_id = first_new_id; internal_id < internal_id_count; ++internal_id) {
+		internal_ids.push_back(static_cast<int>(internal_id));
+	}
+	// Scans skip the ids until their documents are stored
+	external_ids_.resize(internal_id_count, NO_DOCUMENT);
+	document_statuses_.resize(internal_id_count);
+	document_ratings_.resize(internal_id_count);
+	document_lengths_.resize(internal_id_count);
+	documents_.resize(internal_id_count);
+	return internal_ids;
+}
+
+void SearchServer::StoreDocumentColumns(int internal_id, int document_id, DocumentStatus status,
+	const std::vector<int>& ratings, int length, std::shared_ptr<const DocumentData> document_data) {
+	external_ids_[internal_id] = document_id;
+	document_statuses_[internal_id] = static_cast<int>(status);
+	document_ratings_[internal_id] = ComputeAverageRating(ratings);
+	document_lengths_[internal_id] = length;
+	documents_[internal_id] = std::move(document_data);
+}
+
+void SearchServer::StoreBatchDocuments(const std::vector<DocumentInput>& documents,
+	const std::vector<PreparedDocument>& prepared, const std::vector<std::size_t>& order,
+	const std::vector<int>& internal_ids, std::vector<std::shared_ptr<const DocumentData>>& batch_documents) {
+	for (std::size_t k = 0; k < order.size(); ++k) {
+		const DocumentInput& document = documents[order[k]];
+		StoreDocumentColumns(internal_ids[k], document.id, document.status, document.ratings,
+			prepared[order[k]].length, std::move(batch_documents[k]));
+	}
+	std::vector<DocumentEntry> entries;
+	entries.reserve(order.size());
+	for (std::size_t k = 0; k < order.size(); ++k) {
+		const int document_id = documents[order[k]].id;
+		if (DocumentEntry* const entry = document_entries_.Find(document_id)) {
+			entry->internal_id = internal_ids[k];
+		}
+		else {
+			entries.push_back({ document_id, internal_ids[k] });
+		}
+	}
+	document_entries_.InsertSorted(entries);
+}
+
+SearchServer::QueryWord SearchServer::ParseQueryWord(std::string_view text) const {
 	bool is_minus = false;
-	// Word shouldn't be empty
 	if (text[0] == '-') {
 		if (text.size() == 1 || (text.size() > 1 && text[1] == '-')) {
 			throw std::invalid_argument("Invalid minus word: " + std::string(text));
@@ -102,8 +606,11 @@ SearchServer::QueryWord SearchServer::ParseQueryWord(std::string_view text) cons
 
 SearchServer::Query SearchServer::ParseQuery(std::string_view text) const {
 	Query query;
-	for (const std::string_view word : SplitIntoWords(text)) {
-		const QueryWord query_word = ParseQueryWord(word);
+	for (WordTokenizer tokenizer(text); tokenizer.Next();) {
+		if (!tokenizer.IsWordValid()) {
+			throw std::invalid_argument("Invalid query word: " + std::string(tokenizer.GetWord()));
+		}
+		const QueryWord query_word = ParseQueryWord(tokenizer.GetWord());
 		if (!query_word.is_stop) {
 			if (query_word.is_minus) {
 				query.minus_words.insert(query_word.data);
@@ -116,37 +623,252 @@ SearchServer::Query SearchServer::ParseQuery(std::string_view text) const {
 	return query;
 }
 
-double SearchServer::ComputeWordInverseDocumentFreq(std::string_view word) const {
-	return std::log(GetDocumentCount() * 1.0 / word_to_document_freqs_.at(word).size());
+TermStatistics SearchServer::GetTermStatistics(int term_id) const {
+	TermStatistics statistics;
+	// Postings of removed documents are not counted
+	const std::size_t live_posting_count = index_.GetLivePostingCount(term_id);
+	if (live_posting_count == 0) {
+		return statistics;
+	}
+	statistics.inverse_document_freq = std::log(GetDocumentCount() * 1.0 / live_posting_count);
+	statistics.max_score = index_.GetPostings(term_id).GetMaxTermFreq() * statistics.inverse_document_freq;
+	return statistics;
+}
+
+std::shared_ptr<const ImpactTable> SearchServer::GetImpactTable() const {
+	return impact_tables_.Get(generation_, [this](ImpactTable& table) {
+		// A live term has a posting, so no idf exceeds log(N) and no score exceeds the largest term
+		// frequency times it. Bounding every term this way leaves the table O(1) to set up
+		const double max_score = index_.GetMaxTermFreq() * std::log(std::max<double>(GetDocumentCount(), 1.0));
+		table.SetStep(max_score / MAX_IMPACT);
+	});
+}
+
+std::vector<int> SearchServer::GetPlusTermIds(const Query& query) const {
+	std::vector<int> term_ids;
+	term_ids.reserve(query.plus_words.size());
+	for (const std::string_view word : query.plus_words) {
+		const int term_id = index_.FindTermId(word);
+		if (term_id != InvertedIndex::NO_TERM) {
+			term_ids.push_back(term_id);
+		}
+	}
+	std::stable_sort(term_ids.begin(), term_ids.end(), [this](int lhs, int rhs) {
+		return index_.GetLivePostingCount(lhs) < index_.GetLivePostingCount(rhs);
+	});
+	return term_ids;
+}
+
+QueryPlan SearchServer::PlanQuery(const Query& query, const SearchOptions& options) const {
+	QueryPlan plan;
+	plan.strategy = options.strategy;
+	plan.mode = options.mode;
+	const auto get_posting_count = [this](std::string_view word) -> std::size_t {
+		const int term_id = index_.FindTermId(word);
+		return term_id == InvertedIndex::NO_TERM ? 0 : index_.GetPostings(term_id).size();
+	};
+	const auto get_live_posting_count = [this](std::string_view word) -> std::size_t {
+		const int term_id = index_.FindTermId(word);
+		return term_id == InvertedIndex::NO_TERM ? 0 : index_.GetLivePostingCount(term_id);
+	};
+	for (const std::string_view word : query.plus_words) {
+		plan.terms.push_back({ word, get_posting_count(word), false });
+		plan.plus_posting_count += plan.terms.back().posting_count;
+	}
+	// Postings of removed documents still cost a scan, but the terms go in the order of GetPlusTermIds
+	std::stable_sort(plan.terms.begin(), plan.terms.end(), [&](const PlannedTerm& lhs, const PlannedTerm& rhs) {
+		return get_live_posting_count(lhs.word) < get_live_posting_count(rhs.word);
+	});
+	for (const std::string_view word : query.minus_words) {
+		plan.terms.push_back({ word, get_posting_count(word), true });
+		plan.minus_posting_count += plan.terms.back().posting_count;
+	}
+
+	plan.is_parallel = std::thread::hardware_concurrency() > 1
+		&& plan.plus_posting_count >= planner_thresholds_.min_parallel_posting_count;
+	// MaxScore probes minus postings only for its candidates, collecting them up front would cost more
+	plan.is_minus_first = options.mode == QueryMode::DISJUNCTIVE && options.strategy == EvaluationStrategy::EXHAUSTIVE
+		&& plan.minus_posting_count > 0 && plan.plus_posting_count > 0
+		&& static_cast<double>(plan.minus_posting_count)
+			>= planner_thresholds_.min_minus_first_document_share * static_cast<double>(GetDocumentCount());
+	return plan;
 }
 
-std::set<int>::const_iterator SearchServer::begin() const { return document_ids_.begin(); }
+DocumentIdIterator SearchServer::begin() const {
+	if (snapshot_) {
+		const DocumentEntry* const entries = snapshot_->GetDocumentEntries();
+		return DocumentIdIterator(entries, entries + snapshot_->GetDocumentCount(), nullptr, nullptr,
+			snapshot_->GetExternalIds());
+	}
+	return document_entries_.begin(external_ids_.data());
+}
 
-std::set<int>::const_iterator SearchServer::end() const { return document_ids_.end(); }
+DocumentIdIterator SearchServer::end() const {
+	if (snapshot_) {
+		const DocumentEntry* const entries_end = snapshot_->GetDocumentEntries() + snapshot_->GetDocumentCount();
+		return DocumentIdIterator(entries_end, entries_end, nullptr, nullptr, nullptr);
+	}
+	return document_entries_.end();
+}
 
 const std::map<std::string_view, double>& SearchServer::GetWordFrequencies(int document_id) const {
-	if (documents_.count(document_id) == 0) {
+	const int internal_id = FindInternalId(document_id);
+	if (internal_id == NO_DOCUMENT) {
 		return empty_map;
 	}
-	return documents_.at(document_id).word_to_freq;
+	if (snapshot_) {
+		return snapshot_->GetWordFrequencies(internal_id);
+	}
+	const DocumentData& document_data = *documents_[internal_id];
+	std::call_once(document_data.word_to_freq_flag, [this, &document_data]() {
+		for (std::size_t i = 0; i < document_data.term_ids.size(); ++i) {
+			document_data.word_to_freq.emplace(index_.GetTerm(document_data.term_ids[i]), document_data.term_freqs[i]);
+		}
+	});
+	return document_data.word_to_freq;
 }
 
 void SearchServer::RemoveDocument(int document_id) {
-	const auto it = documents_.find(document_id);
-	if (it == documents_.end()) return;
+	if (FindInternalId(document_id) == NO_DOCUMENT) {
+		return;
+	}
+	Materialize();
+	const int internal_id = FindInternalId(document_id);
+	generation_ = GetNextGeneration();
 
-	for (const auto& [word, freq] : it->second.word_to_freq) {
-		word_to_document_freqs_.at(word).erase(document_id);
+	for (const int term_id : documents_[internal_id]->term_ids) {
+		index_.MarkPostingRemoved(term_id);
 	}
-	documents_.erase(document_id);
-	document_ids_.erase(document_id);
+	// The entry stays as a tombstone, Compact erases it
+	removed_documents_.emplace(document_id, internal_id);
+	external_ids_[internal_id] = NO_DOCUMENT;
 }
 
-std::vector<Document> SearchServer::GetMatchedWords(const std::map<int, double>& document_to_relevance) const {
-	std::vector<Document> matched_documents;
-	for (const auto [document_id, relevance] : document_to_relevance) {
-		matched_documents.push_back(
-			{ document_id, relevance, documents_.at(document_id).rating });
+void SearchServer::RemoveDocuments(const std::vector<int>& document_ids) {
+	if (std::none_of(document_ids.begin(), document_ids.end(),
+		[this](int document_id) { return FindInternalId(document_id) != NO_DOCUMENT; })) {
+		return;
+	}
+	Materialize();
+	for (const int document_id : document_ids) {
+		const int internal_id = FindInternalId(document_id);
+		if (internal_id == NO_DOCUMENT) {
+			continue;
+		}
+		for (const int term_id : documents_[internal_id]->term_ids) {
+			index_.MarkPostingRemoved(term_id);
+		}
+		removed_documents_.emplace(document_id, internal_id);
+		external_ids_[internal_id] = NO_DOCUMENT;
 	}
-	return matched_documents;
+	generation_ = GetNextGeneration();
+}
+
+std::size_t SearchServer::Compact(std::size_t max_document_count) {
+	if (removed_documents_.empty()) {
+		return 0;
+	}
+	std::vector<int> document_ids;
+	std::vector<int> internal_ids;
+	auto last = removed_documents_.begin();
+	for (; last != removed_documents_.end() && internal_ids.size() < max_document_count; ++last) {
+		document_ids.push_back(last->first);
+		internal_ids.push_back(last->second);
+	}
+	removed_documents_.erase(removed_documents_.begin(), last);
+	// The ids come sorted from the map, their entries are erased in a single pass
+	document_entries_.EraseSorted(document_ids);
+	PurgeInternalIds(internal_ids);
+	// Word maps point into the term pool. The maps of documents no copy of the server shares are
+	// rebuilt in place over the new pool, shared ones get a copy of the document without the map,
+	// since earlier versions may read theirs concurrently
+	if (removed_documents_.empty() && index_.ReclaimTerms()) {
+		for (std::shared_ptr<const DocumentData>& document_data : documents_) {
+			if (!document_data) {
+				continue;
+			}
+			if (document_data.use_count() == 1) {
+				if (!document_data->word_to_freq.empty()) {
+					document_data->word_to_freq.clear();
+					for (std::size_t i = 0; i < document_data->term_ids.size(); ++i) {
+						document_data->word_to_freq.emplace(index_.GetTerm(document_data->term_ids[i]),
+							document_data->term_freqs[i]);
+					}
+				}
+				continue;
+			}
+			auto reclaimed_data = std::make_shared<DocumentData>();
+			reclaimed_data->term_ids = document_data->term_ids;
+			reclaimed_data->term_freqs = document_data->term_freqs;
+			document_data = std::move(reclaimed_data);
+		}
+	}
+	return internal_ids.size();
+}
+
+std::vector<std::pair<int, int>> SearchServer::SplitDocumentIdRange(const Query& query) const {
+	PostingListView longest_postings;
+	std::size_t posting_count = 0;
+	for (const std::string_view word : query.plus_words) {
+		const int term_id = index_.FindTermId(word);
+		if (term_id == InvertedIndex::NO_TERM) {
+			continue;
+		}
+		const PostingListView postings = index_.GetPostings(term_id);
+		posting_count += postings.size();
+		if (longest_postings.size() < postings.size()) {
+			longest_postings = postings;
+		}
+	}
+
+	const std::size_t thread_count = std::thread::hardware_concurrency();
+	std::size_t max_shard_count = planner_thresholds_.max_shard_count;
+	if (max_shard_count == 0) {
+		max_shard_count = thread_count <= 1 ? 1 : thread_count * SHARDS_PER_THREAD;
+	}
+	const std::size_t shard_count = longest_postings.empty()
+		? 1
+		: std::min(max_shard_count, posting_count / planner_thresholds_.min_postings_per_shard + 1);
+
+	// Quantiles of the longest posting list approximate an even split of the work
+	std::vector<std::pair<int, int>> id_ranges;
+	int first_id = 0;
+	for (std::size_t shard = 1; shard < shard_count; ++shard) {
+		const int bound = longest_postings.GetDocumentIdAt(longest_postings.size() * shard / shard_count);
+		if (bound > first_id) {
+			id_ranges.push_back({ first_id, bound - 1 });
+			first_id = bound;
+		}
+	}
+	id_ranges.push_back({ first_id, std::numeric_limits<int>::max() });
+	return id_ranges;
+}
+
+std::vector<std::pair<int, int>> SearchServer::SplitQueryBatch(std::size_t posting_count, bool is_parallel) const {
+	// Internal ids are dense, so even splits of them hold about as many documents
+	const std::size_t internal_id_count = GetInternalIdCount();
+	const std::size_t max_range_count = planner_thresholds_.max_shard_count > 0
+		? planner_thresholds_.max_shard_count
+		: GetQueryBatchWaveSize() * SHARDS_PER_THREAD;
+	const std::size_t parallel_range_count = is_parallel
+		? std::min(max_range_count, posting_count / planner_thresholds_.min_postings_per_shard + 1)
+		: 1;
+	const std::size_t range_count = std::min(std::max<std::size_t>(internal_id_count, 1),
+		std::max(parallel_range_count, posting_count / MAX_POSTINGS_PER_QUERY_BATCH_RANGE + 1));
+
+	std::vector<std::pair<int, int>> id_ranges;
+	int first_id = 0;
+	for (std::size_t range = 1; range < range_count; ++range) {
+		const int bound = static_cast<int>(internal_id_count * range / range_count);
+		if (bound > first_id) {
+			id_ranges.push_back({ first_id, bound - 1 });
+			first_id = bound;
+		}
+	}
+	id_ranges.push_back({ first_id, std::numeric_limits<int>::max() });
+	return id_ranges;
+}
+
+std::size_t SearchServer::GetQueryBatchWaveSize() {
+	return std::max<std::size_t>(1, std::thread::hardware_concurrency());
 }
\ No newline at end of file
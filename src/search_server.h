@@ -3,78 +3,195 @@
 #include <algorithm>
 #include <atomic>
 #include <cmath>
+#include <exception>
 #include <execution>
 #include <functional>
+#include <limits>
 #include <map>
+#include <memory>
 #include <mutex>
+#include <numeric>
+#include <optional>
 #include <set>
 #include <stdexcept>
 #include <string>
 #include <string_view>
 #include <tuple>
 #include <type_traits>
+#include <unordered_map>
 #include <utility>
 #include <vector>
 
-#include "concurrent_map.h"
 #include "document.h"
+#include "document_id_index.h"
+#include "impact_index.h"
+#include "index_snapshot.h"
+#include "inverted_index.h"
 #include "log_duration.h"
-
-const int MAX_RESULT_DOCUMENT_COUNT = 5;
+#include "posting_cursor.h"
+#include "posting_intersection.h"
+#include "query_cache.h"
+#include "query_plan.h"
+#include "relevance_accumulator.h"
+#include "result_pages.h"
+#include "search_options.h"
+#include "string_processing.h"
+#include "term_statistics.h"
+#include "top_documents.h"
 
 class SearchServer {
 public:
-	explicit SearchServer(std::string_view stop_words);
+	explicit SearchServer(std::string_view stop_words, IndexMode index_mode = IndexMode::FLAT);
 
-	explicit SearchServer(const std::string& stop_words);
+	explicit SearchServer(const std::string& stop_words, IndexMode index_mode = IndexMode::FLAT);
 
 	template <typename StopWords>
-	explicit SearchServer(const StopWords& stop_words)
+	explicit SearchServer(const StopWords& stop_words, IndexMode index_mode = IndexMode::FLAT)
 		: stop_words_(GetValidWordsSet(stop_words))
+		, index_(index_mode)
+		, generation_(GetNextGeneration())
 	{}
 
+	// Serves queries straight from the mapped file, the first modification copies it to the heap
+	static SearchServer OpenSnapshot(const std::string& path);
+
+	void SaveSnapshot(const std::string& path) const;
+
+	// Caches the results of FindTopDocuments filtered by status, zero capacity disables the cache.
+	// Copies of the server share the cache
+	void EnableQueryCache(std::size_t capacity);
+
+	QueryCacheStats GetQueryCacheStats() const;
+
+	// Changes with every modification of the documents, and no two states share a generation
+	uint64_t GetGeneration() const { return generation_; }
+
+	void SetQueryPlannerThresholds(const QueryPlannerThresholds& thresholds) { planner_thresholds_ = thresholds; }
+
+	const QueryPlannerThresholds& GetQueryPlannerThresholds() const { return planner_thresholds_; }
+
+	// Copies of the server made after the call keep calling the observer
+	void SetQueryPlanObserver(QueryPlanObserver observer) { plan_observer_ = std::move(observer); }
+
+	// The plan FindTopDocuments(adaptive_execution, raw_query, ...) evaluates the query with
+	QueryPlan PlanQuery(std::string_view raw_query, const SearchOptions& options = {}) const;
+
 	void AddDocument(int document_id, std::string_view document,
 		DocumentStatus status, const std::vector<int>& ratings);
 
-	template <typename ExecutionPolicy, typename Predicate>
-	std::vector<Document> FindTopDocuments(ExecutionPolicy policy, std::string_view raw_query,
-		Predicate predicate) const {
-		const Query query = ParseQuery(raw_query);
-		auto matched_documents = FindAllDocuments(policy, query, predicate);
+	// Adds the documents as AddDocument called for each of them in order would: when one of them
+	// is invalid, the documents before it are added and the same exception is thrown
+	void AddDocuments(const std::vector<DocumentInput>& documents);
+
+	template <typename ExecutionPolicy>
+	void AddDocuments(ExecutionPolicy policy, const std::vector<DocumentInput>& documents) {
+		static_assert(std::is_same_v<ExecutionPolicy, std::execution::sequenced_policy> || std::is_same_v<ExecutionPolicy, std::execution::parallel_policy>);
+		std::vector<std::size_t> indexes(documents.size());
+		std::iota(indexes.begin(), indexes.end(), 0);
+		std::vector<PreparedDocument> prepared(documents.size());
+		std::for_each(policy, indexes.begin(), indexes.end(), [this, &documents, &prepared](std::size_t i) {
+			prepared[i] = PrepareDocument(documents[i].text);
+		});
+		std::exception_ptr error;
+		const std::size_t valid_count = CountValidDocuments(documents, prepared, error);
+		if (valid_count == 0) {
+			if (error) {
+				std::rethrow_exception(error);
+			}
+			return;
+		}
+		Materialize();
+		generation_ = GetNextGeneration();
 
-		std::sort(policy, matched_documents.begin(), matched_documents.end(),
-			[](const Document& lhs, const Document& rhs) {
-				if (std::abs(lhs.relevance - rhs.relevance) < 1e-6) {
-					return lhs.rating > rhs.rating;
+		// Valid documents in id order get ascending internal ids and are split into contiguous chunks,
+		// so every partial index holds ascending postings and chunks follow each other in id order
+		std::vector<std::size_t> order(indexes.begin(), indexes.begin() + valid_count);
+		std::sort(order.begin(), order.end(), [&documents](std::size_t lhs, std::size_t rhs) {
+			return documents[lhs].id < documents[rhs].id;
+		});
+		for (const std::size_t i : order) {
+			PurgeRemovedDocument(documents[i].id);
+		}
+		const std::vector<int> internal_ids = AllocateInternalIds(order.size());
+		const std::size_t chunk_count = std::is_same_v<ExecutionPolicy, std::execution::parallel_policy>
+			? GetBatchChunkCount(order.size())
+			: 1;
+		std::vector<PartialIndex> partial_indexes(chunk_count);
+		std::vector<std::size_t> chunks(chunk_count);
+		std::iota(chunks.begin(), chunks.end(), 0);
+		std::for_each(policy, chunks.begin(), chunks.end(),
+			[&prepared, &order, &internal_ids, &partial_indexes, chunk_count](std::size_t chunk) {
+				PartialIndex& partial_index = partial_indexes[chunk];
+				for (std::size_t k = order.size() * chunk / chunk_count; k < order.size() * (chunk + 1) / chunk_count; ++k) {
+					const PreparedDocument& document = prepared[order[k]];
+					for (const auto& [word, count] : document.word_counts) {
+						partial_index[word].push_back({ internal_ids[k], count, document.length });
+					}
+				}
+			}
+		);
+
+		// Terms are registered in a single pass, then every posting list is extended on its own
+		const std::vector<BatchTerm> batch_terms = RegisterBatchTerms(partial_indexes);
+		std::for_each(policy, batch_terms.begin(), batch_terms.end(), [this](const BatchTerm& batch_term) {
+			for (const std::vector<BatchPosting>* postings : batch_term.parts) {
+				for (const BatchPosting& posting : *postings) {
+					index_.AddPosting(batch_term.term_id, posting.document_id, posting.count, posting.document_length);
 				}
-				else {
-					return lhs.relevance > rhs.relevance;
+			}
+		});
+		std::vector<std::shared_ptr<const DocumentData>> batch_documents(order.size());
+		std::vector<std::size_t> positions(order.size());
+		std::iota(positions.begin(), positions.end(), 0);
+		std::for_each(policy, positions.begin(), positions.end(),
+			[this, &prepared, &order, &batch_documents](std::size_t k) {
+				const PreparedDocument& document = prepared[order[k]];
+				std::vector<int> term_ids;
+				term_ids.reserve(document.word_counts.size());
+				for (const auto& [word, count] : document.word_counts) {
+					term_ids.push_back(index_.FindTermId(word));
 				}
+				batch_documents[k] = MakeDocumentData(document, std::move(term_ids));
 			}
 		);
-		if (matched_documents.size() > MAX_RESULT_DOCUMENT_COUNT) {
-			matched_documents.resize(MAX_RESULT_DOCUMENT_COUNT);
+		StoreBatchDocuments(documents, prepared, order, internal_ids, batch_documents);
+		if (error) {
+			std::rethrow_exception(error);
 		}
-		return matched_documents;
+	}
+
+	template <typename ExecutionPolicy, typename Predicate>
+	std::vector<Document> FindTopDocuments(ExecutionPolicy policy, std::string_view raw_query,
+		Predicate predicate, const SearchOptions& options = {}) const {
+		return FindTopDocuments(policy, ParseQuery(raw_query), predicate, options);
 	}
 
 	template <typename Predicate>
 	std::vector<Document> FindTopDocuments(std::string_view raw_query,
-		Predicate predicate) const {
-		return FindTopDocuments(std::execution::seq, raw_query, predicate);
+		Predicate predicate, const SearchOptions& options = {}) const {
+		return FindTopDocuments(std::execution::seq, raw_query, predicate, options);
 	}
 
 	std::vector<Document> FindTopDocuments(std::string_view raw_query,
-		DocumentStatus doc_status) const;
+		DocumentStatus doc_status, const SearchOptions& options = {}) const;
 
 	std::vector<Document> FindTopDocuments(std::string_view raw_query) const;
 
 	template <typename ExecutionPolicy>
 	std::vector<Document> FindTopDocuments(ExecutionPolicy policy,
-		std::string_view raw_query, DocumentStatus doc_status) const {
-		return FindTopDocuments(policy, raw_query, [doc_status](int document_id, DocumentStatus status, int rating) {
-			return status == doc_status;
-		});
+		std::string_view raw_query, DocumentStatus doc_status, const SearchOptions& options = {}) const {
+		const StatusPredicate predicate{ doc_status };
+		const Query query = ParseQuery(raw_query);
+		if (!query_cache_) {
+			return FindTopDocuments(policy, query, predicate, options);
+		}
+		std::string key = GetQueryCacheKey(query, doc_status, options);
+		if (std::optional<std::vector<Document>> documents = query_cache_->Find(key, generation_)) {
+			return std::move(*documents);
+		}
+		std::vector<Document> documents = FindTopDocuments(policy, query, predicate, options);
+		query_cache_->Insert(std::move(key), generation_, documents);
+		return documents;
 	}
 
 	template <typename ExecutionPolicy>
@@ -82,6 +199,98 @@ public:
 		return FindTopDocuments(policy, raw_query, DocumentStatus::ACTUAL);
 	}
 
+	// Answers every query as FindTopDocuments(policy, query, doc_status, options) does. Queries are
+	// parsed up front, equal ones are evaluated once, and every posting list is scanned once per
+	// block of document ids for all the queries containing its term. Conjunctive and quantized
+	// queries share no work, they are spread over the threads instead
+	template <typename ExecutionPolicy>
+	std::vector<std::vector<Document>> FindTopDocumentsBatch(ExecutionPolicy policy,
+		const std::vector<std::string>& raw_queries, DocumentStatus doc_status = DocumentStatus::ACTUAL,
+		const SearchOptions& options = {}) const {
+		static_assert(std::is_same_v<ExecutionPolicy, std::execution::sequenced_policy> || std::is_same_v<ExecutionPolicy, std::execution::parallel_policy>);
+		std::vector<Query> queries;
+		std::vector<std::string> keys;
+		std::vector<std::size_t> query_indexes(raw_queries.size());
+		std::unordered_map<std::string_view, std::size_t> key_to_query;
+		keys.reserve(raw_queries.size());
+		for (std::size_t i = 0; i < raw_queries.size(); ++i) {
+			Query query = ParseQuery(raw_queries[i]);
+			std::string key = GetQueryCacheKey(query, doc_status, options);
+			const auto it = key_to_query.find(key);
+			if (it != key_to_query.end()) {
+				query_indexes[i] = it->second;
+				continue;
+			}
+			query_indexes[i] = queries.size();
+			queries.push_back(std::move(query));
+			keys.push_back(std::move(key));
+			key_to_query.emplace(keys.back(), query_indexes[i]);
+		}
+
+		std::vector<std::vector<Document>> query_results(queries.size());
+		std::vector<const Query*> missed_queries;
+		std::vector<std::size_t> missed_indexes;
+		for (std::size_t i = 0; i < queries.size(); ++i) {
+			std::optional<std::vector<Document>> documents = query_cache_
+				? query_cache_->Find(keys[i], generation_)
+				: std::nullopt;
+			if (documents) {
+				query_results[i] = std::move(*documents);
+				continue;
+			}
+			missed_queries.push_back(&queries[i]);
+			missed_indexes.push_back(i);
+		}
+		const StatusPredicate predicate{ doc_status };
+		std::vector<std::vector<Document>> missed_results;
+		if (options.mode == QueryMode::CONJUNCTIVE || IsQuantized(options.strategy)) {
+			missed_results.resize(missed_queries.size());
+			std::transform(policy, missed_queries.begin(), missed_queries.end(), missed_results.begin(),
+				[this, predicate, &options](const Query* query) {
+					return FindTopDocuments(std::execution::seq, *query, predicate, options);
+				});
+		}
+		else {
+			missed_results = FindTopDocumentsBatch(policy, missed_queries, predicate, options.max_result_count);
+		}
+		for (std::size_t k = 0; k < missed_indexes.size(); ++k) {
+			if (query_cache_) {
+				query_cache_->Insert(keys[missed_indexes[k]], generation_, missed_results[k]);
+			}
+			query_results[missed_indexes[k]] = std::move(missed_results[k]);
+		}
+
+		std::vector<std::vector<Document>> results(raw_queries.size());
+		for (std::size_t i = 0; i < raw_queries.size(); ++i) {
+			results[i] = query_results[query_indexes[i]];
+		}
+		return results;
+	}
+
+	// The limit documents ranked right after the cursor, or the first limit documents without one.
+	// Pages rank as FindTopDocuments does, and every page rescans the postings into a heap of limit
+	// documents, so deep pages cost as much as the first one. The cursor of the last document of a
+	// page continues the results as long as the documents don't change
+	template <typename ExecutionPolicy, typename Predicate>
+	ResultPage FindTopDocumentsPage(ExecutionPolicy policy, std::string_view raw_query, Predicate predicate,
+		std::size_t limit, const std::optional<SearchCursor>& after = std::nullopt) const {
+		static_assert(std::is_same_v<ExecutionPolicy, std::execution::sequenced_policy> || std::is_same_v<ExecutionPolicy, std::execution::parallel_policy>);
+		if constexpr (std::is_same_v<Predicate, DocumentStatus>) {
+			return FindTopDocumentsPage(policy, ParseQuery(raw_query), StatusPredicate{ predicate }, limit, after);
+		}
+		else {
+			return FindTopDocumentsPage(policy, ParseQuery(raw_query), predicate, limit, after);
+		}
+	}
+
+	ResultPage FindTopDocumentsPage(std::string_view raw_query, DocumentStatus doc_status, std::size_t limit,
+		const std::optional<SearchCursor>& after = std::nullopt) const;
+
+	// Pages of page_size documents fetched by FindTopDocumentsPage as the iteration reaches them.
+	// The server must outlive the pages
+	ResultPages PaginateTopDocuments(std::string_view raw_query, DocumentStatus doc_status,
+		std::size_t page_size) const;
+
 	std::size_t GetDocumentCount() const;
 
 	std::tuple<std::vector<std::string_view>, DocumentStatus> MatchDocument(std::string_view raw_query,
@@ -91,66 +300,133 @@ public:
 	std::tuple<std::vector<std::string_view>, DocumentStatus> MatchDocument(ExecutionPolicy policy,
 		std::string_view raw_query, int document_id) const {
 		static_assert(std::is_same_v<ExecutionPolicy, std::execution::sequenced_policy> || std::is_same_v<ExecutionPolicy, std::execution::parallel_policy>);
-		const Query query = ParseQuery(raw_query);
+		return MatchDocument(policy, ParseQuery(raw_query), document_id);
+	}
 
-		const bool contains_minus_words = std::any_of(
-			policy,
-			query.minus_words.begin(),
-			query.minus_words.end(),
-			[this, document_id](const std::string_view word) {
-				return word_to_document_freqs_.count(word) && word_to_document_freqs_.at(word).count(document_id);
-			}
-		);
+	// Checks the words in parallel only when the query has enough of them to pay for the threads
+	std::tuple<std::vector<std::string_view>, DocumentStatus> MatchDocument(AdaptiveExecutionPolicy policy,
+		std::string_view raw_query, int document_id) const;
 
-		std::vector<std::string_view> matched_words;
-		if (!contains_minus_words) {
-			matched_words.resize(query.plus_words.size());			
-			const auto it = std::copy_if(
-				policy,
-				query.plus_words.begin(),
-				query.plus_words.end(),
-				matched_words.begin(),
-				[this, document_id](const std::string_view word) {
-					return word_to_document_freqs_.count(word) && word_to_document_freqs_.at(word).count(document_id);
-				}
-			);
-			matched_words.erase(it, matched_words.end());
+	// Matches the query against the documents as MatchDocument does, the results follow the order of
+	// the ids. The query is parsed and its words are looked up in the index once for all the documents
+	template <typename ExecutionPolicy>
+	std::vector<std::tuple<std::vector<std::string_view>, DocumentStatus>> MatchDocuments(ExecutionPolicy policy,
+		std::string_view raw_query, const std::vector<int>& document_ids) const {
+		static_assert(std::is_same_v<ExecutionPolicy, std::execution::sequenced_policy> || std::is_same_v<ExecutionPolicy, std::execution::parallel_policy>);
+		const MatchQuery query = ResolveMatchQuery(ParseQuery(raw_query));
+		std::vector<int> internal_ids;
+		internal_ids.reserve(document_ids.size());
+		for (const int document_id : document_ids) {
+			internal_ids.push_back(GetInternalId(document_id));
 		}
-
-		return { matched_words, documents_.at(document_id).status };
+		std::vector<std::tuple<std::vector<std::string_view>, DocumentStatus>> results(internal_ids.size());
+		std::transform(policy, internal_ids.begin(), internal_ids.end(), results.begin(),
+			[this, &query](int internal_id) {
+				return MatchDocumentTerms(std::execution::seq, query, internal_id);
+			}
+		);
+		return results;
 	}
 
-	std::set<int>::const_iterator begin() const;
+	std::vector<std::tuple<std::vector<std::string_view>, DocumentStatus>> MatchDocuments(std::string_view raw_query,
+		const std::vector<int>& document_ids) const;
 
-	std::set<int>::const_iterator end() const;
+	// Ascending ids of the documents
+	DocumentIdIterator begin() const;
+
+	DocumentIdIterator end() const;
 
 	const std::map<std::string_view, double>& GetWordFrequencies(int document_id) const;
 
+	// Calls function(term_id) for every distinct word of the document in ascending term id order.
+	// Equal words get equal ids within the server, so the ids compare documents without building word maps
+	template <typename Function>
+	void ForEachDocumentTermId(int document_id, Function function) const {
+		const int internal_id = FindInternalId(document_id);
+		if (internal_id == NO_DOCUMENT) {
+			return;
+		}
+		const auto [first, last] = GetDocumentTermIds(internal_id);
+		std::for_each(first, last, function);
+	}
+
+	// The document disappears at once in O(log N) plus its word count. Its postings and its id entry
+	// stay as tombstones until Compact purges them
 	void RemoveDocument(int document_id);
 
 	template <typename ExecutionPolicy>
-	void RemoveDocument(ExecutionPolicy policy, int document_id) {
+	void RemoveDocument([[maybe_unused]] ExecutionPolicy policy, int document_id) {
 		static_assert(std::is_same_v<ExecutionPolicy, std::execution::sequenced_policy> || std::is_same_v<ExecutionPolicy, std::execution::parallel_policy>);
-		const auto it = documents_.find(document_id);
-		if (it == documents_.end()) return;
-		std::for_each(
-			policy,
-			it->second.word_to_freq.begin(),
-			it->second.word_to_freq.end(),
-			[this, document_id](const std::pair<std::string_view, double>& pair) {
-				word_to_document_freqs_.at(pair.first).erase(document_id);
-			}
-		);
-		documents_.erase(document_id);
-		document_ids_.erase(document_id);
+		RemoveDocument(document_id);
 	}
 
+	// Removes the documents as RemoveDocument does
+	void RemoveDocuments(const std::vector<int>& document_ids);
+
+	// Removed documents whose postings are still in the index
+	std::size_t GetRemovedDocumentCount() const { return removed_documents_.size(); }
+
+	// Purges the postings of at most max_document_count removed documents, in id order, and
+	// drops the terms left without postings. Returns the number of purged documents. Terms are
+	// ordered and scored by their live postings, so exact results don't change and the generation
+	// stays the same. Once no removed document is left, the strings of the dropped terms are freed
+	// and the maps GetWordFrequencies returned are rebuilt over the remaining ones. Documents a copy
+	// of the server shares get maps of their own, the copy keeps the earlier ones
+	std::size_t Compact(std::size_t max_document_count = std::numeric_limits<std::size_t>::max());
+
 private:
 	struct DocumentData {
+		// Forward index: the words of the document as term ids in ascending order, and their term frequencies
+		std::vector<int> term_ids;
+		std::vector<double> term_freqs;
+		// Built on the first GetWordFrequencies call, the keys point into the term pool
+		mutable std::once_flag word_to_freq_flag;
+		mutable std::map<std::string_view, double> word_to_freq;
+	};
+	// Tokenized document, word views point into its text
+	struct PreparedDocument {
+		std::vector<std::pair<std::string_view, int>> word_counts;
+		int length = 0;
+		bool is_valid = true;
+		std::string_view invalid_word;
+	};
+	struct BatchPosting {
+		int document_id;
+		int count;
+		int document_length;
+	};
+	using PartialIndex = std::unordered_map<std::string_view, std::vector<BatchPosting>>;
+	// Postings of a term gathered from the partial indexes in chunk order
+	struct BatchTerm {
+		int term_id;
+		std::vector<const std::vector<BatchPosting>*> parts;
+	};
+	struct DocumentAttributes {
+		DocumentStatus status;
 		int rating;
+	};
+	// Filter of FindTopDocuments(status), the scans recognize it and read the status alone
+	struct StatusPredicate {
 		DocumentStatus status;
-		std::set<std::string> words;
-		std::map<std::string_view, double> word_to_freq;
+
+		bool operator()(int, DocumentStatus document_status, int) const {
+			return document_status == status;
+		}
+	};
+	// Metadata columns indexed by internal id, read in place from the heap arrays or the snapshot.
+	// Removed documents and free internal ids have NO_DOCUMENT as their external id
+	struct DocumentColumns {
+		const int* external_ids;
+		const int* statuses;
+		const int* ratings;
+	};
+	// Query words looked up in the index once for matching many documents. Words missing from the
+	// index can't match and are dropped
+	struct MatchQuery {
+		std::vector<std::string_view> plus_words;
+		// Term ids of the plus words, in the same order
+		std::vector<int> plus_term_ids;
+		std::vector<int> minus_term_ids;
 	};
 	struct QueryWord {
 		std::string_view data;
@@ -162,9 +438,31 @@ private:
 		std::set<std::string_view> minus_words;
 	};
 	const std::set<std::string, std::less<>> stop_words_;
-	std::map<std::string_view, std::map<int, double>> word_to_document_freqs_;
-	std::map<int, DocumentData> documents_;
-	std::set<int> document_ids_;
+	InvertedIndex index_;
+	// Documents of a server opened from a snapshot stay there until it is modified
+	std::shared_ptr<const IndexSnapshot> snapshot_;
+	// Internal ids of the documents by id
+	DocumentIdIndex document_entries_;
+	// Documents get dense internal ids as they are added. Postings, accumulators and top-k scans
+	// work on internal ids and index the columns below with them, results are translated back to
+	// ids at the end. Documents never change once added, so copies of the server share their data
+	std::vector<int> external_ids_;
+	std::vector<int> document_statuses_;
+	std::vector<int> document_ratings_;
+	std::vector<int> document_lengths_;
+	std::vector<std::shared_ptr<const DocumentData>> documents_;
+	// Internal ids whose postings were purged, handed out again before new ones
+	std::vector<int> free_internal_ids_;
+	// Internal ids of removed documents by id. Queries skip their postings as the external id
+	// column no longer holds them
+	std::map<int, int> removed_documents_;
+	uint64_t generation_;
+	std::shared_ptr<QueryCache> query_cache_;
+	ImpactTableCache impact_tables_;
+	QueryPlannerThresholds planner_thresholds_;
+	QueryPlanObserver plan_observer_;
+
+	explicit SearchServer(std::shared_ptr<const IndexSnapshot> snapshot);
 
 	template <typename Words>
 	static std::set<std::string, std::less<>> GetValidWordsSet(const Words& words) {
@@ -178,80 +476,840 @@ private:
 		return result;
 	}
 
-	static bool IsValidWord(std::string_view word);
+	// Splits the text and checks the words in a single pass
+	static std::set<std::string, std::less<>> GetValidWordsSet(std::string_view text);
+
+	static uint64_t GetNextGeneration();
+
+	// The sets of the query are sorted and free of duplicates, so equal queries get equal keys.
+	// Exact evaluation strategies return the same documents, so only quantized ones are a part of the key
+	static std::string GetQueryCacheKey(const Query& query, DocumentStatus status, const SearchOptions& options);
 
 	static int ComputeAverageRating(const std::vector<int>& ratings);
 
+	// Never throws on invalid words, they are reported in the result
+	PreparedDocument PrepareDocument(std::string_view text) const;
+
+	// Returns the length of the valid prefix of the batch and the exception for the document after it
+	std::size_t CountValidDocuments(const std::vector<DocumentInput>& documents,
+		const std::vector<PreparedDocument>& prepared, std::exception_ptr& error) const;
+
+	static std::size_t GetBatchChunkCount(std::size_t document_count);
+
+	static std::shared_ptr<const DocumentData> MakeDocumentData(const PreparedDocument& prepared,
+		std::vector<int> term_ids);
+
+	std::vector<BatchTerm> RegisterBatchTerms(const std::vector<PartialIndex>& partial_indexes);
+
+	// Ascending internal ids for count new documents, free ones first. The columns grow to hold them
+	std::vector<int> AllocateInternalIds(std::size_t count);
+
+	// Fills the columns of the internal id, the document is not listed among the sorted ids yet
+	void StoreDocumentColumns(int internal_id, int document_id, DocumentStatus status,
+		const std::vector<int>& ratings, int length, std::shared_ptr<const DocumentData> document_data);
+
+	// Inserts the documents listed by order, which is sorted by id, under the internal ids in the same order
+	void StoreBatchDocuments(const std::vector<DocumentInput>& documents, const std::vector<PreparedDocument>& prepared,
+		const std::vector<std::size_t>& order, const std::vector<int>& internal_ids,
+		std::vector<std::shared_ptr<const DocumentData>>& batch_documents);
+
+	static constexpr int NO_DOCUMENT = IndexSnapshot::NO_DOCUMENT;
+
+	// NO_DOCUMENT if the document is absent
+	int FindInternalId(int document_id) const;
+
+	// Throws std::out_of_range if the document is absent
+	int GetInternalId(int document_id) const;
+
+	// Forward index of the document, its term ids in ascending order
+	std::pair<const int*, const int*> GetDocumentTermIds(int internal_id) const;
+
+	// Zero if the document doesn't hold the term
+	double FindDocumentTermFreq(int internal_id, int term_id) const;
+
+	// Internal ids handed out so far, the columns hold this many entries
+	std::size_t GetInternalIdCount() const;
+
+	DocumentColumns GetDocumentColumns() const;
+
+	DocumentAttributes GetDocumentAttributesAt(int internal_id) const {
+		const DocumentColumns columns = GetDocumentColumns();
+		return { static_cast<DocumentStatus>(columns.statuses[internal_id]), columns.ratings[internal_id] };
+	}
+
+	// Tells whether the document with the internal id is present and passes the filter. Status filters
+	// are resolved at compile time and read the status column alone
+	template <typename Predicate>
+	static bool IsAccepted(const Predicate& predicate, const DocumentColumns& columns, int internal_id) {
+		const int document_id = columns.external_ids[internal_id];
+		if (document_id == NO_DOCUMENT) {
+			return false;
+		}
+		if constexpr (std::is_same_v<Predicate, StatusPredicate>) {
+			return columns.statuses[internal_id] == static_cast<int>(predicate.status);
+		}
+		else {
+			return predicate(document_id, static_cast<DocumentStatus>(columns.statuses[internal_id]),
+				columns.ratings[internal_id]);
+		}
+	}
+
+	std::optional<DocumentAttributes> FindDocumentAttributes(int document_id) const;
+
+	DocumentAttributes GetDocumentAttributes(int document_id) const;
+
+	// Purges the postings of a removed document before its id is added again
+	void PurgeRemovedDocument(int document_id);
+
+	// Purges the postings of the removed documents with the internal ids and frees the ids
+	void PurgeInternalIds(const std::vector<int>& internal_ids);
+
+	// Copies the documents of the snapshot to the heap structures
+	void Materialize();
+
 	bool IsStopWord(std::string_view word) const;
 
-	std::vector<std::string_view> SplitIntoWordsNoStop(std::string_view text) const;
+	// Replaces the contents of words with the words of the text that are not stop words. Stops at
+	// the first word holding control characters and returns it, returns an empty view otherwise
+	std::string_view SplitIntoWordsNoStop(std::string_view text, std::vector<std::string_view>& words) const;
 
+	// The word is not empty and holds no control characters
 	QueryWord ParseQueryWord(std::string_view text) const;
 
 	Query ParseQuery(std::string_view text) const;
 
-	double ComputeWordInverseDocumentFreq(std::string_view word) const;
+	// Statistics of the term in O(1), so writes don't pay for the terms they leave untouched
+	TermStatistics GetTermStatistics(int term_id) const;
+
+	// Impacts of the current generation, quantized with a score bound of every term
+	std::shared_ptr<const ImpactTable> GetImpactTable() const;
+
+	// Term ids of the plus words found in the index, rarest first and equally frequent words in word
+	// order. Postings of removed documents are not counted, so compaction keeps the order. Every
+	// evaluation path sums relevance in this order, so their results agree bit for bit
+	std::vector<int> GetPlusTermIds(const Query& query) const;
+
+	QueryPlan PlanQuery(const Query& query, const SearchOptions& options) const;
+
+	template <typename ExecutionPolicy>
+	std::tuple<std::vector<std::string_view>, DocumentStatus> MatchDocument(ExecutionPolicy policy,
+		const Query& query, int document_id) const {
+		const int internal_id = GetInternalId(document_id);
+		return MatchDocumentTerms(policy, ResolveMatchQuery(query), internal_id);
+	}
+
+	MatchQuery ResolveMatchQuery(const Query& query) const;
+
+	// Every term of the query is a binary search in the sorted forward index of the document
+	std::tuple<std::vector<std::string_view>, DocumentStatus> MatchDocumentTerms(std::execution::sequenced_policy,
+		const MatchQuery& query, int internal_id) const;
+
+	// The terms of a long query are looked up in parallel
+	std::tuple<std::vector<std::string_view>, DocumentStatus> MatchDocumentTerms(std::execution::parallel_policy,
+		const MatchQuery& query, int internal_id) const;
+
+	std::vector<std::pair<int, int>> SplitDocumentIdRange(const Query& query) const;
+
+	// Splits the internal ids into ranges holding about the same number of documents, so that a range
+	// accumulates a bounded share of the postings of a query batch
+	std::vector<std::pair<int, int>> SplitQueryBatch(std::size_t posting_count, bool is_parallel) const;
+
+	// Ranges of a query batch evaluated at the same time by a parallel policy
+	static std::size_t GetQueryBatchWaveSize();
+
+	template <typename ExecutionPolicy, typename Predicate>
+	std::vector<Document> FindTopDocuments(ExecutionPolicy policy, const Query& query,
+		Predicate predicate, const SearchOptions& options) const {
+		if (options.mode == QueryMode::CONJUNCTIVE) {
+			return FindTopDocumentsConjunctive(policy, query, predicate, options.max_result_count);
+		}
+		if (IsQuantized(options.strategy)) {
+			return FindTopDocumentsQuantized(query, predicate, options);
+		}
+		if (options.strategy == EvaluationStrategy::MAX_SCORE) {
+			return FindTopDocumentsMaxScore(policy, query, predicate, options.max_result_count);
+		}
+		return SelectTopDocuments(policy, FindAllDocuments(policy, query, predicate), options.max_result_count);
+	}
+
+	template <typename Predicate>
+	std::vector<Document> FindTopDocuments([[maybe_unused]] AdaptiveExecutionPolicy policy, const Query& query,
+		Predicate predicate, const SearchOptions& options) const {
+		const QueryPlan plan = PlanQuery(query, options);
+		if (plan_observer_) {
+			plan_observer_(plan);
+		}
+		if (options.mode == QueryMode::CONJUNCTIVE) {
+			return plan.is_parallel
+				? FindTopDocumentsConjunctive(std::execution::par, query, predicate, options.max_result_count)
+				: FindTopDocumentsConjunctive(std::execution::seq, query, predicate, options.max_result_count);
+		}
+		if (IsQuantized(options.strategy)) {
+			return FindTopDocumentsQuantized(query, predicate, options);
+		}
+		if (options.strategy == EvaluationStrategy::MAX_SCORE) {
+			return plan.is_parallel
+				? FindTopDocumentsMaxScore(std::execution::par, query, predicate, options.max_result_count)
+				: FindTopDocumentsMaxScore(std::execution::seq, query, predicate, options.max_result_count);
+		}
+		if (plan.is_parallel) {
+			return SelectTopDocuments(std::execution::par,
+				FindAllDocuments(std::execution::par, query, predicate, plan.is_minus_first), options.max_result_count);
+		}
+		return SelectTopDocuments(std::execution::seq,
+			FindAllDocuments(std::execution::seq, query, predicate, plan.is_minus_first), options.max_result_count);
+	}
+
+	// Scores the documents with internal ids in [first_id, last_id] using accumulators local to the call
+	// and passes every matched document to consume. With is_minus_first the documents holding minus
+	// words are collected up front and never scored
+	template <typename Predicate, typename Consumer>
+	void FindDocumentsInRange(const Query& query, Predicate predicate, int first_id, int last_id,
+		bool is_minus_first, Consumer consume) const {
+		struct TermSlice {
+			PostingCursor cursor;
+			double inverse_document_freq;
+		};
+		std::vector<TermSlice> plus_slices;
+		std::size_t posting_count = 0;
+		int min_id = last_id;
+		int max_id = first_id;
+		for (const int term_id : GetPlusTermIds(query)) {
+			const PostingListView postings = index_.GetPostings(term_id);
+			PostingCursor cursor(postings, first_id, last_id);
+			if (cursor.IsAtEnd()) {
+				continue;
+			}
+			posting_count += postings.CountInRange(first_id, last_id);
+			min_id = std::min(min_id, cursor.GetDocumentId());
+			max_id = std::max(max_id, std::min(last_id, postings.GetLastDocumentId()));
+			plus_slices.push_back({ std::move(cursor), GetTermStatistics(term_id).inverse_document_freq });
+		}
+		if (plus_slices.empty()) {
+			return;
+		}
+
+		RelevanceAccumulator document_to_relevance(min_id, max_id, posting_count);
+		const auto for_each_minus_posting = [this, &query, min_id, max_id](auto function) {
+			for (const std::string_view word : query.minus_words) {
+				const int term_id = index_.FindTermId(word);
+				if (term_id == InvertedIndex::NO_TERM) {
+					continue;
+				}
+				for (PostingCursor cursor(index_.GetPostings(term_id), min_id, max_id); !cursor.IsAtEnd(); cursor.Next()) {
+					function(cursor.GetDocumentId());
+				}
+			}
+		};
+		// Hash table accumulators pay more for the exclusions than the skipped lookups save
+		is_minus_first = is_minus_first && document_to_relevance.IsDense();
+		if (is_minus_first) {
+			for_each_minus_posting([&document_to_relevance](int document_id) {
+				document_to_relevance.Exclude(document_id);
+			});
+		}
+
+		const DocumentColumns columns = GetDocumentColumns();
+		for (TermSlice& slice : plus_slices) {
+			for (PostingCursor& cursor = slice.cursor; !cursor.IsAtEnd(); cursor.Next()) {
+				const int internal_id = cursor.GetDocumentId();
+				if (is_minus_first && document_to_relevance.IsExcluded(internal_id)) {
+					continue;
+				}
+				if (IsAccepted(predicate, columns, internal_id)) {
+					document_to_relevance.Add(internal_id, cursor.GetTermFreq() * slice.inverse_document_freq);
+				}
+			}
+		}
+
+		if (!is_minus_first) {
+			for_each_minus_posting([&document_to_relevance](int document_id) {
+				document_to_relevance.Erase(document_id);
+			});
+		}
+
+		document_to_relevance.ForEach([&columns, &consume](int internal_id, double relevance) {
+			consume(Document{ columns.external_ids[internal_id], relevance, columns.ratings[internal_id] });
+		});
+	}
+
+	template <typename Predicate>
+	std::vector<Document> FindAllDocuments([[maybe_unused]] std::execution::sequenced_policy, const Query& query,
+		Predicate predicate, bool is_minus_first = false) const {
+		std::vector<Document> matched_documents;
+		FindDocumentsInRange(query, predicate, 0, std::numeric_limits<int>::max(), is_minus_first,
+			[&matched_documents](const Document& document) { matched_documents.push_back(document); });
+		return matched_documents;
+	}
+
+	// Every shard owns a disjoint range of internal ids, so shards never touch each other's accumulators
+	template <typename Predicate>
+	std::vector<Document> FindAllDocuments(std::execution::parallel_policy policy, const Query& query,
+		Predicate predicate, bool is_minus_first = false) const {
+		const std::vector<std::pair<int, int>> id_ranges = SplitDocumentIdRange(query);
+		if (id_ranges.size() == 1) {
+			return FindAllDocuments(std::execution::seq, query, predicate, is_minus_first);
+		}
+
+		std::vector<std::vector<Document>> shard_documents(id_ranges.size());
+		std::vector<std::size_t> shards(id_ranges.size());
+		std::iota(shards.begin(), shards.end(), 0);
+		std::for_each(policy, shards.begin(), shards.end(),
+			[this, &query, predicate, is_minus_first, &id_ranges, &shard_documents](std::size_t shard) {
+				std::vector<Document>& documents = shard_documents[shard];
+				FindDocumentsInRange(query, predicate, id_ranges[shard].first, id_ranges[shard].second,
+					is_minus_first, [&documents](const Document& document) { documents.push_back(document); });
+			}
+		);
+
+		std::vector<Document> matched_documents;
+		for (const std::vector<Document>& documents : shard_documents) {
+			matched_documents.insert(matched_documents.end(), documents.begin(), documents.end());
+		}
+		return matched_documents;
+	}
+
+	// Scores the documents as FindAllDocuments does, but keeps only the limit best of those ranked
+	// after the cursor in a heap instead of collecting every match
+	template <typename Predicate>
+	ResultPage FindTopDocumentsPage([[maybe_unused]] std::execution::sequenced_policy, const Query& query,
+		Predicate predicate, std::size_t limit, const std::optional<SearchCursor>& after) const {
+		TopDocuments top_documents(limit);
+		if (limit > 0) {
+			FindPageDocumentsInRange(query, predicate, 0, std::numeric_limits<int>::max(), after, top_documents);
+		}
+		return MakeResultPage(std::move(top_documents).Extract(), limit);
+	}
+
+	template <typename Predicate>
+	ResultPage FindTopDocumentsPage(std::execution::parallel_policy policy, const Query& query,
+		Predicate predicate, std::size_t limit, const std::optional<SearchCursor>& after) const {
+		const std::vector<std::pair<int, int>> id_ranges = SplitDocumentIdRange(query);
+		if (id_ranges.size() == 1 || limit == 0) {
+			return FindTopDocumentsPage(std::execution::seq, query, predicate, limit, after);
+		}
+
+		std::vector<TopDocuments> shard_tops(id_ranges.size(), TopDocuments(limit));
+		std::vector<std::size_t> shards(id_ranges.size());
+		std::iota(shards.begin(), shards.end(), 0);
+		std::for_each(policy, shards.begin(), shards.end(),
+			[this, &query, predicate, &after, &id_ranges, &shard_tops](std::size_t shard) {
+				FindPageDocumentsInRange(query, predicate, id_ranges[shard].first, id_ranges[shard].second,
+					after, shard_tops[shard]);
+			}
+		);
+
+		TopDocuments top_documents(limit);
+		for (const TopDocuments& shard_top : shard_tops) {
+			top_documents.Merge(shard_top);
+		}
+		return MakeResultPage(std::move(top_documents).Extract(), limit);
+	}
+
+	template <typename Predicate>
+	void FindPageDocumentsInRange(const Query& query, Predicate predicate, int first_id, int last_id,
+		const std::optional<SearchCursor>& after, TopDocuments& top_documents) const {
+		if (!after) {
+			FindDocumentsInRange(query, predicate, first_id, last_id, false,
+				[&top_documents](const Document& document) { top_documents.Add(document); });
+			return;
+		}
+		const Document last_document(after->document_id, after->relevance, after->rating);
+		FindDocumentsInRange(query, predicate, first_id, last_id, false,
+			[&top_documents, &last_document](const Document& document) {
+				if (IsMoreRelevant(last_document, document)) {
+					top_documents.Add(document);
+				}
+			}
+		);
+	}
+
+	static ResultPage MakeResultPage(std::vector<Document> documents, std::size_t limit);
 
-	std::vector<Document> GetMatchedWords(const std::map<int, double>& document_to_relevance) const;
+	// Postings of a term and the indexes of the batch queries containing it
+	struct BatchQueryTerm {
+		int term_id;
+		double inverse_document_freq;
+		std::vector<std::size_t> queries;
+	};
+
+	template <typename ExecutionPolicy, typename Predicate>
+	std::vector<std::vector<Document>> FindTopDocumentsBatch(ExecutionPolicy policy,
+		const std::vector<const Query*>& queries, Predicate predicate, std::size_t max_result_count) const {
+		// Terms go rarest first and in word order among equally frequent terms, which is the
+		// order GetPlusTermIds gives every query, so every relevance is summed as FindTopDocuments sums it
+		std::map<std::string_view, std::vector<std::size_t>> plus_word_queries;
+		std::map<std::string_view, std::vector<std::size_t>> minus_word_queries;
+		for (std::size_t i = 0; i < queries.size(); ++i) {
+			for (const std::string_view word : queries[i]->plus_words) {
+				plus_word_queries[word].push_back(i);
+			}
+			for (const std::string_view word : queries[i]->minus_words) {
+				minus_word_queries[word].push_back(i);
+			}
+		}
+		std::size_t posting_count = 0;
+		std::vector<BatchQueryTerm> plus_terms;
+		for (auto& [word, term_queries] : plus_word_queries) {
+			const int term_id = index_.FindTermId(word);
+			if (term_id != InvertedIndex::NO_TERM) {
+				posting_count += index_.GetPostings(term_id).size() * term_queries.size();
+				plus_terms.push_back({ term_id, GetTermStatistics(term_id).inverse_document_freq, std::move(term_queries) });
+			}
+		}
+		std::stable_sort(plus_terms.begin(), plus_terms.end(), [this](const BatchQueryTerm& lhs, const BatchQueryTerm& rhs) {
+			return index_.GetLivePostingCount(lhs.term_id) < index_.GetLivePostingCount(rhs.term_id);
+		});
+		std::vector<BatchQueryTerm> minus_terms;
+		for (auto& [word, term_queries] : minus_word_queries) {
+			const int term_id = index_.FindTermId(word);
+			if (term_id != InvertedIndex::NO_TERM) {
+				minus_terms.push_back({ term_id, 0.0, std::move(term_queries) });
+			}
+		}
 
+		std::vector<TopDocuments> top_documents(queries.size(), TopDocuments(max_result_count));
+		if (!plus_terms.empty() && max_result_count > 0) {
+			constexpr bool is_parallel = std::is_same_v<ExecutionPolicy, std::execution::parallel_policy>;
+			const std::vector<std::pair<int, int>> id_ranges = SplitQueryBatch(posting_count, is_parallel);
+			const std::size_t wave_size = is_parallel ? GetQueryBatchWaveSize() : 1;
+			// Ranges go in waves, so only a wave of accumulators is alive at a time
+			for (std::size_t first_range = 0; first_range < id_ranges.size(); first_range += wave_size) {
+				std::vector<std::size_t> ranges(std::min(wave_size, id_ranges.size() - first_range));
+				std::iota(ranges.begin(), ranges.end(), first_range);
+				std::vector<std::vector<TopDocuments>> range_tops(ranges.size());
+				std::for_each(policy, ranges.begin(), ranges.end(),
+					[this, &plus_terms, &minus_terms, &queries, predicate, max_result_count, &id_ranges, &range_tops, first_range](std::size_t range) {
+						range_tops[range - first_range] = FindBatchTopDocumentsInRange(plus_terms, minus_terms, queries.size(),
+							predicate, max_result_count, id_ranges[range].first, id_ranges[range].second);
+					}
+				);
+				for (const std::vector<TopDocuments>& tops : range_tops) {
+					for (std::size_t i = 0; i < queries.size(); ++i) {
+						top_documents[i].Merge(tops[i]);
+					}
+				}
+			}
+		}
+
+		std::vector<std::vector<Document>> results;
+		results.reserve(queries.size());
+		for (TopDocuments& top : top_documents) {
+			results.push_back(std::move(top).Extract());
+		}
+		return results;
+	}
+
+	// Every posting of the range is looked up once and scored for all the queries of its term
 	template <typename Predicate>
-	std::vector<Document> FindAllDocuments([[maybe_unused]] std::execution::sequenced_policy, const Query& query, Predicate predicate) const {
-		std::map<int, double> document_to_relevance;
-		for (const std::string_view word : query.plus_words) {
-			if (word_to_document_freqs_.count(word) == 0) {
+	std::vector<TopDocuments> FindBatchTopDocumentsInRange(const std::vector<BatchQueryTerm>& plus_terms,
+		const std::vector<BatchQueryTerm>& minus_terms, std::size_t query_count, Predicate predicate,
+		std::size_t max_result_count, int first_id, int last_id) const {
+		std::vector<std::size_t> posting_counts(query_count);
+		std::vector<int> min_ids(query_count, last_id);
+		std::vector<int> max_ids(query_count, first_id);
+		std::vector<PostingCursor> cursors;
+		cursors.reserve(plus_terms.size());
+		for (const BatchQueryTerm& term : plus_terms) {
+			const PostingListView postings = index_.GetPostings(term.term_id);
+			PostingCursor& cursor = cursors.emplace_back(postings, first_id, last_id);
+			if (cursor.IsAtEnd()) {
 				continue;
 			}
-			const double inverse_document_freq = ComputeWordInverseDocumentFreq(word);
-			for (const auto [document_id, term_freq] :
-				word_to_document_freqs_.at(word)) {
-				const DocumentData& doc = documents_.at(document_id);
-				if (predicate(document_id, doc.status, doc.rating)) {
-					document_to_relevance[document_id] +=
-						term_freq * inverse_document_freq;
+			const std::size_t count = postings.CountInRange(first_id, last_id);
+			const int term_min_id = cursor.GetDocumentId();
+			const int term_max_id = std::min(last_id, postings.GetLastDocumentId());
+			for (const std::size_t i : term.queries) {
+				posting_counts[i] += count;
+				min_ids[i] = std::min(min_ids[i], term_min_id);
+				max_ids[i] = std::max(max_ids[i], term_max_id);
+			}
+		}
+		std::vector<std::optional<RelevanceAccumulator>> accumulators(query_count);
+		for (std::size_t i = 0; i < query_count; ++i) {
+			if (posting_counts[i] > 0) {
+				accumulators[i].emplace(min_ids[i], max_ids[i], posting_counts[i]);
+			}
+		}
+
+		const DocumentColumns columns = GetDocumentColumns();
+		for (std::size_t t = 0; t < plus_terms.size(); ++t) {
+			for (PostingCursor& cursor = cursors[t]; !cursor.IsAtEnd(); cursor.Next()) {
+				const int internal_id = cursor.GetDocumentId();
+				if (!IsAccepted(predicate, columns, internal_id)) {
+					continue;
+				}
+				const double relevance = cursor.GetTermFreq() * plus_terms[t].inverse_document_freq;
+				for (const std::size_t i : plus_terms[t].queries) {
+					accumulators[i]->Add(internal_id, relevance);
 				}
 			}
 		}
+		for (const BatchQueryTerm& term : minus_terms) {
+			for (PostingCursor cursor(index_.GetPostings(term.term_id), first_id, last_id); !cursor.IsAtEnd(); cursor.Next()) {
+				const int document_id = cursor.GetDocumentId();
+				for (const std::size_t i : term.queries) {
+					if (accumulators[i] && min_ids[i] <= document_id && document_id <= max_ids[i]) {
+						accumulators[i]->Erase(document_id);
+					}
+				}
+			}
+		}
+
+		std::vector<TopDocuments> top_documents(query_count, TopDocuments(max_result_count));
+		for (std::size_t i = 0; i < query_count; ++i) {
+			if (accumulators[i]) {
+				accumulators[i]->ForEach([&columns, &top_documents, i](int internal_id, double relevance) {
+					top_documents[i].Add({ columns.external_ids[internal_id], relevance, columns.ratings[internal_id] });
+				});
+			}
+		}
+		return top_documents;
+	}
 
+	// MaxScore: terms are ordered by their score upper bound, and the longest prefix whose bounds
+	// sum below the current top-k threshold is only probed for documents found by the other terms
+	template <typename Predicate>
+	void FindTopDocumentsInRangeMaxScore(const Query& query, Predicate predicate, int first_id, int last_id,
+		TopDocuments& top_documents) const {
+		struct ScoredTerm {
+			PostingCursor cursor;
+			double inverse_document_freq;
+			double max_score;
+			std::size_t query_index;
+		};
+		std::vector<ScoredTerm> terms;
+		for (const int term_id : GetPlusTermIds(query)) {
+			const PostingListView postings = index_.GetPostings(term_id);
+			PostingCursor cursor(postings, first_id, last_id);
+			if (cursor.IsAtEnd()) {
+				continue;
+			}
+			const TermStatistics statistics = GetTermStatistics(term_id);
+			terms.push_back({ std::move(cursor), statistics.inverse_document_freq, statistics.max_score, terms.size() });
+		}
+		if (terms.empty()) {
+			return;
+		}
+		std::vector<PostingCursor> minus_cursors;
 		for (const std::string_view word : query.minus_words) {
-			if (word_to_document_freqs_.count(word) == 0) {
+			const int term_id = index_.FindTermId(word);
+			if (term_id == InvertedIndex::NO_TERM) {
 				continue;
 			}
-			for (const auto [document_id, _] : word_to_document_freqs_.at(word)) {
-				document_to_relevance.erase(document_id);
+			minus_cursors.emplace_back(index_.GetPostings(term_id), first_id, last_id);
+		}
+
+		// Relevance is summed in the order of GetPlusTermIds afterwards, so it matches the exhaustive
+		// path bit for bit
+		std::vector<double> term_scores(terms.size());
+		std::vector<char> is_term_matched(terms.size());
+		std::sort(terms.begin(), terms.end(), [](const ScoredTerm& lhs, const ScoredTerm& rhs) {
+			return lhs.max_score < rhs.max_score;
+		});
+		std::vector<double> max_score_prefix_sums(terms.size());
+		std::transform_inclusive_scan(terms.begin(), terms.end(), max_score_prefix_sums.begin(), std::plus<>{},
+			[](const ScoredTerm& term) { return term.max_score; });
+		double threshold = -std::numeric_limits<double>::infinity();
+		std::size_t first_essential = 0;
+		const DocumentColumns columns = GetDocumentColumns();
+
+		while (true) {
+			int internal_id = std::numeric_limits<int>::max();
+			bool has_candidate = false;
+			for (std::size_t i = first_essential; i < terms.size(); ++i) {
+				if (!terms[i].cursor.IsAtEnd()) {
+					internal_id = std::min(internal_id, terms[i].cursor.GetDocumentId());
+					has_candidate = true;
+				}
+			}
+			if (!has_candidate) {
+				break;
+			}
+
+			std::fill(is_term_matched.begin(), is_term_matched.end(), false);
+			double score_bound = first_essential == 0 ? 0.0 : max_score_prefix_sums[first_essential - 1];
+			for (std::size_t i = first_essential; i < terms.size(); ++i) {
+				PostingCursor& cursor = terms[i].cursor;
+				if (!cursor.IsAtEnd() && cursor.GetDocumentId() == internal_id) {
+					const double score = cursor.GetTermFreq() * terms[i].inverse_document_freq;
+					term_scores[terms[i].query_index] = score;
+					is_term_matched[terms[i].query_index] = true;
+					score_bound += score;
+					cursor.Next();
+				}
+			}
+			for (std::size_t i = first_essential; i > 0 && score_bound >= threshold; --i) {
+				ScoredTerm& term = terms[i - 1];
+				score_bound -= term.max_score;
+				if (term.cursor.SkipTo(internal_id) && term.cursor.GetDocumentId() == internal_id) {
+					const double score = term.cursor.GetTermFreq() * term.inverse_document_freq;
+					term_scores[term.query_index] = score;
+					is_term_matched[term.query_index] = true;
+					score_bound += score;
+				}
+			}
+			if (score_bound < threshold) {
+				continue;
+			}
+
+			if (!IsAccepted(predicate, columns, internal_id)) {
+				continue;
+			}
+			const bool has_minus_word = std::any_of(minus_cursors.begin(), minus_cursors.end(),
+				[internal_id](PostingCursor& cursor) {
+					return cursor.SkipTo(internal_id) && cursor.GetDocumentId() == internal_id;
+				});
+			if (has_minus_word) {
+				continue;
+			}
+
+			double relevance = 0.0;
+			for (std::size_t i = 0; i < term_scores.size(); ++i) {
+				if (is_term_matched[i]) {
+					relevance += term_scores[i];
+				}
+			}
+			top_documents.Add({ columns.external_ids[internal_id], relevance, columns.ratings[internal_id] });
+			if (top_documents.IsFull()) {
+				// Near ties are decided by rating, the extra epsilon absorbs rounding of the bounds
+				threshold = top_documents.GetLeastRelevant().relevance - 2 * RELEVANCE_EPSILON;
+				while (first_essential < terms.size() && max_score_prefix_sums[first_essential] < threshold) {
+					++first_essential;
+				}
 			}
 		}
+	}
+
+	template <typename Predicate>
+	std::vector<Document> FindTopDocumentsMaxScore([[maybe_unused]] std::execution::sequenced_policy,
+		const Query& query, Predicate predicate, std::size_t max_result_count) const {
+		TopDocuments top_documents(max_result_count);
+		if (max_result_count > 0) {
+			FindTopDocumentsInRangeMaxScore(query, predicate, 0, std::numeric_limits<int>::max(), top_documents);
+		}
+		return std::move(top_documents).Extract();
+	}
+
+	template <typename Predicate>
+	std::vector<Document> FindTopDocumentsMaxScore(std::execution::parallel_policy policy,
+		const Query& query, Predicate predicate, std::size_t max_result_count) const {
+		const std::vector<std::pair<int, int>> id_ranges = SplitDocumentIdRange(query);
+		if (id_ranges.size() == 1 || max_result_count == 0) {
+			return FindTopDocumentsMaxScore(std::execution::seq, query, predicate, max_result_count);
+		}
+
+		std::vector<TopDocuments> shard_tops(id_ranges.size(), TopDocuments(max_result_count));
+		std::vector<std::size_t> shards(id_ranges.size());
+		std::iota(shards.begin(), shards.end(), 0);
+		std::for_each(policy, shards.begin(), shards.end(),
+			[this, &query, predicate, &id_ranges, &shard_tops](std::size_t shard) {
+				FindTopDocumentsInRangeMaxScore(query, predicate, id_ranges[shard].first, id_ranges[shard].second,
+					shard_tops[shard]);
+			}
+		);
 
-		return GetMatchedWords(document_to_relevance);
+		TopDocuments top_documents(max_result_count);
+		for (const TopDocuments& shard_top : shard_tops) {
+			top_documents.Merge(shard_top);
+		}
+		return std::move(top_documents).Extract();
 	}
 
+	// Quantized impacts of the plus words are summed into 16-bit scores. IMPACT_ORDERED takes the
+	// segments of the highest impact first. Once the impacts left can't lift an unseen document
+	// above the max_result_count-th score, it stops as soon as rescoring the documents they still
+	// can lift costs less than the postings left. Those documents are rescored exactly in the order
+	// of GetPlusTermIds, so their relevance matches the exhaustive path
 	template <typename Predicate>
-	std::vector<Document> FindAllDocuments(std::execution::parallel_policy policy, const Query& query, Predicate predicate) const {
-		ConcurrentMap<int, double> document_to_relevance;
-		std::for_each(policy, query.plus_words.begin(), query.plus_words.end(),
-			[this, predicate, &document_to_relevance](const std::string_view word) {
-				if (word_to_document_freqs_.count(word)) {
-					const double inverse_document_freq = ComputeWordInverseDocumentFreq(word);
-					for (const auto [document_id, term_freq] : word_to_document_freqs_.at(word)) {
-						const DocumentData& doc = documents_.at(document_id);
-						if (predicate(document_id, doc.status, doc.rating)) {
-							document_to_relevance[document_id].ref_to_value +=
-								term_freq * inverse_document_freq;
-						}
+	std::vector<Document> FindTopDocumentsQuantized(const Query& query, Predicate predicate,
+		const SearchOptions& options) const {
+		const std::vector<int> term_ids = GetPlusTermIds(query);
+		if (term_ids.size() > ImpactAccumulator::MAX_TERM_COUNT) {
+			return FindTopDocuments(std::execution::seq, query, predicate, SearchOptions(options.max_result_count));
+		}
+		TopDocuments top_documents(options.max_result_count);
+		if (term_ids.empty() || options.max_result_count == 0) {
+			return std::move(top_documents).Extract();
+		}
+		const std::shared_ptr<const ImpactTable> impact_table = GetImpactTable();
+		std::vector<const TermImpacts*> terms;
+		std::vector<double> inverse_document_freqs;
+		for (const int term_id : term_ids) {
+			inverse_document_freqs.push_back(GetTermStatistics(term_id).inverse_document_freq);
+			terms.push_back(&impact_table->GetTermImpacts(term_id, index_.GetPostings(term_id),
+				inverse_document_freqs.back()));
+		}
+
+		ImpactAccumulator accumulator(GetInternalIdCount(), terms.size(), options.max_result_count);
+		for (const std::string_view word : query.minus_words) {
+			const int term_id = index_.FindTermId(word);
+			if (term_id == InvertedIndex::NO_TERM) {
+				continue;
+			}
+			for (PostingCursor cursor(index_.GetPostings(term_id)); !cursor.IsAtEnd(); cursor.Next()) {
+				accumulator.Reject(cursor.GetDocumentId());
+			}
+		}
+		const DocumentColumns columns = GetDocumentColumns();
+		const auto score_segment = [&predicate, &columns, &accumulator](const TermImpacts& term, std::size_t segment) {
+			const uint8_t impact = term.segment_impacts[segment];
+			for (uint32_t i = term.segment_begins[segment]; i < term.segment_begins[segment + 1]; ++i) {
+				const int internal_id = term.document_ids[i];
+				if (!accumulator.IsSeen(internal_id)) {
+					if (IsAccepted(predicate, columns, internal_id)) {
+						accumulator.Accept(internal_id);
+					}
+					else {
+						accumulator.Reject(internal_id);
 					}
 				}
+				accumulator.Add(internal_id, impact);
 			}
-		);
+		};
 
-		std::for_each(policy, query.minus_words.begin(), query.minus_words.end(),
-			[this, &document_to_relevance](const std::string_view word) {
-				if (word_to_document_freqs_.count(word)) {
-					for (const auto [document_id, _] : word_to_document_freqs_.at(word)) {
-						document_to_relevance.Erase(document_id);
+		// Sum of the impacts of the segments up next, no unscored posting adds more to a document
+		int remaining_impact = 0;
+		if (options.strategy == EvaluationStrategy::IMPACT_ORDERED) {
+			std::vector<std::size_t> segments(terms.size());
+			std::size_t remaining_posting_count = 0;
+			for (const TermImpacts* term : terms) {
+				remaining_impact += term->segment_impacts.front();
+				remaining_posting_count += term->document_ids.size();
+			}
+			const auto is_done = [&]() {
+				const int threshold = accumulator.GetThreshold();
+				return accumulator.IsFull() && remaining_impact <= threshold
+					&& accumulator.CountAtLeast(static_cast<uint16_t>(threshold - remaining_impact))
+						* POSTINGS_PER_RESCORED_DOCUMENT <= remaining_posting_count;
+			};
+			while (!is_done()) {
+				std::size_t best = terms.size();
+				for (std::size_t t = 0; t < terms.size(); ++t) {
+					if (segments[t] < terms[t]->segment_impacts.size()
+						&& (best == terms.size() || terms[t]->segment_impacts[segments[t]] > terms[best]->segment_impacts[segments[best]])) {
+						best = t;
 					}
 				}
+				if (best == terms.size()) {
+					break;
+				}
+				const TermImpacts& term = *terms[best];
+				score_segment(term, segments[best]);
+				remaining_impact -= term.segment_impacts[segments[best]];
+				remaining_posting_count -= term.segment_begins[segments[best] + 1] - term.segment_begins[segments[best]];
+				if (++segments[best] < term.segment_impacts.size()) {
+					remaining_impact += term.segment_impacts[segments[best]];
+				}
+			}
+		}
+		else {
+			for (const TermImpacts* term : terms) {
+				for (std::size_t segment = 0; segment < term->segment_impacts.size(); ++segment) {
+					score_segment(*term, segment);
+				}
+			}
+		}
+
+		const int threshold = accumulator.GetThreshold();
+		std::vector<int> candidates;
+		accumulator.CollectCandidates(static_cast<uint16_t>(std::max(threshold - remaining_impact, 0)), candidates);
+		for (const int internal_id : candidates) {
+			double relevance = 0.0;
+			for (std::size_t t = 0; t < term_ids.size(); ++t) {
+				relevance += FindDocumentTermFreq(internal_id, term_ids[t]) * inverse_document_freqs[t];
+			}
+			top_documents.Add({ columns.external_ids[internal_id], relevance, columns.ratings[internal_id] });
+		}
+		return std::move(top_documents).Extract();
+	}
+
+	// Documents holding every plus word: the ids of the rarest word are intersected with the posting
+	// lists of the others in turn, and only the documents left are looked up and scored
+	template <typename Predicate>
+	void FindTopDocumentsInRangeConjunctive(const Query& query, Predicate predicate, int first_id, int last_id,
+		TopDocuments& top_documents) const {
+		const std::vector<int> term_ids = GetPlusTermIds(query);
+		// A plus word missing from the index leaves no document
+		if (term_ids.empty() || term_ids.size() < query.plus_words.size()) {
+			return;
+		}
+		std::vector<int> internal_ids;
+		for (PostingCursor cursor(index_.GetPostings(term_ids[0]), first_id, last_id); !cursor.IsAtEnd(); cursor.Next()) {
+			internal_ids.push_back(cursor.GetDocumentId());
+		}
+		std::vector<int> buffer;
+		for (std::size_t t = 1; t < term_ids.size() && !internal_ids.empty(); ++t) {
+			IntersectWithPostings(index_.GetPostings(term_ids[t]), internal_ids, buffer);
+		}
+		std::vector<int> excluded_ids;
+		for (const std::string_view word : query.minus_words) {
+			const int term_id = index_.FindTermId(word);
+			if (term_id == InvertedIndex::NO_TERM || internal_ids.empty()) {
+				continue;
+			}
+			excluded_ids = internal_ids;
+			IntersectWithPostings(index_.GetPostings(term_id), excluded_ids, buffer);
+			buffer.clear();
+			std::set_difference(internal_ids.begin(), internal_ids.end(), excluded_ids.begin(), excluded_ids.end(),
+				std::back_inserter(buffer));
+			internal_ids.swap(buffer);
+		}
+
+		std::vector<PostingCursor> cursors;
+		std::vector<double> inverse_document_freqs;
+		cursors.reserve(term_ids.size());
+		for (const int term_id : term_ids) {
+			cursors.emplace_back(index_.GetPostings(term_id), first_id, last_id);
+			inverse_document_freqs.push_back(GetTermStatistics(term_id).inverse_document_freq);
+		}
+		const DocumentColumns columns = GetDocumentColumns();
+		for (const int internal_id : internal_ids) {
+			if (!IsAccepted(predicate, columns, internal_id)) {
+				continue;
+			}
+			// Summed in the order of GetPlusTermIds, as the disjunctive paths sum it
+			double relevance = 0.0;
+			for (std::size_t t = 0; t < term_ids.size(); ++t) {
+				cursors[t].SkipTo(internal_id);
+				relevance += cursors[t].GetTermFreq() * inverse_document_freqs[t];
+			}
+			top_documents.Add({ columns.external_ids[internal_id], relevance, columns.ratings[internal_id] });
+		}
+	}
+
+	template <typename Predicate>
+	std::vector<Document> FindTopDocumentsConjunctive([[maybe_unused]] std::execution::sequenced_policy,
+		const Query& query, Predicate predicate, std::size_t max_result_count) const {
+		TopDocuments top_documents(max_result_count);
+		if (max_result_count > 0) {
+			FindTopDocumentsInRangeConjunctive(query, predicate, 0, std::numeric_limits<int>::max(), top_documents);
+		}
+		return std::move(top_documents).Extract();
+	}
+
+	template <typename Predicate>
+	std::vector<Document> FindTopDocumentsConjunctive(std::execution::parallel_policy policy,
+		const Query& query, Predicate predicate, std::size_t max_result_count) const {
+		const std::vector<std::pair<int, int>> id_ranges = SplitDocumentIdRange(query);
+		if (id_ranges.size() == 1 || max_result_count == 0) {
+			return FindTopDocumentsConjunctive(std::execution::seq, query, predicate, max_result_count);
+		}
+
+		std::vector<TopDocuments> shard_tops(id_ranges.size(), TopDocuments(max_result_count));
+		std::vector<std::size_t> shards(id_ranges.size());
+		std::iota(shards.begin(), shards.end(), 0);
+		std::for_each(policy, shards.begin(), shards.end(),
+			[this, &query, predicate, &id_ranges, &shard_tops](std::size_t shard) {
+				FindTopDocumentsInRangeConjunctive(query, predicate, id_ranges[shard].first, id_ranges[shard].second,
+					shard_tops[shard]);
 			}
 		);
 
-		return GetMatchedWords(document_to_relevance.BuildOrdinaryMap());
+		TopDocuments top_documents(max_result_count);
+		for (const TopDocuments& shard_top : shard_tops) {
+			top_documents.Merge(shard_top);
+		}
+		return std::move(top_documents).Extract();
 	}
 };
@@ -0,0 +1,959 @@
+#include "concurrent_map.h"
+#include "inverted_index.h"
+#include "log_duration.h"
+#include "posting_cursor.h"
+#include "posting_intersection.h"
+#include "process_queries.h"
+#include "remove_duplicates.h"
+#include "search_server.h"
+#include "search_server_bench_suite.h"
+#include "string_processing.h"
+#include "versioned_search_server.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <cstdint>
+#include <execution>
+#include <filesystem>
+#include <iostream>
+#include <map>
+#include <mutex>
+#include <optional>
+#include <random>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <vector>
+
+using namespace std;
+
+namespace {
+
+const int DOCUMENT_COUNT = 200'000;
+const int WORDS_PER_DOCUMENT = 20;
+const int VOCABULARY_SIZE = 20'000;
+const int QUERY_WORD_COUNT = 2'000;
+const int CONCURRENT_ADDS_PER_THREAD = 1'000'000;
+const int QUERY_COUNT = 1'000;
+const int WORDS_PER_QUERY = 4;
+
+vector<string> GenerateVocabulary(int size) {
+	vector<string> words;
+	words.reserve(size);
+	for (int i = 0; i < size; ++i) {
+		words.push_back("word"s + to_string(i));
+	}
+	return words;
+}
+
+// Skewed towards the beginning of the vocabulary, so a few terms get very long posting lists
+int PickWord(mt19937& generator, int vocabulary_size) {
+	uniform_real_distribution<double> distribution(0.0, 1.0);
+	const double u = distribution(generator);
+	return static_cast<int>(vocabulary_size * u * u * u);
+}
+
+// Counts the bytes a container requests, so node based layouts can be compared with flat ones
+size_t allocated_bytes = 0;
+
+template <typename T>
+struct CountingAllocator {
+	using value_type = T;
+
+	CountingAllocator() = default;
+
+	template <typename U>
+	CountingAllocator(const CountingAllocator<U>&) {}
+
+	T* allocate(size_t n) {
+		allocated_bytes += n * sizeof(T);
+		return allocator<T>().allocate(n);
+	}
+
+	void deallocate(T* p, size_t n) {
+		allocated_bytes -= n * sizeof(T);
+		allocator<T>().deallocate(p, n);
+	}
+
+	template <typename U>
+	bool operator==(const CountingAllocator<U>&) const { return true; }
+
+	template <typename U>
+	bool operator!=(const CountingAllocator<U>&) const { return false; }
+};
+
+using DocumentFreqs = map<int, double, less<int>, CountingAllocator<pair<const int, double>>>;
+
+double ScanPostings(const InvertedIndex& index, const vector<string_view>& query_words) {
+	double checksum = 0.0;
+	for (const string_view word : query_words) {
+		const int term_id = index.FindTermId(word);
+		if (term_id == InvertedIndex::NO_TERM) {
+			continue;
+		}
+		for (PostingCursor cursor(index.GetPostings(term_id)); !cursor.IsAtEnd(); cursor.Next()) {
+			checksum += cursor.GetTermFreq() * (cursor.GetDocumentId() & 1);
+		}
+	}
+	return checksum;
+}
+
+void BenchmarkPostingScan() {
+	const vector<string> vocabulary = GenerateVocabulary(VOCABULARY_SIZE);
+	mt19937 generator(42);
+
+	map<string_view, DocumentFreqs> word_to_document_freqs;
+	InvertedIndex flat_index(IndexMode::FLAT);
+	InvertedIndex compressed_index(IndexMode::COMPRESSED);
+	for (int document_id = 0; document_id < DOCUMENT_COUNT; ++document_id) {
+		map<string_view, int> word_to_count;
+		for (int i = 0; i < WORDS_PER_DOCUMENT; ++i) {
+			++word_to_count[vocabulary[PickWord(generator, VOCABULARY_SIZE)]];
+		}
+		for (const auto [word, count] : word_to_count) {
+			word_to_document_freqs[word][document_id] = ComputeTermFreq(count, WORDS_PER_DOCUMENT);
+			flat_index.AddPosting(flat_index.AddTerm(word), document_id, count, WORDS_PER_DOCUMENT);
+			compressed_index.AddPosting(compressed_index.AddTerm(word), document_id, count, WORDS_PER_DOCUMENT);
+		}
+	}
+
+	vector<string_view> query_words;
+	for (int i = 0; i < QUERY_WORD_COUNT; ++i) {
+		query_words.push_back(vocabulary[PickWord(generator, VOCABULARY_SIZE)]);
+	}
+
+	const double posting_count = static_cast<double>(flat_index.GetPostingCount());
+	cout << "Posting scan over "s << DOCUMENT_COUNT << " documents, "s
+		<< QUERY_WORD_COUNT << " query words"s << endl;
+	cout << "Bytes per posting: map of maps "s << allocated_bytes / posting_count
+		<< ", flat "s << flat_index.GetPostingsMemoryUsage() / posting_count
+		<< ", compressed "s << compressed_index.GetPostingsMemoryUsage() / posting_count << endl;
+	double map_checksum = 0.0;
+	{
+		LOG_DURATION("map of maps"s);
+		for (const string_view word : query_words) {
+			if (word_to_document_freqs.count(word) == 0) {
+				continue;
+			}
+			for (const auto [document_id, term_freq] : word_to_document_freqs.at(word)) {
+				map_checksum += term_freq * (document_id & 1);
+			}
+		}
+	}
+	double flat_checksum = 0.0;
+	{
+		LOG_DURATION("flat posting arrays"s);
+		flat_checksum = ScanPostings(flat_index, query_words);
+	}
+	double compressed_checksum = 0.0;
+	{
+		LOG_DURATION("compressed posting blocks"s);
+		compressed_checksum = ScanPostings(compressed_index, query_words);
+	}
+	if (map_checksum != flat_checksum || map_checksum != compressed_checksum) {
+		cout << "Checksum mismatch: "s << map_checksum << " vs "s << flat_checksum
+			<< " vs "s << compressed_checksum << endl;
+	}
+}
+
+string GenerateText(mt19937& generator, const vector<string>& vocabulary, int word_count) {
+	string text;
+	for (int i = 0; i < word_count; ++i) {
+		if (i > 0) {
+			text += ' ';
+		}
+		text += vocabulary[PickWord(generator, static_cast<int>(vocabulary.size()))];
+	}
+	return text;
+}
+
+SearchServer GenerateSearchServer(mt19937& generator, const vector<string>& vocabulary,
+	IndexMode index_mode = IndexMode::FLAT) {
+	SearchServer search_server(""s, index_mode);
+	for (int document_id = 0; document_id < DOCUMENT_COUNT; ++document_id) {
+		search_server.AddDocument(document_id, GenerateText(generator, vocabulary, WORDS_PER_DOCUMENT),
+			DocumentStatus::ACTUAL, { static_cast<int>(generator() % 10) });
+	}
+	return search_server;
+}
+
+void BenchmarkTopDocuments(IndexMode index_mode) {
+	const vector<string> vocabulary = GenerateVocabulary(VOCABULARY_SIZE);
+	mt19937 generator(7);
+	const SearchServer search_server = GenerateSearchServer(generator, vocabulary, index_mode);
+	vector<string> queries;
+	for (int i = 0; i < QUERY_COUNT; ++i) {
+		queries.push_back(GenerateText(generator, vocabulary, WORDS_PER_QUERY));
+	}
+
+	cout << "Top documents for "s << QUERY_COUNT << " queries over "s << DOCUMENT_COUNT << " documents, "s
+		<< (index_mode == IndexMode::FLAT ? "flat"s : "compressed"s) << " index"s << endl;
+	size_t exhaustive_count = 0;
+	{
+		LOG_DURATION("exhaustive"s);
+		for (const string& query : queries) {
+			exhaustive_count += search_server.FindTopDocuments(query).size();
+		}
+	}
+	size_t predicate_count = 0;
+	{
+		LOG_DURATION("exhaustive with rating predicate"s);
+		for (const string& query : queries) {
+			predicate_count += search_server.FindTopDocuments(query,
+				[](int, DocumentStatus, int rating) { return rating > 0; }).size();
+		}
+	}
+	size_t max_score_count = 0;
+	{
+		LOG_DURATION("MaxScore"s);
+		for (const string& query : queries) {
+			max_score_count += search_server.FindTopDocuments(query, DocumentStatus::ACTUAL,
+				SearchOptions(MAX_RESULT_DOCUMENT_COUNT, EvaluationStrategy::MAX_SCORE)).size();
+		}
+	}
+	if (exhaustive_count != max_score_count) {
+		cout << "Result count mismatch: "s << exhaustive_count << " vs "s << max_score_count << endl;
+	}
+}
+
+// Throughput of the quantized strategies against the exact ones, and the share of their results
+// equal to the exact top documents
+void BenchmarkQuantizedScores() {
+	const vector<string> vocabulary = GenerateVocabulary(VOCABULARY_SIZE);
+	mt19937 generator(7);
+	const SearchServer search_server = GenerateSearchServer(generator, vocabulary);
+	vector<string> queries;
+	for (int i = 0; i < QUERY_COUNT; ++i) {
+		queries.push_back(GenerateText(generator, vocabulary, WORDS_PER_QUERY));
+	}
+	// Impacts are quantized on the first query of a term
+	for (const string& query : queries) {
+		search_server.FindTopDocuments(query, DocumentStatus::ACTUAL, SearchOptions(1, EvaluationStrategy::QUANTIZED));
+	}
+
+	cout << "Quantized scores for "s << QUERY_COUNT << " queries over "s << DOCUMENT_COUNT << " documents"s << endl;
+	vector<vector<Document>> exact_results;
+	{
+		LOG_DURATION("exhaustive"s);
+		for (const string& query : queries) {
+			exact_results.push_back(search_server.FindTopDocuments(query));
+		}
+	}
+	const vector<pair<EvaluationStrategy, string>> strategies = {
+		{ EvaluationStrategy::MAX_SCORE, "MaxScore"s },
+		{ EvaluationStrategy::QUANTIZED, "quantized"s },
+		{ EvaluationStrategy::IMPACT_ORDERED, "impact ordered"s },
+	};
+	for (const auto& [strategy, name] : strategies) {
+		vector<vector<Document>> results;
+		{
+			LOG_DURATION(name);
+			for (const string& query : queries) {
+				results.push_back(search_server.FindTopDocuments(query, DocumentStatus::ACTUAL,
+					SearchOptions(MAX_RESULT_DOCUMENT_COUNT, strategy)));
+			}
+		}
+		int exact_count = 0;
+		for (size_t i = 0; i < queries.size(); ++i) {
+			exact_count += equal(results[i].begin(), results[i].end(), exact_results[i].begin(), exact_results[i].end(),
+				[](const Document& lhs, const Document& rhs) { return lhs.id == rhs.id; });
+		}
+		cout << exact_count << " of "s << queries.size() << " results equal to the exact ones"s << endl;
+	}
+}
+
+// External ids spread over the whole int range, postings still hold dense internal ids
+void BenchmarkScatteredIds() {
+	const vector<string> vocabulary = GenerateVocabulary(VOCABULARY_SIZE);
+	mt19937 generator(7);
+	SearchServer search_server(""s);
+	for (int i = 0; i < DOCUMENT_COUNT; ++i) {
+		const int document_id = static_cast<int>((i * 2654435761u) % 2147483647u);
+		search_server.AddDocument(document_id, GenerateText(generator, vocabulary, WORDS_PER_DOCUMENT),
+			static_cast<DocumentStatus>(i % 4), { static_cast<int>(generator() % 10) });
+	}
+	vector<string> queries;
+	for (int i = 0; i < QUERY_COUNT; ++i) {
+		queries.push_back(GenerateText(generator, vocabulary, WORDS_PER_QUERY));
+	}
+
+	cout << "Top documents for "s << QUERY_COUNT << " queries over "s << DOCUMENT_COUNT
+		<< " documents with scattered ids"s << endl;
+	size_t count = 0;
+	{
+		LOG_DURATION("status filter"s);
+		for (const string& query : queries) {
+			count += search_server.FindTopDocuments(query, DocumentStatus::BANNED).size();
+		}
+	}
+	{
+		LOG_DURATION("rating predicate"s);
+		for (const string& query : queries) {
+			count += search_server.FindTopDocuments(query,
+				[](int, DocumentStatus, int rating) { return rating > 0; }).size();
+		}
+	}
+	{
+		LOG_DURATION("iteration in id order"s);
+		int previous_id = -1;
+		for (const int document_id : search_server) {
+			count += document_id > previous_id;
+			previous_id = document_id;
+		}
+	}
+	cout << "Checksum: "s << count << endl;
+}
+
+// Pages deep into the results: every page either selects the top of all documents up to its end and
+// drops the ones before it, or resumes after the cursor of the previous page
+void BenchmarkPagination() {
+	const int page_size = 10;
+	const int page_count = 50;
+	const vector<string> vocabulary = GenerateVocabulary(VOCABULARY_SIZE);
+	mt19937 generator(7);
+	const SearchServer search_server = GenerateSearchServer(generator, vocabulary);
+	vector<string> queries;
+	for (int i = 0; i < QUERY_COUNT / 10; ++i) {
+		queries.push_back(GenerateText(generator, vocabulary, WORDS_PER_QUERY));
+	}
+
+	cout << page_count << " pages of "s << page_size << " documents for "s << queries.size() << " queries over "s
+		<< DOCUMENT_COUNT << " documents"s << endl;
+	size_t top_checksum = 0;
+	{
+		LOG_DURATION("top documents up to the page"s);
+		for (const string& query : queries) {
+			for (int page = 0; page < page_count; ++page) {
+				const vector<Document> documents = search_server.FindTopDocuments(query, DocumentStatus::ACTUAL,
+					SearchOptions(static_cast<size_t>(page + 1) * page_size));
+				for (size_t i = static_cast<size_t>(page) * page_size; i < documents.size(); ++i) {
+					top_checksum += documents[i].id;
+				}
+			}
+		}
+	}
+	size_t cursor_checksum = 0;
+	{
+		LOG_DURATION("search-after cursor"s);
+		for (const string& query : queries) {
+			int page = 0;
+			for (const auto& documents : search_server.PaginateTopDocuments(query, DocumentStatus::ACTUAL, page_size)) {
+				for (const Document& document : documents) {
+					cursor_checksum += document.id;
+				}
+				if (++page == page_count) {
+					break;
+				}
+			}
+		}
+	}
+	if (top_checksum != cursor_checksum) {
+		cout << "Page mismatch: "s << top_checksum << " vs "s << cursor_checksum << endl;
+	}
+}
+
+void BenchmarkHighlighting() {
+	const int page_size = 20;
+	const vector<string> vocabulary = GenerateVocabulary(VOCABULARY_SIZE);
+	mt19937 generator(7);
+	const SearchServer search_server = GenerateSearchServer(generator, vocabulary);
+	vector<string> queries;
+	vector<vector<int>> pages;
+	for (int i = 0; i < QUERY_COUNT; ++i) {
+		queries.push_back(GenerateText(generator, vocabulary, WORDS_PER_QUERY));
+		vector<int> page;
+		for (const Document& document : search_server.FindTopDocuments(queries.back(), DocumentStatus::ACTUAL,
+			SearchOptions(page_size))) {
+			page.push_back(document.id);
+		}
+		pages.push_back(move(page));
+	}
+
+	cout << "Matching pages of "s << page_size << " results for "s << queries.size() << " queries"s << endl;
+	size_t single_checksum = 0;
+	{
+		LOG_DURATION("MatchDocument per result"s);
+		for (size_t i = 0; i < queries.size(); ++i) {
+			for (const int document_id : pages[i]) {
+				single_checksum += get<0>(search_server.MatchDocument(queries[i], document_id)).size();
+			}
+		}
+	}
+	size_t batch_checksum = 0;
+	{
+		LOG_DURATION("MatchDocuments per page"s);
+		for (size_t i = 0; i < queries.size(); ++i) {
+			for (const auto& [words, status] : search_server.MatchDocuments(queries[i], pages[i])) {
+				batch_checksum += words.size();
+			}
+		}
+	}
+	{
+		LOG_DURATION("MatchDocuments per page, par"s);
+		size_t checksum = 0;
+		for (size_t i = 0; i < queries.size(); ++i) {
+			for (const auto& [words, status] : search_server.MatchDocuments(execution::par, queries[i], pages[i])) {
+				checksum += words.size();
+			}
+		}
+		batch_checksum = checksum == batch_checksum ? batch_checksum : 0;
+	}
+	if (single_checksum != batch_checksum) {
+		cout << "Match mismatch: "s << single_checksum << " vs "s << batch_checksum << endl;
+	}
+}
+
+void BenchmarkQueryPlanner() {
+	const vector<string> vocabulary = GenerateVocabulary(VOCABULARY_SIZE);
+	mt19937 generator(31);
+	SearchServer search_server = GenerateSearchServer(generator, vocabulary);
+	vector<string> queries;
+	for (int i = 0; i < QUERY_COUNT; ++i) {
+		queries.push_back(GenerateText(generator, vocabulary, WORDS_PER_QUERY) + " -"s
+			+ vocabulary[PickWord(generator, VOCABULARY_SIZE)]);
+	}
+	atomic<size_t> parallel_count = 0;
+	atomic<size_t> minus_first_count = 0;
+	search_server.SetQueryPlanObserver([&parallel_count, &minus_first_count](const QueryPlan& plan) {
+		parallel_count += plan.is_parallel;
+		minus_first_count += plan.is_minus_first;
+	});
+
+	cout << "Query planner on "s << QUERY_COUNT << " queries with minus words over "s << DOCUMENT_COUNT
+		<< " documents"s << endl;
+	vector<vector<Document>> results(queries.size());
+	{
+		LOG_DURATION("sequential"s);
+		transform(queries.begin(), queries.end(), results.begin(),
+			[&search_server](const string& query) { return search_server.FindTopDocuments(execution::seq, query); });
+	}
+	{
+		LOG_DURATION("parallel"s);
+		for (const string& query : queries) {
+			search_server.FindTopDocuments(execution::par, query);
+		}
+	}
+	vector<vector<Document>> adaptive_results(queries.size());
+	{
+		LOG_DURATION("adaptive"s);
+		transform(queries.begin(), queries.end(), adaptive_results.begin(),
+			[&search_server](const string& query) { return search_server.FindTopDocuments(adaptive_execution, query); });
+	}
+	cout << "Plans: "s << parallel_count << " parallel, "s << minus_first_count << " minus words first"s << endl;
+	const bool is_same = equal(results.begin(), results.end(), adaptive_results.begin(),
+		[](const vector<Document>& lhs, const vector<Document>& rhs) {
+			return equal(lhs.begin(), lhs.end(), rhs.begin(), rhs.end(), [](const Document& l, const Document& r) {
+				return l.id == r.id && l.relevance == r.relevance;
+			});
+		});
+	if (!is_same) {
+		cout << "Adaptive results differ"s << endl;
+	}
+}
+
+void BenchmarkConjunctiveQueries() {
+	const vector<string> vocabulary = GenerateVocabulary(VOCABULARY_SIZE);
+	mt19937 generator(37);
+	const SearchServer search_server = GenerateSearchServer(generator, vocabulary);
+	// Frequent words make for long posting lists and small intersections
+	const vector<string> query_vocabulary(vocabulary.begin(), vocabulary.begin() + 200);
+	// Filtering ranks every matching document, so fewer queries keep the run short
+	const int query_count = QUERY_COUNT / 10;
+	vector<string> queries;
+	for (int i = 0; i < query_count; ++i) {
+		queries.push_back(GenerateText(generator, query_vocabulary, 3));
+	}
+
+	cout << "Conjunctive top documents for "s << query_count << " queries over "s << DOCUMENT_COUNT << " documents"s << endl;
+	size_t filtered_count = 0;
+	{
+		LOG_DURATION("filtering disjunctive results"s);
+		for (const string& query : queries) {
+			const vector<Document> documents = search_server.FindTopDocuments(query, DocumentStatus::ACTUAL, DOCUMENT_COUNT);
+			const size_t plus_word_count = search_server.PlanQuery(query).terms.size();
+			size_t result_count = 0;
+			for (const Document& document : documents) {
+				if (result_count < MAX_RESULT_DOCUMENT_COUNT
+					&& get<0>(search_server.MatchDocument(query, document.id)).size() == plus_word_count) {
+					++result_count;
+				}
+			}
+			filtered_count += result_count;
+		}
+	}
+	size_t conjunctive_count = 0;
+	{
+		LOG_DURATION("intersecting posting lists"s);
+		const SearchOptions options(MAX_RESULT_DOCUMENT_COUNT, EvaluationStrategy::EXHAUSTIVE, QueryMode::CONJUNCTIVE);
+		for (const string& query : queries) {
+			conjunctive_count += search_server.FindTopDocuments(query, DocumentStatus::ACTUAL, options).size();
+		}
+	}
+	if (filtered_count != conjunctive_count) {
+		cout << "Result count mismatch: "s << filtered_count << " vs "s << conjunctive_count << endl;
+	}
+
+	vector<vector<int>> id_lists;
+	for (int i = 0; i < 8; ++i) {
+		vector<int> ids;
+		for (int id = 0; id < DOCUMENT_COUNT; ++id) {
+			if (generator() % (2 + i) == 0) {
+				ids.push_back(id);
+			}
+		}
+		id_lists.push_back(move(ids));
+	}
+	vector<int> out(DOCUMENT_COUNT);
+	size_t merged_count = 0;
+	{
+		LOG_DURATION("std::set_intersection"s);
+		for (int round = 0; round < 50; ++round) {
+			for (size_t i = 1; i < id_lists.size(); ++i) {
+				merged_count += set_intersection(id_lists[i - 1].begin(), id_lists[i - 1].end(),
+					id_lists[i].begin(), id_lists[i].end(), out.begin()) - out.begin();
+			}
+		}
+	}
+	size_t block_count = 0;
+	{
+		LOG_DURATION("block intersection"s);
+		for (int round = 0; round < 50; ++round) {
+			for (size_t i = 1; i < id_lists.size(); ++i) {
+				block_count += IntersectDocumentIds(id_lists[i - 1].data(), id_lists[i - 1].size(),
+					id_lists[i].data(), id_lists[i].size(), out.data());
+			}
+		}
+	}
+	if (merged_count != block_count) {
+		cout << "Intersection size mismatch"s << endl;
+	}
+}
+
+// The ConcurrentMap this repository used before the open addressing rewrite
+template <typename Key, typename Value>
+class LegacyConcurrentMap {
+private:
+	struct Bucket {
+		std::mutex mutex;
+		std::map<Key, Value> map;
+	};
+
+public:
+	struct Access {
+		std::lock_guard<std::mutex> guard;
+		Value& ref_to_value;
+		Access(const Key& key, Bucket& bucket)
+			: guard(bucket.mutex)
+			, ref_to_value(bucket.map[key])
+		{}
+	};
+
+	explicit LegacyConcurrentMap(std::size_t bucket_count = 8)
+		: buckets_(bucket_count)
+	{}
+
+	Access operator[](const Key& key) {
+		return Access(key, buckets_[static_cast<uint64_t>(key) % buckets_.size()]);
+	}
+
+private:
+	std::vector<Bucket> buckets_;
+};
+
+template <typename Function>
+void RunOnThreads(int thread_count, Function function) {
+	vector<thread> threads;
+	for (int i = 0; i < thread_count; ++i) {
+		threads.emplace_back(function, i);
+	}
+	for (thread& t : threads) {
+		t.join();
+	}
+}
+
+void BenchmarkQueryBatch() {
+	const int query_count = 2 * QUERY_COUNT;
+	const vector<string> vocabulary = GenerateVocabulary(VOCABULARY_SIZE);
+	mt19937 generator(29);
+	const SearchServer search_server = GenerateSearchServer(generator, vocabulary);
+	// Queries of a batch draw their words from a narrower vocabulary and share many of them
+	const vector<string> query_vocabulary(vocabulary.begin(), vocabulary.begin() + QUERY_WORD_COUNT);
+	vector<string> queries;
+	for (int i = 0; i < query_count; ++i) {
+		queries.push_back(GenerateText(generator, query_vocabulary, WORDS_PER_QUERY));
+	}
+
+	cout << "Batch of "s << query_count << " queries over "s << DOCUMENT_COUNT << " documents"s << endl;
+	vector<vector<Document>> single_results(queries.size());
+	{
+		LOG_DURATION("one query at a time"s);
+		transform(execution::par, queries.begin(), queries.end(), single_results.begin(),
+			[&search_server](const string& query) { return search_server.FindTopDocuments(query); });
+	}
+	vector<vector<Document>> batch_results;
+	{
+		LOG_DURATION("term-grouped batch"s);
+		batch_results = search_server.FindTopDocumentsBatch(execution::par, queries);
+	}
+	size_t document_count = 0;
+	{
+		LOG_DURATION("joined range"s);
+		for (const Document& document : ProcessQueriesJoined(search_server, queries)) {
+			document_count += document.id >= 0;
+		}
+	}
+	const bool is_same = equal(single_results.begin(), single_results.end(), batch_results.begin(),
+		[](const vector<Document>& lhs, const vector<Document>& rhs) {
+			return equal(lhs.begin(), lhs.end(), rhs.begin(), rhs.end(), [](const Document& l, const Document& r) {
+				return l.id == r.id && l.relevance == r.relevance;
+			});
+		});
+	if (!is_same || document_count == 0) {
+		cout << "Batch results differ"s << endl;
+	}
+}
+
+// Splitting by std::string_view::find into a new vector, as a baseline for the tokenizer
+vector<string_view> SplitByFind(string_view text) {
+	vector<string_view> words;
+	for (size_t space = text.find(' '); space != text.npos; space = text.find(' ')) {
+		words.push_back(text.substr(0, space));
+		text.remove_prefix(space + 1);
+	}
+	words.push_back(text);
+	return words;
+}
+
+void BenchmarkTokenizer() {
+	const vector<string> vocabulary = GenerateVocabulary(VOCABULARY_SIZE);
+	mt19937 generator(31);
+	vector<string> texts;
+	for (int i = 0; i < DOCUMENT_COUNT; ++i) {
+		texts.push_back(GenerateText(generator, vocabulary, WORDS_PER_DOCUMENT));
+	}
+
+	cout << "Tokenizing "s << DOCUMENT_COUNT << " texts"s << endl;
+	size_t find_length = 0;
+	{
+		LOG_DURATION("find and validate each word"s);
+		for (const string& text : texts) {
+			for (const string_view word : SplitByFind(text)) {
+				find_length += all_of(word.begin(), word.end(), [](char c) { return c < '\0' || c >= ' '; }) ? word.size() : 0;
+			}
+		}
+	}
+	size_t tokenizer_length = 0;
+	{
+		LOG_DURATION("tokenizer"s);
+		for (const string& text : texts) {
+			for (WordTokenizer tokenizer(text); tokenizer.Next();) {
+				tokenizer_length += tokenizer.IsWordValid() ? tokenizer.GetWord().size() : 0;
+			}
+		}
+	}
+	if (find_length != tokenizer_length) {
+		cout << "Tokenizer mismatch: "s << find_length << " vs "s << tokenizer_length << endl;
+	}
+}
+
+void BenchmarkConcurrentMap() {
+	const int thread_count = max(4, static_cast<int>(thread::hardware_concurrency()));
+	for (const int key_count : { 64, 100'000 }) {
+		cout << "ConcurrentMap, "s << thread_count << " threads adding to "s << key_count << " keys"s << endl;
+		{
+			LegacyConcurrentMap<int, double> map;
+			LOG_DURATION("mutex + std::map buckets"s);
+			RunOnThreads(thread_count, [&map, key_count](int thread_index) {
+				for (int i = 0; i < CONCURRENT_ADDS_PER_THREAD; ++i) {
+					map[static_cast<int>((i * 7919u + thread_index) % key_count)].ref_to_value += 1.0;
+				}
+			});
+		}
+		{
+			ConcurrentMap<int, double> map;
+			LOG_DURATION("open addressing shards, Access"s);
+			RunOnThreads(thread_count, [&map, key_count](int thread_index) {
+				for (int i = 0; i < CONCURRENT_ADDS_PER_THREAD; ++i) {
+					map[static_cast<int>((i * 7919u + thread_index) % key_count)].ref_to_value += 1.0;
+				}
+			});
+		}
+		{
+			ConcurrentMap<int, double> map;
+			LOG_DURATION("open addressing shards, FetchAdd"s);
+			RunOnThreads(thread_count, [&map, key_count](int thread_index) {
+				for (int i = 0; i < CONCURRENT_ADDS_PER_THREAD; ++i) {
+					map.FetchAdd(static_cast<int>((i * 7919u + thread_index) % key_count), 1.0);
+				}
+			});
+		}
+	}
+}
+
+void BenchmarkBulkIndexing() {
+	const vector<string> vocabulary = GenerateVocabulary(VOCABULARY_SIZE);
+	mt19937 generator(13);
+	vector<string> texts;
+	for (int i = 0; i < DOCUMENT_COUNT; ++i) {
+		texts.push_back(GenerateText(generator, vocabulary, WORDS_PER_DOCUMENT));
+	}
+	vector<DocumentInput> documents;
+	for (int document_id = 0; document_id < DOCUMENT_COUNT; ++document_id) {
+		documents.push_back({ document_id, texts[document_id], DocumentStatus::ACTUAL, { document_id % 10 } });
+	}
+
+	cout << "Indexing "s << DOCUMENT_COUNT << " documents"s << endl;
+	size_t document_count = 0;
+	{
+		LOG_DURATION("AddDocument one by one"s);
+		SearchServer search_server(""s);
+		for (const DocumentInput& document : documents) {
+			search_server.AddDocument(document.id, document.text, document.status, document.ratings);
+		}
+		document_count += search_server.GetDocumentCount();
+	}
+	{
+		LOG_DURATION("AddDocuments, seq"s);
+		SearchServer search_server(""s);
+		search_server.AddDocuments(documents);
+		document_count += search_server.GetDocumentCount();
+	}
+	{
+		LOG_DURATION("AddDocuments, par"s);
+		SearchServer search_server(""s);
+		search_server.AddDocuments(execution::par, documents);
+		document_count += search_server.GetDocumentCount();
+	}
+	if (document_count != 3 * documents.size()) {
+		cout << "Document count mismatch: "s << document_count << endl;
+	}
+}
+
+void BenchmarkVersionedUpdates() {
+	const int update_count = 100;
+	const vector<string> vocabulary = GenerateVocabulary(VOCABULARY_SIZE);
+	mt19937 generator(17);
+	VersionedSearchServer search_server(GenerateSearchServer(generator, vocabulary));
+	vector<string> texts;
+	for (int i = 0; i < update_count; ++i) {
+		texts.push_back(GenerateText(generator, vocabulary, WORDS_PER_DOCUMENT));
+	}
+
+	cout << "Publishing "s << update_count << " documents over "s << DOCUMENT_COUNT << " documents"s << endl;
+	{
+		LOG_DURATION("a version per document"s);
+		for (int i = 0; i < update_count; ++i) {
+			search_server.Update([i, &texts](SearchServer& server) {
+				server.AddDocument(DOCUMENT_COUNT + i, texts[i], DocumentStatus::ACTUAL, { 1 });
+			});
+		}
+	}
+	vector<DocumentInput> documents;
+	for (int i = 0; i < update_count; ++i) {
+		documents.push_back({ DOCUMENT_COUNT + update_count + i, texts[i], DocumentStatus::ACTUAL, { 1 } });
+	}
+	{
+		LOG_DURATION("a single version"s);
+		search_server.AddDocuments(documents);
+	}
+	if (search_server.Acquire()->GetDocumentCount() != static_cast<size_t>(DOCUMENT_COUNT + 2 * update_count)) {
+		cout << "Document count mismatch: "s << search_server.Acquire()->GetDocumentCount() << endl;
+	}
+}
+
+void BenchmarkRemoval(IndexMode index_mode) {
+	const int removal_count = DOCUMENT_COUNT / 10;
+	const int removals_per_version = 200;
+	const vector<string> vocabulary = GenerateVocabulary(VOCABULARY_SIZE);
+	mt19937 generator(19);
+	VersionedSearchServer search_server(GenerateSearchServer(generator, vocabulary, index_mode));
+	vector<int> document_ids(search_server.Acquire()->begin(), search_server.Acquire()->end());
+	shuffle(document_ids.begin(), document_ids.end(), generator);
+	const string query = GenerateText(generator, vocabulary, 5);
+
+	cout << "Removing "s << removal_count << " of "s << DOCUMENT_COUNT << " documents, "s
+		<< (index_mode == IndexMode::FLAT ? "flat"s : "compressed"s) << " postings"s << endl;
+	{
+		LOG_DURATION("a version per "s + to_string(removals_per_version) + " removals"s);
+		for (int first = 0; first < removal_count; first += removals_per_version) {
+			search_server.Update([&document_ids, first, removals_per_version](SearchServer& server) {
+				for (int i = first; i < first + removals_per_version; ++i) {
+					server.RemoveDocument(document_ids[i]);
+				}
+			});
+		}
+	}
+	const vector<Document> before = search_server.Acquire()->FindTopDocuments(query);
+	{
+		LOG_DURATION("query over removed postings"s);
+		for (int i = 0; i < 100; ++i) {
+			search_server.Acquire()->FindTopDocuments(query);
+		}
+	}
+	{
+		LOG_DURATION("background compaction"s);
+		search_server.CompactInBackground(1024).get();
+	}
+	{
+		LOG_DURATION("query after compaction"s);
+		for (int i = 0; i < 100; ++i) {
+			search_server.Acquire()->FindTopDocuments(query);
+		}
+	}
+	const vector<Document> after = search_server.Acquire()->FindTopDocuments(query);
+	if (before.size() != after.size() || !equal(before.begin(), before.end(), after.begin(),
+		[](const Document& lhs, const Document& rhs) { return lhs.id == rhs.id && lhs.relevance == rhs.relevance; })) {
+		cout << "Compaction changed the results"s << endl;
+	}
+}
+
+void BenchmarkDuplicates() {
+	const vector<string> vocabulary = GenerateVocabulary(VOCABULARY_SIZE);
+	mt19937 generator(23);
+	SearchServer search_server(""s);
+	vector<string> texts;
+	// Every tenth document repeats an earlier one, every tenth after it has one more word
+	for (int document_id = 0; document_id < DOCUMENT_COUNT; ++document_id) {
+		if (document_id % 10 == 9) {
+			texts.push_back(texts[generator() % texts.size()]);
+		}
+		else if (document_id % 10 == 8) {
+			texts.push_back(texts[generator() % texts.size()] + " "s + vocabulary[generator() % vocabulary.size()]);
+		}
+		else {
+			texts.push_back(GenerateText(generator, vocabulary, WORDS_PER_DOCUMENT));
+		}
+		search_server.AddDocument(document_id, texts.back(), DocumentStatus::ACTUAL, { 1 });
+	}
+
+	cout << "Duplicates among "s << DOCUMENT_COUNT << " documents"s << endl;
+	vector<int> exact_duplicates;
+	{
+		LOG_DURATION("exact fingerprints"s);
+		exact_duplicates = FindDuplicates(search_server);
+	}
+	vector<int> near_duplicates;
+	{
+		LOG_DURATION("near duplicates, MinHash with LSH"s);
+		near_duplicates = FindDuplicates(search_server, DuplicateOptions(DuplicateMode::NEAR, 0.8));
+	}
+	{
+		LOG_DURATION("batch removal"s);
+		search_server.RemoveDocuments(near_duplicates);
+	}
+	cout << "Exact: "s << exact_duplicates.size() << ", near: "s << near_duplicates.size()
+		<< ", left: "s << search_server.GetDocumentCount() << endl;
+}
+
+void BenchmarkQueryCache() {
+	const int distinct_query_count = 200;
+	const int request_count = 2'000;
+	const vector<string> vocabulary = GenerateVocabulary(VOCABULARY_SIZE);
+	mt19937 generator(19);
+	SearchServer search_server = GenerateSearchServer(generator, vocabulary);
+	vector<string> queries;
+	for (int i = 0; i < distinct_query_count; ++i) {
+		queries.push_back(GenerateText(generator, vocabulary, WORDS_PER_QUERY));
+	}
+	// A few queries make up most of the requests
+	vector<string> requests;
+	for (int i = 0; i < request_count; ++i) {
+		requests.push_back(queries[PickWord(generator, distinct_query_count)]);
+	}
+
+	cout << request_count << " skewed requests of "s << distinct_query_count << " queries over "s
+		<< DOCUMENT_COUNT << " documents"s << endl;
+	size_t uncached_count = 0;
+	{
+		LOG_DURATION("without cache"s);
+		for (const string& request : requests) {
+			uncached_count += search_server.FindTopDocuments(request).size();
+		}
+	}
+	search_server.EnableQueryCache(distinct_query_count / 2);
+	size_t cached_count = 0;
+	{
+		LOG_DURATION("with cache"s);
+		for (const string& request : requests) {
+			cached_count += search_server.FindTopDocuments(request).size();
+		}
+	}
+	cout << "Hit rate: "s << search_server.GetQueryCacheStats().GetHitRate() << endl;
+	if (uncached_count != cached_count) {
+		cout << "Result count mismatch: "s << uncached_count << " vs "s << cached_count << endl;
+	}
+}
+
+void BenchmarkSnapshot(IndexMode index_mode) {
+	const vector<string> vocabulary = GenerateVocabulary(VOCABULARY_SIZE);
+	mt19937 generator(11);
+	const string path = (filesystem::temp_directory_path() / "search_server_bench.snapshot"s).string();
+	const string query = GenerateText(generator, vocabulary, WORDS_PER_QUERY);
+
+	cout << "Startup with "s << DOCUMENT_COUNT << " documents, "s
+		<< (index_mode == IndexMode::FLAT ? "flat"s : "compressed"s) << " index"s << endl;
+	size_t rebuilt_count = 0;
+	optional<SearchServer> search_server;
+	{
+		LOG_DURATION("rebuild + first query"s);
+		search_server.emplace(GenerateSearchServer(generator, vocabulary, index_mode));
+		rebuilt_count = search_server->FindTopDocuments(query).size();
+	}
+	{
+		LOG_DURATION("save snapshot"s);
+		search_server->SaveSnapshot(path);
+	}
+	search_server.reset();
+	size_t opened_count = 0;
+	{
+		LOG_DURATION("open snapshot + first query"s);
+		const SearchServer search_server = SearchServer::OpenSnapshot(path);
+		opened_count = search_server.FindTopDocuments(query).size();
+	}
+	cout << "Snapshot size: "s << filesystem::file_size(path) / (1024 * 1024) << " MB"s << endl;
+	if (rebuilt_count != opened_count) {
+		cout << "Result count mismatch: "s << rebuilt_count << " vs "s << opened_count << endl;
+	}
+	filesystem::remove(path);
+}
+
+}  // namespace
+
+// Without arguments runs the micro-benchmarks of the index internals. With --suite measures the public
+// operations over a synthetic corpus and writes JSON or CSV, see BenchmarkSuiteOptions
+int main(int argc, char* argv[]) {
+	if (argc > 1 && argv[1] == "--suite"s) {
+		try {
+			RunBenchmarkSuite(ParseBenchmarkSuiteOptions(vector<string>(argv + 2, argv + argc)), cout);
+		}
+		catch (const invalid_argument& e) {
+			cerr << e.what() << endl;
+			cerr << "Usage: "s << argv[0] << " [--suite [--name=value]...]"s << endl;
+			return 1;
+		}
+		return 0;
+	}
+	BenchmarkPostingScan();
+	BenchmarkConcurrentMap();
+	BenchmarkQueryBatch();
+	BenchmarkTokenizer();
+	BenchmarkTopDocuments(IndexMode::FLAT);
+	BenchmarkTopDocuments(IndexMode::COMPRESSED);
+	BenchmarkQuantizedScores();
+	BenchmarkScatteredIds();
+	BenchmarkPagination();
+	BenchmarkHighlighting();
+	BenchmarkQueryPlanner();
+	BenchmarkConjunctiveQueries();
+	BenchmarkQueryCache();
+	BenchmarkBulkIndexing();
+	BenchmarkVersionedUpdates();
+	BenchmarkRemoval(IndexMode::FLAT);
+	BenchmarkRemoval(IndexMode::COMPRESSED);
+	BenchmarkDuplicates();
+	BenchmarkSnapshot(IndexMode::FLAT);
+	BenchmarkSnapshot(IndexMode::COMPRESSED);
+	return 0;
+}
@@ -0,0 +1,622 @@
+#include <algorithm>
+#include <charconv>
+#include <chrono>
+#include <cmath>
+#include <execution>
+#include <iomanip>
+#include <iostream>
+#include <iterator>
+#include <numeric>
+#include <optional>
+#include <random>
+#include <sstream>
+#include <stdexcept>
+#include <string_view>
+#include <thread>
+#include <type_traits>
+#include <utility>
+
+#if defined(SEARCH_SERVER_BENCH_TBB)
+#include <tbb/global_control.h>
+#endif
+
+#include "process_queries.h"
+#include "remove_duplicates.h"
+#include "search_server.h"
+#include "search_server_bench_suite.h"
+
+namespace {
+
+const char* const STOP_WORDS[] = {
+	"a", "an", "and", "at", "by", "for", "in", "is", "it", "of", "on", "or", "the", "to", "was", "with",
+};
+const int RATINGS_PER_DOCUMENT = 3;
+const int MAX_RATING = 10;
+// Share of documents with each status other than ACTUAL
+const double INACTIVE_STATUS_SHARE = 0.05;
+
+// Uniform in [0, 1) from 32 random bits, the same with every standard library
+double NextUniform(std::mt19937& generator) {
+	return generator() / 4294967296.0;
+}
+
+// Samples frequency ranks of a vocabulary by binary search in the cumulative distribution
+class ZipfSampler {
+public:
+	ZipfSampler(int vocabulary_size, double exponent)
+		: cumulative_weights_(vocabulary_size)
+	{
+		double sum = 0.0;
+		for (int rank = 0; rank < vocabulary_size; ++rank) {
+			sum += 1.0 / std::pow(rank + 1.0, exponent);
+			cumulative_weights_[rank] = sum;
+		}
+	}
+
+	int Sample(std::mt19937& generator) const {
+		const double weight = NextUniform(generator) * cumulative_weights_.back();
+		const auto it = std::upper_bound(cumulative_weights_.begin(), cumulative_weights_.end(), weight);
+		return static_cast<int>(std::min<std::ptrdiff_t>(it - cumulative_weights_.begin(),
+			cumulative_weights_.size() - 1));
+	}
+
+private:
+	std::vector<double> cumulative_weights_;
+};
+
+std::string MakeWord(int rank) {
+	return "w" + std::to_string(rank);
+}
+
+template <typename Value>
+Value ParseNumber(std::string_view name, std::string_view text) {
+	Value value{};
+	const char* const last = text.data() + text.size();
+	if constexpr (std::is_floating_point_v<Value>) {
+		// from_chars for floating point is missing from older standard libraries
+		std::istringstream input{ std::string(text) };
+		if (!(input >> value) || input.peek() != std::char_traits<char>::eof()) {
+			throw std::invalid_argument("Invalid value of --" + std::string(name) + ": " + std::string(text));
+		}
+	}
+	else {
+		const auto [end, error] = std::from_chars(text.data(), last, value);
+		if (text.empty() || error != std::errc() || end != last) {
+			throw std::invalid_argument("Invalid value of --" + std::string(name) + ": " + std::string(text));
+		}
+	}
+	return value;
+}
+
+int ParsePositive(std::string_view name, std::string_view text) {
+	const int value = ParseNumber<int>(name, text);
+	if (value <= 0) {
+		throw std::invalid_argument("--" + std::string(name) + " must be positive");
+	}
+	return value;
+}
+
+double ParseRatio(std::string_view name, std::string_view text) {
+	const double value = ParseNumber<double>(name, text);
+	if (!(value >= 0.0 && value <= 1.0)) {
+		throw std::invalid_argument("--" + std::string(name) + " must be between 0 and 1");
+	}
+	return value;
+}
+
+std::vector<int> DefaultThreadCounts() {
+	const int max_thread_count = static_cast<int>(std::max(1u, std::thread::hardware_concurrency()));
+	std::vector<int> thread_counts;
+	for (int thread_count = 1; thread_count < max_thread_count; thread_count *= 2) {
+		thread_counts.push_back(thread_count);
+	}
+	thread_counts.push_back(max_thread_count);
+	return thread_counts;
+}
+
+// Limits the threads of the parallel algorithms while alive. Without TBB the standard library
+// decides, and the sweep is reduced to its default
+class ThreadLimit {
+public:
+	explicit ThreadLimit([[maybe_unused]] int thread_count)
+#if defined(SEARCH_SERVER_BENCH_TBB)
+		: control_(tbb::global_control::max_allowed_parallelism, static_cast<std::size_t>(thread_count))
+#endif
+	{}
+
+	static bool IsSupported() {
+#if defined(SEARCH_SERVER_BENCH_TBB)
+		return true;
+#else
+		return false;
+#endif
+	}
+
+private:
+#if defined(SEARCH_SERVER_BENCH_TBB)
+	tbb::global_control control_;
+#endif
+};
+
+// Suppresses the reports RemoveDuplicates prints while alive
+class SilencedOutput {
+public:
+	SilencedOutput()
+		: buffer_(std::cout.rdbuf(nullptr))
+	{}
+
+	~SilencedOutput() {
+		std::cout.rdbuf(buffer_);
+	}
+
+	SilencedOutput(const SilencedOutput&) = delete;
+	SilencedOutput& operator=(const SilencedOutput&) = delete;
+
+private:
+	std::streambuf* buffer_;
+};
+
+struct Measurement {
+	std::string operation;
+	std::string policy;
+	int thread_count;
+	// Items, e.g. queries, one call handles
+	std::size_t batch_size = 1;
+	// Seconds per call
+	std::vector<double> latencies;
+};
+
+class Stopwatch {
+public:
+	Stopwatch()
+		: start_(std::chrono::steady_clock::now())
+	{}
+
+	double GetSeconds() const {
+		return std::chrono::duration<double>(std::chrono::steady_clock::now() - start_).count();
+	}
+
+private:
+	std::chrono::steady_clock::time_point start_;
+};
+
+// Nearest rank percentile of sorted latencies
+double GetPercentile(const std::vector<double>& sorted_latencies, double percentile) {
+	const std::size_t rank = static_cast<std::size_t>(std::ceil(percentile / 100.0 * sorted_latencies.size()));
+	return sorted_latencies[std::clamp<std::size_t>(rank, 1, sorted_latencies.size()) - 1];
+}
+
+struct Summary {
+	double mean;
+	double p50;
+	double p90;
+	double p99;
+	double max;
+	double calls_per_second;
+	double items_per_second;
+};
+
+Summary Summarize(const Measurement& measurement) {
+	std::vector<double> latencies = measurement.latencies;
+	std::sort(latencies.begin(), latencies.end());
+	const double total = std::accumulate(latencies.begin(), latencies.end(), 0.0);
+	const double calls_per_second = total > 0.0 ? latencies.size() / total : 0.0;
+	return {
+		total / latencies.size(),
+		GetPercentile(latencies, 50.0),
+		GetPercentile(latencies, 90.0),
+		GetPercentile(latencies, 99.0),
+		latencies.back(),
+		calls_per_second,
+		calls_per_second * measurement.batch_size,
+	};
+}
+
+std::string JoinThreadCounts(const std::vector<int>& thread_counts, std::string_view separator) {
+	std::string text;
+	for (int thread_count : thread_counts) {
+		if (!text.empty()) {
+			text += separator;
+		}
+		text += std::to_string(thread_count);
+	}
+	return text;
+}
+
+// Latencies in microseconds
+void WriteJson(const BenchmarkSuiteOptions& options, const std::vector<Measurement>& measurements,
+	std::ostream& out) {
+	out << std::fixed << std::setprecision(3);
+	out << "{\n  \"config\": {"
+		<< "\"document_count\": " << options.document_count
+		<< ", \"document_length\": " << options.document_length
+		<< ", \"vocabulary_size\": " << options.vocabulary_size
+		<< ", \"zipf_exponent\": " << options.zipf_exponent
+		<< ", \"stop_word_ratio\": " << options.stop_word_ratio
+		<< ", \"minus_word_ratio\": " << options.minus_word_ratio
+		<< ", \"duplicate_ratio\": " << options.duplicate_ratio
+		<< ", \"query_count\": " << options.query_count
+		<< ", \"query_length\": " << options.query_length
+		<< ", \"removal_count\": " << options.removal_count
+		<< ", \"repetition_count\": " << options.repetition_count
+		<< ", \"thread_counts\": [" << JoinThreadCounts(options.thread_counts, ", ") << "]"
+		<< ", \"seed\": " << options.seed
+		<< "},\n  \"results\": [";
+	for (std::size_t i = 0; i < measurements.size(); ++i) {
+		const Measurement& measurement = measurements[i];
+		const Summary summary = Summarize(measurement);
+		out << (i == 0 ? "\n" : ",\n")
+			<< "    {\"operation\": \"" << measurement.operation << "\""
+			<< ", \"policy\": \"" << measurement.policy << "\""
+			<< ", \"threads\": " << measurement.thread_count
+			<< ", \"batch_size\": " << measurement.batch_size
+			<< ", \"calls\": " << measurement.latencies.size()
+			<< ", \"mean_us\": " << summary.mean * 1e6
+			<< ", \"p50_us\": " << summary.p50 * 1e6
+			<< ", \"p90_us\": " << summary.p90 * 1e6
+			<< ", \"p99_us\": " << summary.p99 * 1e6
+			<< ", \"max_us\": " << summary.max * 1e6
+			<< ", \"calls_per_second\": " << summary.calls_per_second
+			<< ", \"items_per_second\": " << summary.items_per_second << "}";
+	}
+	out << "\n  ]\n}\n";
+}
+
+void WriteCsv(const std::vector<Measurement>& measurements, std::ostream& out) {
+	out << std::fixed << std::setprecision(3);
+	out << "operation,policy,threads,batch_size,calls,mean_us,p50_us,p90_us,p99_us,max_us,"
+		"calls_per_second,items_per_second\n";
+	for (const Measurement& measurement : measurements) {
+		const Summary summary = Summarize(measurement);
+		out << measurement.operation << ',' << measurement.policy << ',' << measurement.thread_count << ','
+			<< measurement.batch_size << ',' << measurement.latencies.size() << ','
+			<< summary.mean * 1e6 << ',' << summary.p50 * 1e6 << ',' << summary.p90 * 1e6 << ','
+			<< summary.p99 * 1e6 << ',' << summary.max * 1e6 << ','
+			<< summary.calls_per_second << ',' << summary.items_per_second << '\n';
+	}
+}
+
+class BenchmarkSuite {
+public:
+	explicit BenchmarkSuite(const BenchmarkSuiteOptions& options)
+		: options_(options)
+		, corpus_(GenerateSyntheticCorpus(options))
+	{
+		std::mt19937 generator(options.seed + 1);
+		for (int i = 0; i < options.query_count; ++i) {
+			match_document_ids_.push_back(static_cast<int>(generator() % corpus_.texts.size()));
+		}
+		removed_document_ids_.resize(corpus_.texts.size());
+		std::iota(removed_document_ids_.begin(), removed_document_ids_.end(), 0);
+		std::shuffle(removed_document_ids_.begin(), removed_document_ids_.end(), generator);
+		removed_document_ids_.resize(std::min<std::size_t>(options.removal_count, removed_document_ids_.size()));
+	}
+
+	std::vector<Measurement> Run() {
+		MeasureAddDocument();
+		for (const auto& [policy, thread_counts] : GetPolicies()) {
+			for (int thread_count : thread_counts) {
+				const ThreadLimit limit(thread_count);
+				MeasureFindTopDocuments(policy, thread_count);
+				MeasureMatchDocument(policy, thread_count);
+				MeasureRemoveDocument(policy, thread_count);
+			}
+		}
+		MeasureRemoveDuplicates();
+		for (int thread_count : options_.thread_counts) {
+			const ThreadLimit limit(thread_count);
+			MeasureProcessQueries(thread_count);
+		}
+		return std::move(measurements_);
+	}
+
+private:
+	const BenchmarkSuiteOptions& options_;
+	SyntheticCorpus corpus_;
+	// Built by MeasureAddDocument
+	std::optional<SearchServer> search_server_;
+	std::vector<int> match_document_ids_;
+	std::vector<int> removed_document_ids_;
+	std::vector<Measurement> measurements_;
+
+	// Sequential calls run on one thread, so only the parallel ones are swept
+	std::vector<std::pair<std::string, std::vector<int>>> GetPolicies() const {
+		return { { "seq", { 1 } }, { "par", options_.thread_counts } };
+	}
+
+	Measurement& StartMeasurement(std::string operation, std::string policy, int thread_count,
+		std::size_t batch_size = 1) {
+		measurements_.push_back({ std::move(operation), std::move(policy), thread_count, batch_size, {} });
+		return measurements_.back();
+	}
+
+	template <typename Call>
+	void Measure(Measurement& measurement, Call call) {
+		const Stopwatch stopwatch;
+		call();
+		measurement.latencies.push_back(stopwatch.GetSeconds());
+	}
+
+	// Repeats every call of a pass over the inputs, so the percentiles cover all repetitions
+	template <typename Call>
+	void MeasureCalls(std::string operation, const std::string& policy, int thread_count, std::size_t call_count,
+		Call call) {
+		Measurement& measurement = StartMeasurement(std::move(operation), policy, thread_count);
+		for (int repetition = 0; repetition < options_.repetition_count; ++repetition) {
+			for (std::size_t i = 0; i < call_count; ++i) {
+				Measure(measurement, [&call, i]() { call(i); });
+			}
+		}
+	}
+
+	// Documents are added untimed in parallel, for the operations changing the server
+	SearchServer BuildSearchServer() const {
+		std::vector<DocumentInput> documents;
+		documents.reserve(corpus_.texts.size());
+		for (std::size_t i = 0; i < corpus_.texts.size(); ++i) {
+			documents.push_back({ static_cast<int>(i), corpus_.texts[i], corpus_.statuses[i], corpus_.ratings[i] });
+		}
+		SearchServer search_server(corpus_.stop_words);
+		search_server.AddDocuments(std::execution::par, documents);
+		return search_server;
+	}
+
+	void MeasureAddDocument() {
+		Measurement& measurement = StartMeasurement("AddDocument", "seq", 1);
+		for (int repetition = 0; repetition < options_.repetition_count; ++repetition) {
+			// The last server built answers the queries
+			std::optional<SearchServer> discarded_server;
+			SearchServer& search_server = repetition + 1 == options_.repetition_count
+				? search_server_.emplace(corpus_.stop_words)
+				: discarded_server.emplace(corpus_.stop_words);
+			for (std::size_t i = 0; i < corpus_.texts.size(); ++i) {
+				Measure(measurement, [&]() {
+					search_server.AddDocument(static_cast<int>(i), corpus_.texts[i], corpus_.statuses[i],
+						corpus_.ratings[i]);
+				});
+			}
+		}
+	}
+
+	template <typename ExecutionPolicy>
+	void MeasureFindTopDocuments(ExecutionPolicy policy, const std::string& policy_name, int thread_count) {
+		const std::vector<std::string>& queries = corpus_.queries;
+		MeasureCalls("FindTopDocuments", policy_name, thread_count, queries.size(), [&](std::size_t i) {
+			search_server_->FindTopDocuments(policy, queries[i]);
+		});
+		MeasureCalls("FindTopDocuments(status)", policy_name, thread_count, queries.size(), [&](std::size_t i) {
+			search_server_->FindTopDocuments(policy, queries[i], DocumentStatus::BANNED);
+		});
+		MeasureCalls("FindTopDocuments(predicate)", policy_name, thread_count, queries.size(), [&](std::size_t i) {
+			search_server_->FindTopDocuments(policy, queries[i], [](int document_id, DocumentStatus, int rating) {
+				return document_id % 2 == 0 && rating > 0;
+			});
+		});
+	}
+
+	void MeasureFindTopDocuments(const std::string& policy, int thread_count) {
+		if (policy == "seq") {
+			MeasureFindTopDocuments(std::execution::seq, policy, thread_count);
+		}
+		else {
+			MeasureFindTopDocuments(std::execution::par, policy, thread_count);
+		}
+	}
+
+	template <typename ExecutionPolicy>
+	void MeasureMatchDocument(ExecutionPolicy policy, const std::string& policy_name, int thread_count) {
+		MeasureCalls("MatchDocument", policy_name, thread_count, corpus_.queries.size(), [&](std::size_t i) {
+			search_server_->MatchDocument(policy, corpus_.queries[i], match_document_ids_[i]);
+		});
+	}
+
+	void MeasureMatchDocument(const std::string& policy, int thread_count) {
+		if (policy == "seq") {
+			MeasureMatchDocument(std::execution::seq, policy, thread_count);
+		}
+		else {
+			MeasureMatchDocument(std::execution::par, policy, thread_count);
+		}
+	}
+
+	// Every repetition removes the documents from a fresh copy of the index
+	template <typename ExecutionPolicy>
+	void MeasureRemoveDocument(ExecutionPolicy policy, const std::string& policy_name, int thread_count) {
+		Measurement& measurement = StartMeasurement("RemoveDocument", policy_name, thread_count);
+		for (int repetition = 0; repetition < options_.repetition_count; ++repetition) {
+			SearchServer search_server = BuildSearchServer();
+			for (int document_id : removed_document_ids_) {
+				Measure(measurement, [&]() { search_server.RemoveDocument(policy, document_id); });
+			}
+		}
+	}
+
+	void MeasureRemoveDocument(const std::string& policy, int thread_count) {
+		if (policy == "seq") {
+			MeasureRemoveDocument(std::execution::seq, policy, thread_count);
+		}
+		else {
+			MeasureRemoveDocument(std::execution::par, policy, thread_count);
+		}
+	}
+
+	// One call handles the whole index and runs on the default threads
+	void MeasureRemoveDuplicates() {
+		Measurement& measurement = StartMeasurement("RemoveDuplicates", "-",
+			static_cast<int>(std::max(1u, std::thread::hardware_concurrency())), corpus_.texts.size());
+		for (int repetition = 0; repetition < options_.repetition_count; ++repetition) {
+			SearchServer search_server = BuildSearchServer();
+			const SilencedOutput silenced_output;
+			Measure(measurement, [&search_server]() { RemoveDuplicates(search_server); });
+		}
+	}
+
+	// One call answers every query
+	void MeasureProcessQueries(int thread_count) {
+		const std::vector<std::string>& queries = corpus_.queries;
+		Measurement& batch_measurement = StartMeasurement("ProcessQueries", "par", thread_count, queries.size());
+		for (int repetition = 0; repetition < options_.repetition_count; ++repetition) {
+			Measure(batch_measurement, [&]() { ProcessQueries(*search_server_, queries); });
+		}
+		Measurement& joined_measurement = StartMeasurement("ProcessQueriesJoined", "par", thread_count,
+			queries.size());
+		for (int repetition = 0; repetition < options_.repetition_count; ++repetition) {
+			Measure(joined_measurement, [&]() {
+				const JoinedDocuments documents = ProcessQueriesJoined(*search_server_, queries);
+				// Walks the joined range, as its callers do
+				volatile std::ptrdiff_t document_count = std::distance(documents.begin(), documents.end());
+				static_cast<void>(document_count);
+			});
+		}
+	}
+};
+
+}  // namespace
+
+BenchmarkSuiteOptions ParseBenchmarkSuiteOptions(const std::vector<std::string>& arguments) {
+	BenchmarkSuiteOptions options;
+	for (const std::string& argument : arguments) {
+		const std::string_view text = argument;
+		const std::size_t equals = text.find('=');
+		if (text.substr(0, 2) != "--" || equals == std::string_view::npos) {
+			throw std::invalid_argument("Expected --name=value, got " + argument);
+		}
+		const std::string_view name = text.substr(2, equals - 2);
+		const std::string_view value = text.substr(equals + 1);
+		if (name == "document-count") {
+			options.document_count = ParsePositive(name, value);
+		}
+		else if (name == "document-length") {
+			options.document_length = ParsePositive(name, value);
+		}
+		else if (name == "vocabulary-size") {
+			options.vocabulary_size = ParsePositive(name, value);
+		}
+		else if (name == "zipf-exponent") {
+			options.zipf_exponent = ParseNumber<double>(name, value);
+			if (!(options.zipf_exponent >= 0.0)) {
+				throw std::invalid_argument("--zipf-exponent must not be negative");
+			}
+		}
+		else if (name == "stop-word-ratio") {
+			options.stop_word_ratio = ParseRatio(name, value);
+		}
+		else if (name == "minus-word-ratio") {
+			options.minus_word_ratio = ParseRatio(name, value);
+		}
+		else if (name == "duplicate-ratio") {
+			options.duplicate_ratio = ParseRatio(name, value);
+		}
+		else if (name == "query-count") {
+			options.query_count = ParsePositive(name, value);
+		}
+		else if (name == "query-length") {
+			options.query_length = ParsePositive(name, value);
+		}
+		else if (name == "removal-count") {
+			options.removal_count = ParsePositive(name, value);
+		}
+		else if (name == "repetition-count") {
+			options.repetition_count = ParsePositive(name, value);
+		}
+		else if (name == "threads") {
+			options.thread_counts.clear();
+			for (std::size_t begin = 0; begin <= value.size();) {
+				const std::size_t end = std::min(value.find(',', begin), value.size());
+				options.thread_counts.push_back(ParsePositive(name, value.substr(begin, end - begin)));
+				begin = end + 1;
+			}
+		}
+		else if (name == "seed") {
+			options.seed = ParseNumber<uint32_t>(name, value);
+		}
+		else if (name == "format") {
+			if (value == "json") {
+				options.format = BenchmarkFormat::JSON;
+			}
+			else if (value == "csv") {
+				options.format = BenchmarkFormat::CSV;
+			}
+			else {
+				throw std::invalid_argument("--format must be json or csv");
+			}
+		}
+		else {
+			throw std::invalid_argument("Unknown option --" + std::string(name));
+		}
+	}
+	return options;
+}
+
+SyntheticCorpus GenerateSyntheticCorpus(const BenchmarkSuiteOptions& options) {
+	std::mt19937 generator(options.seed);
+	const ZipfSampler sampler(options.vocabulary_size, options.zipf_exponent);
+	const std::size_t stop_word_count = std::size(STOP_WORDS);
+	SyntheticCorpus corpus;
+	for (const char* stop_word : STOP_WORDS) {
+		corpus.stop_words += corpus.stop_words.empty() ? "" : " ";
+		corpus.stop_words += stop_word;
+	}
+
+	corpus.texts.reserve(options.document_count);
+	for (int document_id = 0; document_id < options.document_count; ++document_id) {
+		if (document_id > 0 && NextUniform(generator) < options.duplicate_ratio) {
+			corpus.texts.push_back(corpus.texts[generator() % corpus.texts.size()]);
+		}
+		else {
+			std::string text;
+			for (int i = 0; i < options.document_length; ++i) {
+				text += i == 0 ? "" : " ";
+				text += NextUniform(generator) < options.stop_word_ratio
+					? std::string(STOP_WORDS[generator() % stop_word_count])
+					: MakeWord(sampler.Sample(generator));
+			}
+			corpus.texts.push_back(std::move(text));
+		}
+
+		const double status_draw = NextUniform(generator);
+		corpus.statuses.push_back(status_draw < INACTIVE_STATUS_SHARE ? DocumentStatus::IRRELEVANT
+			: status_draw < 2 * INACTIVE_STATUS_SHARE ? DocumentStatus::BANNED
+			: status_draw < 3 * INACTIVE_STATUS_SHARE ? DocumentStatus::REMOVED
+			: DocumentStatus::ACTUAL);
+		std::vector<int> ratings(RATINGS_PER_DOCUMENT);
+		for (int& rating : ratings) {
+			rating = static_cast<int>(generator() % (2 * MAX_RATING + 1)) - MAX_RATING;
+		}
+		corpus.ratings.push_back(std::move(ratings));
+	}
+
+	// Queries are drawn from the same distribution as the documents, so frequent words are queried
+	// more often, as they are in real query logs
+	corpus.queries.reserve(options.query_count);
+	for (int query_index = 0; query_index < options.query_count; ++query_index) {
+		std::string query;
+		for (int i = 0; i < options.query_length; ++i) {
+			query += i == 0 ? "" : " ";
+			query += NextUniform(generator) < options.minus_word_ratio ? "-" : "";
+			query += MakeWord(sampler.Sample(generator));
+		}
+		corpus.queries.push_back(std::move(query));
+	}
+	return corpus;
+}
+
+void RunBenchmarkSuite(const BenchmarkSuiteOptions& options, std::ostream& out) {
+	BenchmarkSuiteOptions effective_options = options;
+	if (effective_options.thread_counts.empty() || !ThreadLimit::IsSupported()) {
+		if (!effective_options.thread_counts.empty()) {
+			std::cerr << "Thread counts need TBB, measuring with the default threads only" << std::endl;
+		}
+		effective_options.thread_counts = ThreadLimit::IsSupported()
+			? DefaultThreadCounts()
+			: std::vector<int>{ DefaultThreadCounts().back() };
+	}
+
+	const std::vector<Measurement> measurements = BenchmarkSuite(effective_options).Run();
+	if (effective_options.format == BenchmarkFormat::JSON) {
+		WriteJson(effective_options, measurements, out);
+	}
+	else {
+		WriteCsv(measurements, out);
+	}
+}
@@ -0,0 +1,57 @@
+#pragma once
+
+#include <cstdint>
+#include <ostream>
+#include <string>
+#include <vector>
+
+#include "document.h"
+
+enum class BenchmarkFormat {
+	JSON,
+	CSV,
+};
+
+struct BenchmarkSuiteOptions {
+	int document_count = 50'000;
+	int document_length = 40;
+	int vocabulary_size = 50'000;
+	// Word of frequency rank r is drawn with a probability proportional to 1 / r^zipf_exponent
+	double zipf_exponent = 1.0;
+	// Shares of document words drawn from the stop words and of query words turned into minus words
+	double stop_word_ratio = 0.2;
+	double minus_word_ratio = 0.1;
+	// Share of documents repeating the words of an earlier one, so RemoveDuplicates has work
+	double duplicate_ratio = 0.05;
+	int query_count = 1'000;
+	int query_length = 4;
+	int removal_count = 1'000;
+	int repetition_count = 3;
+	// Parallel operations are measured with every thread count. Empty means powers of two up to
+	// the hardware concurrency
+	std::vector<int> thread_counts;
+	uint32_t seed = 42;
+	BenchmarkFormat format = BenchmarkFormat::JSON;
+};
+
+// Parses arguments of the form --name=value, the names being the fields above with dashes, e.g.
+// --document-count=1000 --threads=1,2,4 --format=csv. Throws std::invalid_argument on unknown
+// names and malformed values
+BenchmarkSuiteOptions ParseBenchmarkSuiteOptions(const std::vector<std::string>& arguments);
+
+// Equal options give equal corpora on every platform: the words are sampled from a Mersenne
+// Twister without the distributions of the standard library
+struct SyntheticCorpus {
+	std::string stop_words;
+	// Document i has id i
+	std::vector<std::string> texts;
+	std::vector<DocumentStatus> statuses;
+	std::vector<std::vector<int>> ratings;
+	std::vector<std::string> queries;
+};
+
+SyntheticCorpus GenerateSyntheticCorpus(const BenchmarkSuiteOptions& options);
+
+// Measures the latency of every call of the public operations of the server over a synthetic
+// corpus and writes its percentiles and throughput, one record per operation, policy and threads
+void RunBenchmarkSuite(const BenchmarkSuiteOptions& options, std::ostream& out);
@@ -0,0 +1,39 @@
+#include "corpus_loader.h"
+#include "search_server.h"
+
+#include <chrono>
+#include <exception>
+#include <iostream>
+#include <string>
+
+using namespace std;
+
+// Indexes a corpus file and reports the ingest throughput, optionally saving the index to a snapshot
+int main(int argc, char* argv[]) {
+	if (argc < 2 || argc > 4) {
+		cerr << "Usage: "s << argv[0] << " <corpus> [stop words] [snapshot]"s << endl;
+		cerr << "Corpus lines hold id, status, ratings and text separated by tabs"s << endl;
+		return 1;
+	}
+	try {
+		SearchServer search_server(string(argc > 2 ? argv[2] : ""));
+		const auto start_time = chrono::steady_clock::now();
+		const CorpusLoadStats stats = LoadCorpus(search_server, argv[1]);
+		const double seconds = chrono::duration<double>(chrono::steady_clock::now() - start_time).count();
+		const double megabytes = static_cast<double>(stats.byte_count) / (1 << 20);
+		cout << "Indexed "s << stats.document_count << " documents, "s << megabytes << " MB in "s << seconds << " s"s << endl;
+		if (seconds > 0.0) {
+			cout << megabytes / seconds << " MB/s, "s << static_cast<double>(stats.document_count) / seconds
+				<< " docs/s"s << endl;
+		}
+		if (argc > 3) {
+			search_server.SaveSnapshot(argv[3]);
+			cout << "Saved snapshot to "s << argv[3] << endl;
+		}
+	}
+	catch (const exception& e) {
+		cerr << e.what() << endl;
+		return 1;
+	}
+	return 0;
+}
@@ -0,0 +1,1438 @@
+﻿#include "concurrent_map.h"
+#include "corpus_loader.h"
+#include "document.h"
+#include "impact_index.h"
+#include "inverted_index.h"
+#include "posting_intersection.h"
+#include "process_queries.h"
+#include "query_plan.h"
+#include "remove_duplicates.h"
+#include "search_options.h"
+#include "search_server.h"
+#include "string_processing.h"
+#include "top_documents.h"
+#include "versioned_search_server.h"
+
+#include <algorithm>
+#include <cstdint>
+#include <cstdlib>
+#include <execution>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <limits>
+#include <map>
+#include <memory>
+#include <optional>
+#include <random>
+#include <set>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <system_error>
+#include <thread>
+#include <vector>
+
+using namespace std;
+
+namespace {
+
+void AssertImpl(bool value, const string& expr_str, const string& file, const string& func, unsigned line,
+	const string& hint) {
+	if (!value) {
+		cerr << file << "("s << line << "): "s << func << ": "s;
+		cerr << "ASSERT("s << expr_str << ") failed."s;
+		if (!hint.empty()) {
+			cerr << " Hint: "s << hint;
+		}
+		cerr << endl;
+		abort();
+	}
+}
+
+#define ASSERT(expr) AssertImpl(!!(expr), #expr, __FILE__, __FUNCTION__, __LINE__, ""s)
+
+#define ASSERT_HINT(expr, hint) AssertImpl(!!(expr), #expr, __FILE__, __FUNCTION__, __LINE__, (hint))
+
+template <typename T, typename U>
+void AssertEqualImpl(const T& t, const U& u, const string& t_str, const string& u_str, const string& file,
+	const string& func, unsigned line, const string& hint) {
+	if (t != u) {
+		cerr << boolalpha;
+		cerr << file << "("s << line << "): "s << func << ": "s;
+		cerr << "ASSERT_EQUAL("s << t_str << ", "s << u_str << ") failed: "s;
+		cerr << t << " != "s << u << "."s;
+		if (!hint.empty()) {
+			cerr << " Hint: "s << hint;
+		}
+		cerr << endl;
+		abort();
+	}
+}
+
+#define ASSERT_EQUAL(a, b) AssertEqualImpl((a), (b), #a, #b, __FILE__, __FUNCTION__, __LINE__, ""s)
+
+#define ASSERT_EQUAL_HINT(a, b, hint) AssertEqualImpl((a), (b), #a, #b, __FILE__, __FUNCTION__, __LINE__, (hint))
+
+// Relevances are compared bit for bit, every evaluation path sums them in the same order
+void AssertEqualDocumentsImpl(const vector<Document>& expected, const vector<Document>& actual,
+	const string& file, const string& func, unsigned line, const string& hint) {
+	bool is_equal = expected.size() == actual.size();
+	for (size_t i = 0; is_equal && i < expected.size(); ++i) {
+		is_equal = expected[i].id == actual[i].id && expected[i].relevance == actual[i].relevance
+			&& expected[i].rating == actual[i].rating;
+	}
+	if (!is_equal) {
+		cerr << file << "("s << line << "): "s << func << ": documents differ."s;
+		if (!hint.empty()) {
+			cerr << " Hint: "s << hint;
+		}
+		cerr << endl << "Expected:"s << endl;
+		for (const Document& document : expected) {
+			cerr << "  "s << document << endl;
+		}
+		cerr << "Actual:"s << endl;
+		for (const Document& document : actual) {
+			cerr << "  "s << document << endl;
+		}
+		abort();
+	}
+}
+
+#define ASSERT_EQUAL_DOCUMENTS(expected, actual, hint) \
+	AssertEqualDocumentsImpl((expected), (actual), __FILE__, __FUNCTION__, __LINE__, (hint))
+
+template <typename Function>
+void RunTestImpl(Function function, const string& function_name) {
+	function();
+	cerr << function_name << " OK"s << endl;
+}
+
+#define RUN_TEST(func) RunTestImpl((func), #func)
+
+// A small vocabulary skewed towards its first words and a narrow range of ratings, so that
+// relevances and ratings tie often
+struct TestCorpus {
+	vector<int> ids;
+	vector<string> texts;
+	vector<DocumentStatus> statuses;
+	vector<vector<int>> ratings;
+	vector<string> queries;
+};
+
+TestCorpus GenerateTestCorpus(uint32_t seed, int document_count) {
+	const int vocabulary_size = 60;
+	mt19937 generator(seed);
+	const auto pick_word = [&generator]() {
+		const double u = generator() / 4294967296.0;
+		return "w"s + to_string(static_cast<int>(vocabulary_size * u * u));
+	};
+	TestCorpus corpus;
+	for (int i = 0; i < document_count; ++i) {
+		corpus.ids.push_back(i * 3 + static_cast<int>(generator() % 3));
+		string text;
+		const int length = 3 + static_cast<int>(generator() % 12);
+		for (int k = 0; k < length; ++k) {
+			text += (k == 0 ? ""s : " "s) + pick_word();
+		}
+		corpus.texts.push_back(move(text));
+		corpus.statuses.push_back(generator() % 8 == 0 ? DocumentStatus::BANNED : DocumentStatus::ACTUAL);
+		corpus.ratings.push_back({ static_cast<int>(generator() % 5) - 2, static_cast<int>(generator() % 5) - 2 });
+	}
+	for (int i = 0; i < 40; ++i) {
+		string query;
+		const int length = 1 + static_cast<int>(generator() % 4);
+		for (int k = 0; k < length; ++k) {
+			query += (k == 0 ? ""s : " "s) + (generator() % 6 == 0 ? "-"s : ""s) + pick_word();
+		}
+		corpus.queries.push_back(move(query));
+	}
+	return corpus;
+}
+
+void AddTestCorpus(SearchServer& search_server, const TestCorpus& corpus) {
+	for (size_t i = 0; i < corpus.ids.size(); ++i) {
+		search_server.AddDocument(corpus.ids[i], corpus.texts[i], corpus.statuses[i], corpus.ratings[i]);
+	}
+}
+
+const SearchOptions UNBOUNDED(numeric_limits<size_t>::max());
+
+bool IsEvenRated(int document_id, DocumentStatus status, int rating) {
+	return document_id % 2 == 0 && status != DocumentStatus::BANNED && rating >= 0;
+}
+
+// Splitting and validation as they were before the vectorized tokenizer, empty words dropped
+vector<string_view> SplitIntoWordsReference(string_view text) {
+	vector<string_view> words;
+	while (true) {
+		const size_t space = text.find(' ');
+		const string_view word = text.substr(0, space);
+		if (!word.empty()) {
+			words.push_back(word);
+		}
+		if (space == text.npos) {
+			return words;
+		}
+		text.remove_prefix(space + 1);
+	}
+}
+
+bool IsValidWordReference(string_view word) {
+	return none_of(word.begin(), word.end(), [](char c) {
+		return static_cast<unsigned char>(c) < ' ';
+	});
+}
+
+void AssertTokenizedAsReference(string_view text, const string& hint) {
+	const vector<string_view> expected = SplitIntoWordsReference(text);
+	ASSERT_HINT(SplitIntoWords(text) == expected, hint);
+	size_t position = 0;
+	for (WordTokenizer tokenizer(text); tokenizer.Next(); ++position) {
+		ASSERT_HINT(position < expected.size() && tokenizer.GetWord() == expected[position], hint);
+		// The views point into the text, not into copies
+		ASSERT_HINT(tokenizer.GetWord().data() == expected[position].data(), hint);
+		ASSERT_EQUAL_HINT(tokenizer.IsWordValid(), IsValidWordReference(expected[position]), hint);
+	}
+	ASSERT_EQUAL_HINT(position, expected.size(), hint);
+	ASSERT_EQUAL_HINT(IsValidWord(text), IsValidWordReference(text), hint);
+}
+
+void TestTokenizerMatchesReference() {
+	AssertTokenizedAsReference(""sv, "empty"s);
+	AssertTokenizedAsReference("a"sv, "single character"s);
+	AssertTokenizedAsReference(" "sv, "single space"s);
+	AssertTokenizedAsReference("   leading"sv, "leading spaces"s);
+	AssertTokenizedAsReference("trailing   "sv, "trailing spaces"s);
+	AssertTokenizedAsReference("  repeated    spaces  between   words "sv, "repeated spaces"s);
+	ASSERT_EQUAL(SplitIntoWords("  fluffy   cat "sv).size(), 2u);
+	ASSERT(SplitIntoWords("     "sv).empty());
+
+	// Words around the 16 and 32 byte blocks of the vectorized search, and a control character
+	// at every offset of them
+	for (const size_t offset : { 13, 14, 15, 16, 17, 29, 30, 31, 32, 33, 47, 48, 63, 64, 65 }) {
+		const string text = string(offset, 'x') + " crossing"s + string(offset, ' ') + string(40, 'y');
+		AssertTokenizedAsReference(text, "boundary at "s + to_string(offset));
+		for (const char control : { '\x01', '\t', '\n', '\x1f' }) {
+			string invalid_text = text;
+			invalid_text[offset] = control;
+			AssertTokenizedAsReference(invalid_text, "control character at "s + to_string(offset));
+		}
+	}
+	// Bytes above 127 are valid, they are negative as char
+	AssertTokenizedAsReference("caf\xc3\xa9 na\xc3\xafve \xff"sv, "non-ASCII"s);
+
+	mt19937 generator(41);
+	const string alphabet = "ab \x01\x1f\x7f\x80\xe9"s;
+	for (int i = 0; i < 3000; ++i) {
+		string text(generator() % 100, ' ');
+		for (char& c : text) {
+			// Mostly letters and spaces, so there are words to split
+			const uint32_t pick = generator() % 40;
+			c = pick < 3 ? alphabet[3 + pick] : pick < 5 ? alphabet[6 + pick - 3] : pick < 15 ? ' ' : alphabet[pick % 2];
+		}
+		AssertTokenizedAsReference(text, "random text "s + to_string(i));
+	}
+
+	SearchServer search_server(""s);
+	bool is_document_rejected = false;
+	try {
+		search_server.AddDocument(1, "cat in the\x12 city"sv, DocumentStatus::ACTUAL, { 1 });
+	}
+	catch (const invalid_argument&) {
+		is_document_rejected = true;
+	}
+	ASSERT(is_document_rejected);
+	ASSERT_EQUAL(search_server.GetDocumentCount(), 0u);
+	bool is_query_rejected = false;
+	try {
+		search_server.FindTopDocuments(string(30, 'q') + "\x05"s);
+	}
+	catch (const invalid_argument&) {
+		is_query_rejected = true;
+	}
+	ASSERT(is_query_rejected);
+}
+
+// Sends every key to one of a few home slots, so keys share probe sequences and shards
+struct CollidingHash {
+	size_t operator()(int key) const {
+		return static_cast<size_t>(key % 4);
+	}
+};
+
+// Threads add to shared keys, whose sums don't depend on the interleaving, and insert, add to and
+// erase keys of their own. Replaying every thread in turn on a std::map gives the expected state
+template <typename Value, typename Hash>
+void TestConcurrentMapWorkload(size_t shard_count, const string& hint) {
+	const int thread_count = 4;
+	const int operation_count = 3000;
+	const auto run = [operation_count](int thread, auto fetch_add, auto add_by_access, auto erase) {
+		const auto own_key = [thread](int i) {
+			return 1'000'000 + thread + thread_count * i;
+		};
+		for (int i = 0; i < operation_count; ++i) {
+			fetch_add((i * 7 + thread) % 500, static_cast<Value>(i % 5 + 1));
+			add_by_access(500 + i % 300, static_cast<Value>(1));
+			fetch_add(own_key(i), static_cast<Value>(i));
+			if (i % 3 == 0) {
+				erase(own_key(i / 2));
+			}
+			if (i % 7 == 0) {
+				add_by_access(own_key(i / 3), static_cast<Value>(2));
+			}
+		}
+	};
+
+	ConcurrentMap<int, Value, Hash> concurrent_map(shard_count);
+	vector<thread> threads;
+	for (int thread = 0; thread < thread_count; ++thread) {
+		threads.emplace_back([&concurrent_map, &run, thread]() {
+			run(thread, [&concurrent_map](int key, Value delta) { concurrent_map.FetchAdd(key, delta); },
+				[&concurrent_map](int key, Value delta) { concurrent_map[key].ref_to_value += delta; },
+				[&concurrent_map](int key) { concurrent_map.Erase(key); });
+		});
+	}
+	// Readers run alongside the writers
+	threads.emplace_back([&concurrent_map]() {
+		for (int i = 0; i < 20; ++i) {
+			size_t visited = 0;
+			concurrent_map.ForEach([&visited](int, Value) { ++visited; });
+			concurrent_map.size();
+		}
+	});
+	for (thread& thread : threads) {
+		thread.join();
+	}
+
+	map<int, Value> expected;
+	for (int thread = 0; thread < thread_count; ++thread) {
+		run(thread, [&expected](int key, Value delta) { expected[key] += delta; },
+			[&expected](int key, Value delta) { expected[key] += delta; },
+			[&expected](int key) { expected.erase(key); });
+	}
+	ASSERT_EQUAL_HINT(concurrent_map.size(), expected.size(), hint);
+	ASSERT_HINT(concurrent_map.BuildOrdinaryMap() == expected, hint);
+	map<int, Value> drained;
+	concurrent_map.Drain([&drained](int key, Value value) { drained.emplace(key, value); });
+	ASSERT_HINT(drained == expected, hint);
+	ASSERT_EQUAL_HINT(concurrent_map.size(), 0u, hint);
+}
+
+void TestConcurrentMap() {
+	TestConcurrentMapWorkload<int64_t, hash<int>>(ConcurrentMap<int, int64_t>::DefaultShardCount(), "int64_t"s);
+	// A single shard grows from empty under all the writers
+	TestConcurrentMapWorkload<int64_t, hash<int>>(1, "single shard"s);
+	TestConcurrentMapWorkload<int64_t, CollidingHash>(8, "colliding keys"s);
+	// Whole numbers keep the sums of doubles exact in any order
+	TestConcurrentMapWorkload<double, hash<int>>(4, "double"s);
+}
+
+void TestMaxScoreMatchesExhaustive() {
+	for (uint32_t seed = 1; seed <= 5; ++seed) {
+		const TestCorpus corpus = GenerateTestCorpus(seed, 2000);
+		SearchServer search_server(""s);
+		AddTestCorpus(search_server, corpus);
+		for (const string& query : corpus.queries) {
+			for (const size_t count : { 1, 5, 20 }) {
+				const string hint = "seed "s + to_string(seed) + ", query "s + query + ", count "s + to_string(count);
+				const SearchOptions exhaustive(count);
+				const SearchOptions max_score(count, EvaluationStrategy::MAX_SCORE);
+				ASSERT_EQUAL_DOCUMENTS(search_server.FindTopDocuments(query, DocumentStatus::ACTUAL, exhaustive),
+					search_server.FindTopDocuments(query, DocumentStatus::ACTUAL, max_score), hint);
+				ASSERT_EQUAL_DOCUMENTS(search_server.FindTopDocuments(query, DocumentStatus::ACTUAL, exhaustive),
+					search_server.FindTopDocuments(execution::par, query, DocumentStatus::ACTUAL, max_score), hint);
+				ASSERT_EQUAL_DOCUMENTS(search_server.FindTopDocuments(query, IsEvenRated, exhaustive),
+					search_server.FindTopDocuments(query, IsEvenRated, max_score), hint);
+				ASSERT_EQUAL_DOCUMENTS(search_server.FindTopDocuments(query, IsEvenRated, exhaustive),
+					search_server.FindTopDocuments(execution::par, query, IsEvenRated, max_score), hint);
+			}
+		}
+	}
+}
+
+// Quantized strategies rescore their results exactly. A document they leave out may be more relevant
+// than the last result by at most the quantization step for every plus word
+void TestQuantizedMatchesExhaustive() {
+	for (uint32_t seed = 1; seed <= 3; ++seed) {
+		const TestCorpus corpus = GenerateTestCorpus(seed, 2000);
+		SearchServer search_server(""s);
+		AddTestCorpus(search_server, corpus);
+		const auto any_document = [](int, DocumentStatus, int) {
+			return true;
+		};
+		// The largest score bound of a word is its best relevance as a query of its own
+		double max_score = 0.0;
+		for (int word = 0; word < 60; ++word) {
+			const vector<Document> best = search_server.FindTopDocuments("w"s + to_string(word), any_document, SearchOptions(1));
+			if (!best.empty()) {
+				max_score = max(max_score, best[0].relevance);
+			}
+		}
+		const double step = max_score / MAX_IMPACT;
+
+		for (const string& query : corpus.queries) {
+			set<string> plus_words;
+			istringstream words(query);
+			for (string word; words >> word;) {
+				if (word[0] != '-') {
+					plus_words.insert(word);
+				}
+			}
+			const double error_bound = step * static_cast<double>(plus_words.size()) + 1e-9;
+			const vector<Document> exhaustive = search_server.FindTopDocuments(query, DocumentStatus::ACTUAL, UNBOUNDED);
+			map<int, Document> exhaustive_by_id;
+			for (const Document& document : exhaustive) {
+				exhaustive_by_id.emplace(document.id, document);
+			}
+
+			for (const EvaluationStrategy strategy : { EvaluationStrategy::QUANTIZED, EvaluationStrategy::IMPACT_ORDERED }) {
+				for (const size_t count : { 1, 5, 50 }) {
+					const string hint = "seed "s + to_string(seed) + ", query "s + query + ", count "s + to_string(count)
+						+ (strategy == EvaluationStrategy::QUANTIZED ? ", quantized"s : ", impact ordered"s);
+					const vector<Document> documents = search_server.FindTopDocuments(query, DocumentStatus::ACTUAL,
+						SearchOptions(count, strategy));
+					ASSERT_EQUAL_HINT(documents.size(), min(count, exhaustive.size()), hint);
+					set<int> ids;
+					for (size_t i = 0; i < documents.size(); ++i) {
+						const auto it = exhaustive_by_id.find(documents[i].id);
+						ASSERT_HINT(it != exhaustive_by_id.end(), hint);
+						ASSERT_EQUAL_DOCUMENTS(vector<Document>{ it->second }, vector<Document>{ documents[i] }, hint);
+						ASSERT_HINT(i == 0 || IsMoreRelevant(documents[i - 1], documents[i]), hint);
+						ids.insert(documents[i].id);
+					}
+					for (const Document& document : exhaustive) {
+						ASSERT_HINT(ids.count(document.id) > 0 || document.relevance <= documents.back().relevance + error_bound,
+							hint + ", document "s + to_string(document.id));
+					}
+				}
+			}
+		}
+	}
+}
+
+void TestCompressedMatchesFlat() {
+	for (uint32_t seed = 1; seed <= 5; ++seed) {
+		const TestCorpus corpus = GenerateTestCorpus(seed, 2000);
+		SearchServer flat_server(""s, IndexMode::FLAT);
+		SearchServer compressed_server(""s, IndexMode::COMPRESSED);
+		AddTestCorpus(flat_server, corpus);
+		AddTestCorpus(compressed_server, corpus);
+		// Removed documents leave their postings behind until compaction
+		for (size_t i = 0; i < corpus.ids.size(); i += 7) {
+			flat_server.RemoveDocument(corpus.ids[i]);
+			compressed_server.RemoveDocument(corpus.ids[i]);
+		}
+		for (const string& query : corpus.queries) {
+			const string hint = "seed "s + to_string(seed) + ", query "s + query;
+			ASSERT_EQUAL_DOCUMENTS(flat_server.FindTopDocuments(query, DocumentStatus::ACTUAL, UNBOUNDED),
+				compressed_server.FindTopDocuments(query, DocumentStatus::ACTUAL, UNBOUNDED), hint);
+			ASSERT_EQUAL_DOCUMENTS(flat_server.FindTopDocuments(query, IsEvenRated, UNBOUNDED),
+				compressed_server.FindTopDocuments(execution::par, query, IsEvenRated, UNBOUNDED), hint);
+			const SearchOptions max_score(5, EvaluationStrategy::MAX_SCORE);
+			ASSERT_EQUAL_DOCUMENTS(flat_server.FindTopDocuments(query, DocumentStatus::ACTUAL, max_score),
+				compressed_server.FindTopDocuments(query, DocumentStatus::ACTUAL, max_score), hint);
+		}
+	}
+
+	// Words repeated up to hundreds of times get the same term frequency from both representations
+	SearchServer flat_server(""s, IndexMode::FLAT);
+	SearchServer compressed_server(""s, IndexMode::COMPRESSED);
+	for (int id = 0; id < 300; ++id) {
+		string text;
+		for (int k = 0; k <= id; ++k) {
+			text += "repeated "s;
+		}
+		text += "once"s + string(id % 7, 'x');
+		flat_server.AddDocument(id, text, DocumentStatus::ACTUAL, { id });
+		compressed_server.AddDocument(id, text, DocumentStatus::ACTUAL, { id });
+	}
+	for (const string& query : { "repeated"s, "once repeated"s, "oncexxx"s }) {
+		ASSERT_EQUAL_DOCUMENTS(flat_server.FindTopDocuments(query, DocumentStatus::ACTUAL, UNBOUNDED),
+			compressed_server.FindTopDocuments(query, DocumentStatus::ACTUAL, UNBOUNDED), "query "s + query);
+	}
+}
+
+void TestIntersectionMatchesSetIntersection() {
+	mt19937 generator(37);
+	const auto make_ids = [&generator](size_t size) {
+		set<int> ids;
+		while (ids.size() < size) {
+			ids.insert(static_cast<int>(generator() % 20000));
+		}
+		return vector<int>(ids.begin(), ids.end());
+	};
+	// Similar lengths go block by block, lengths 32 times apart and more gallop
+	const vector<pair<size_t, size_t>> sizes = { { 0, 100 }, { 1, 1 }, { 3, 5000 }, { 7, 7 }, { 40, 2000 },
+		{ 150, 4999 }, { 1000, 1000 }, { 4000, 6000 }, { 9000, 31 } };
+	for (const auto& [lhs_size, rhs_size] : sizes) {
+		const vector<int> lhs = make_ids(lhs_size);
+		const vector<int> rhs = make_ids(rhs_size);
+		vector<int> expected;
+		set_intersection(lhs.begin(), lhs.end(), rhs.begin(), rhs.end(), back_inserter(expected));
+		vector<int> actual(min(lhs_size, rhs_size));
+		actual.resize(IntersectDocumentIds(lhs.data(), lhs.size(), rhs.data(), rhs.size(), actual.data()));
+		ASSERT_HINT(expected == actual, "sizes "s + to_string(lhs_size) + " and "s + to_string(rhs_size));
+	}
+}
+
+// Conjunctive results are the exhaustive disjunctive ones holding every plus word
+vector<Document> FilterConjunctive(const SearchServer& search_server, const string& query, vector<Document> documents) {
+	vector<string> plus_words;
+	istringstream words(query);
+	for (string word; words >> word;) {
+		if (word[0] != '-') {
+			plus_words.push_back(word);
+		}
+	}
+	documents.erase(remove_if(documents.begin(), documents.end(), [&search_server, &plus_words](const Document& document) {
+		const map<string_view, double>& word_frequencies = search_server.GetWordFrequencies(document.id);
+		return any_of(plus_words.begin(), plus_words.end(), [&word_frequencies](const string& word) {
+			return word_frequencies.count(word) == 0;
+		});
+	}), documents.end());
+	return documents;
+}
+
+void TestConjunctiveMatchesFilteredExhaustive() {
+	for (uint32_t seed = 1; seed <= 3; ++seed) {
+		TestCorpus corpus = GenerateTestCorpus(seed, 3000);
+		// Rare words make lists short enough for galloping through the common ones
+		for (size_t i = 0; i < corpus.texts.size(); ++i) {
+			corpus.texts[i] += i % 97 == 0 ? " r0"s : ""s;
+			corpus.texts[i] += i % 41 == 0 ? " r1"s : ""s;
+		}
+		for (const string& query : { "w0 r0"s, "r0 w0 w1"s, "w1 r1 -w2"s, "r0 r1"s, "w0 w1 w2 w3"s, "r1 w5 w0 -r0"s,
+			"w0 unknown"s, "w0 w0 r1"s }) {
+			corpus.queries.push_back(query);
+		}
+		for (const IndexMode mode : { IndexMode::FLAT, IndexMode::COMPRESSED }) {
+			SearchServer search_server(""s, mode);
+			AddTestCorpus(search_server, corpus);
+			for (size_t i = 0; i < corpus.ids.size(); i += 7) {
+				search_server.RemoveDocument(corpus.ids[i]);
+			}
+			const SearchOptions conjunctive(UNBOUNDED.max_result_count, EvaluationStrategy::EXHAUSTIVE, QueryMode::CONJUNCTIVE);
+			const SearchOptions conjunctive_top(5, EvaluationStrategy::EXHAUSTIVE, QueryMode::CONJUNCTIVE);
+			for (const string& query : corpus.queries) {
+				const string hint = "seed "s + to_string(seed) + ", mode "s + to_string(static_cast<int>(mode))
+					+ ", query "s + query;
+				const vector<Document> expected = FilterConjunctive(search_server, query,
+					search_server.FindTopDocuments(query, DocumentStatus::ACTUAL, UNBOUNDED));
+				ASSERT_EQUAL_DOCUMENTS(expected, search_server.FindTopDocuments(query, DocumentStatus::ACTUAL, conjunctive), hint);
+				ASSERT_EQUAL_DOCUMENTS(expected, search_server.FindTopDocuments(execution::par, query, DocumentStatus::ACTUAL,
+					conjunctive), hint);
+				const vector<Document> expected_top(expected.begin(), expected.begin() + min<size_t>(expected.size(), 5));
+				ASSERT_EQUAL_DOCUMENTS(expected_top, search_server.FindTopDocuments(query, DocumentStatus::ACTUAL,
+					conjunctive_top), hint);
+				const vector<Document> expected_even = FilterConjunctive(search_server, query,
+					search_server.FindTopDocuments(query, IsEvenRated, UNBOUNDED));
+				ASSERT_EQUAL_DOCUMENTS(expected_even, search_server.FindTopDocuments(execution::par, query, IsEvenRated,
+					conjunctive), hint);
+			}
+		}
+	}
+}
+
+// Small shards split even short posting lists of a parallel query into document id ranges, whatever
+// the number of hardware threads
+void TestParallelMatchesSequential() {
+	const TestCorpus corpus = GenerateTestCorpus(53, 3000);
+	for (const IndexMode mode : { IndexMode::FLAT, IndexMode::COMPRESSED }) {
+		SearchServer search_server(""s, mode);
+		QueryPlannerThresholds thresholds;
+		thresholds.min_postings_per_shard = 64;
+		thresholds.max_shard_count = 8;
+		search_server.SetQueryPlannerThresholds(thresholds);
+		AddTestCorpus(search_server, corpus);
+		for (size_t i = 0; i < corpus.ids.size(); i += 9) {
+			search_server.RemoveDocument(corpus.ids[i]);
+		}
+		const vector<SearchOptions> all_options = { UNBOUNDED, SearchOptions(5),
+			SearchOptions(5, EvaluationStrategy::MAX_SCORE),
+			SearchOptions(UNBOUNDED.max_result_count, EvaluationStrategy::EXHAUSTIVE, QueryMode::CONJUNCTIVE),
+			SearchOptions(UNBOUNDED.max_result_count, EvaluationStrategy::QUANTIZED),
+			SearchOptions(5, EvaluationStrategy::IMPACT_ORDERED) };
+		for (size_t k = 0; k < all_options.size(); ++k) {
+			const SearchOptions& options = all_options[k];
+			for (const string& query : corpus.queries) {
+				const string hint = "mode "s + to_string(static_cast<int>(mode)) + ", options "s + to_string(k)
+					+ ", query "s + query;
+				for (const DocumentStatus status : { DocumentStatus::ACTUAL, DocumentStatus::BANNED }) {
+					ASSERT_EQUAL_DOCUMENTS(search_server.FindTopDocuments(query, status, options),
+						search_server.FindTopDocuments(execution::par, query, status, options), hint);
+				}
+				ASSERT_EQUAL_DOCUMENTS(search_server.FindTopDocuments(query, IsEvenRated, options),
+					search_server.FindTopDocuments(execution::par, query, IsEvenRated, options), hint);
+			}
+			vector<vector<Document>> expected;
+			for (const string& query : corpus.queries) {
+				expected.push_back(search_server.FindTopDocuments(query, DocumentStatus::ACTUAL, options));
+			}
+			const vector<vector<Document>> batch = search_server.FindTopDocumentsBatch(execution::par, corpus.queries,
+				DocumentStatus::ACTUAL, options);
+			ASSERT_EQUAL(batch.size(), expected.size());
+			for (size_t i = 0; i < expected.size(); ++i) {
+				ASSERT_EQUAL_DOCUMENTS(expected[i], batch[i], "batch, options "s + to_string(k) + ", query "s
+					+ corpus.queries[i]);
+			}
+		}
+
+		for (const string& query : corpus.queries) {
+			optional<SearchCursor> cursor;
+			vector<Document> parallel_paged;
+			do {
+				ResultPage page = search_server.FindTopDocumentsPage(execution::par, query, DocumentStatus::BANNED, 7, cursor);
+				parallel_paged.insert(parallel_paged.end(), page.documents.begin(), page.documents.end());
+				cursor = page.next;
+			} while (cursor);
+			ASSERT_EQUAL_DOCUMENTS(search_server.FindTopDocuments(query, DocumentStatus::BANNED, UNBOUNDED), parallel_paged,
+				"parallel pages, query "s + query);
+		}
+	}
+}
+
+void TestProcessQueriesMatchesFindTopDocuments() {
+	const TestCorpus corpus = GenerateTestCorpus(43, 2000);
+	SearchServer search_server("w3"s);
+	AddTestCorpus(search_server, corpus);
+	for (size_t i = 0; i < corpus.ids.size(); i += 5) {
+		search_server.RemoveDocument(corpus.ids[i]);
+	}
+	// Repeated queries and queries equal up to word order are evaluated once in a batch
+	vector<string> queries = corpus.queries;
+	queries.insert(queries.end(), corpus.queries.begin(), corpus.queries.begin() + 10);
+	queries.insert(queries.end(), { "w1 w2 -w5"s, "-w5 w2 w1"s, "w3"s, "unknown"s, "w0 w0"s });
+
+	vector<vector<Document>> expected;
+	vector<Document> expected_joined;
+	for (const string& query : queries) {
+		expected.push_back(search_server.FindTopDocuments(query));
+		expected_joined.insert(expected_joined.end(), expected.back().begin(), expected.back().end());
+	}
+	const vector<vector<Document>> actual = ProcessQueries(search_server, queries);
+	ASSERT_EQUAL(actual.size(), expected.size());
+	for (size_t i = 0; i < queries.size(); ++i) {
+		ASSERT_EQUAL_DOCUMENTS(expected[i], actual[i], "query "s + queries[i]);
+	}
+
+	// Iterators taken before a move keep walking the moved range
+	optional<JoinedDocuments> original(ProcessQueriesJoined(search_server, queries));
+	JoinedDocuments::Iterator it = original->begin();
+	const JoinedDocuments joined = move(*original);
+	original.reset();
+	ASSERT_EQUAL(joined.size(), expected_joined.size());
+	ASSERT_EQUAL_DOCUMENTS(expected_joined, vector<Document>(it, joined.end()), "joined after a move"s);
+	ASSERT_EQUAL_DOCUMENTS(expected_joined, vector<Document>(joined.begin(), joined.end()), "joined"s);
+
+	const VersionedSearchServer versioned_server(search_server);
+	const vector<vector<Document>> versioned_actual = ProcessQueries(versioned_server, queries);
+	for (size_t i = 0; i < queries.size(); ++i) {
+		ASSERT_EQUAL_DOCUMENTS(expected[i], versioned_actual[i], "versioned, query "s + queries[i]);
+	}
+	const JoinedDocuments versioned_joined = ProcessQueriesJoined(versioned_server, queries);
+	ASSERT_EQUAL_DOCUMENTS(expected_joined, vector<Document>(versioned_joined.begin(), versioned_joined.end()),
+		"versioned joined"s);
+}
+
+void AssertQueryCacheStats(const SearchServer& search_server, uint64_t hit_count, uint64_t miss_count,
+	const string& hint) {
+	const QueryCacheStats stats = search_server.GetQueryCacheStats();
+	ASSERT_EQUAL_HINT(stats.hit_count, hit_count, hint);
+	ASSERT_EQUAL_HINT(stats.miss_count, miss_count, hint);
+}
+
+void TestQueryCache() {
+	SearchServer search_server("and in the"s);
+	SearchServer uncached_server("and in the"s);
+	const vector<pair<int, string>> documents = { { 1, "white cat and fancy collar"s }, { 2, "fluffy cat fluffy tail"s },
+		{ 3, "groomed dog expressive eyes"s }, { 4, "groomed starling evgeny"s }, { 5, "fluffy dog in the park"s } };
+	for (const auto& [id, text] : documents) {
+		search_server.AddDocument(id, text, DocumentStatus::ACTUAL, { id });
+		uncached_server.AddDocument(id, text, DocumentStatus::ACTUAL, { id });
+	}
+	AssertQueryCacheStats(search_server, 0, 0, "disabled"s);
+	search_server.FindTopDocuments("fluffy cat"s);
+	AssertQueryCacheStats(search_server, 0, 0, "disabled"s);
+
+	search_server.EnableQueryCache(100);
+	const auto assert_cached = [&](const string& query, uint64_t hit_count, uint64_t miss_count) {
+		ASSERT_EQUAL_DOCUMENTS(uncached_server.FindTopDocuments(query), search_server.FindTopDocuments(query),
+			"query "s + query);
+		AssertQueryCacheStats(search_server, hit_count, miss_count, "query "s + query);
+	};
+	assert_cached("fluffy groomed cat -collar"s, 0, 1);
+	assert_cached("fluffy groomed cat -collar"s, 1, 1);
+	// Word order, repeated words, stop words and the place of minus words don't change the key
+	assert_cached("cat groomed fluffy -collar"s, 2, 1);
+	assert_cached("-collar cat cat fluffy the groomed fluffy"s, 3, 1);
+	assert_cached("groomed -collar and cat -collar fluffy"s, 4, 1);
+	// Other minus words, statuses and options are other keys
+	assert_cached("fluffy groomed cat"s, 4, 2);
+	assert_cached("fluffy groomed cat -tail"s, 4, 3);
+	search_server.FindTopDocuments("fluffy groomed cat -collar"s, DocumentStatus::BANNED);
+	AssertQueryCacheStats(search_server, 4, 4, "banned status"s);
+	search_server.FindTopDocuments("fluffy groomed cat -collar"s, DocumentStatus::ACTUAL, SearchOptions(2));
+	AssertQueryCacheStats(search_server, 4, 5, "two results"s);
+	search_server.FindTopDocuments("fluffy groomed cat -collar"s, DocumentStatus::ACTUAL,
+		SearchOptions(5, EvaluationStrategy::QUANTIZED));
+	AssertQueryCacheStats(search_server, 4, 6, "quantized"s);
+	// Strategies giving exact results share the key
+	search_server.FindTopDocuments("cat fluffy groomed -collar"s, DocumentStatus::ACTUAL,
+		SearchOptions(5, EvaluationStrategy::MAX_SCORE));
+	AssertQueryCacheStats(search_server, 5, 6, "max score"s);
+
+	// Every modification invalidates the entries, the new results are cached again
+	search_server.AddDocument(6, "fluffy cat groomed"s, DocumentStatus::ACTUAL, { 6 });
+	uncached_server.AddDocument(6, "fluffy cat groomed"s, DocumentStatus::ACTUAL, { 6 });
+	assert_cached("fluffy groomed cat -collar"s, 5, 7);
+	ASSERT_EQUAL(search_server.FindTopDocuments("cat groomed fluffy -collar"s).front().id, 6);
+	AssertQueryCacheStats(search_server, 6, 7, "after AddDocument"s);
+	search_server.RemoveDocument(6);
+	uncached_server.RemoveDocument(6);
+	assert_cached("fluffy groomed cat -collar"s, 6, 8);
+	assert_cached("fluffy groomed cat -collar"s, 7, 8);
+	// Removing an absent document and compacting change no result, the entries stay valid
+	search_server.RemoveDocument(100);
+	search_server.Compact();
+	uncached_server.Compact();
+	assert_cached("fluffy groomed cat -collar"s, 8, 8);
+
+	// Batches go through the same entries
+	const vector<string> batch = { "fluffy groomed cat -collar"s, "-collar fluffy cat groomed"s, "starling"s };
+	const vector<vector<Document>> batch_results = search_server.FindTopDocumentsBatch(execution::par, batch);
+	AssertQueryCacheStats(search_server, 9, 9, "batch"s);
+	for (size_t i = 0; i < batch.size(); ++i) {
+		ASSERT_EQUAL_DOCUMENTS(uncached_server.FindTopDocuments(batch[i]), batch_results[i], "batch query "s + batch[i]);
+	}
+	assert_cached("starling"s, 10, 9);
+
+	// Copies share the cache, and a modified copy misses the entries of the original
+	SearchServer copy = search_server;
+	copy.FindTopDocuments("starling"s);
+	AssertQueryCacheStats(search_server, 11, 9, "copy"s);
+	copy.RemoveDocument(4);
+	copy.FindTopDocuments("starling"s);
+	AssertQueryCacheStats(search_server, 11, 10, "modified copy"s);
+	ASSERT(copy.FindTopDocuments("starling"s).empty());
+	AssertQueryCacheStats(search_server, 12, 10, "modified copy"s);
+	// The entry keeps the newest generation, so the original misses it from now on
+	assert_cached("starling"s, 12, 11);
+}
+
+set<string> GetWordSet(const SearchServer& search_server, int document_id) {
+	set<string> words;
+	for (const auto& [word, freq] : search_server.GetWordFrequencies(document_id)) {
+		words.emplace(word);
+	}
+	return words;
+}
+
+double ComputeJaccardSimilarity(const set<string>& lhs, const set<string>& rhs) {
+	vector<string> common;
+	set_intersection(lhs.begin(), lhs.end(), rhs.begin(), rhs.end(), back_inserter(common));
+	return static_cast<double>(common.size()) / (lhs.size() + rhs.size() - common.size());
+}
+
+// Documents in id order are duplicates when a kept one, that is an earlier non-duplicate, has the
+// same set of words, or a Jaccard similarity of at least the threshold
+vector<int> FindDuplicatesReference(const SearchServer& search_server, double similarity_threshold) {
+	vector<set<string>> kept;
+	vector<int> duplicates;
+	for (const int document_id : search_server) {
+		set<string> words = GetWordSet(search_server, document_id);
+		if (any_of(kept.begin(), kept.end(), [&words, similarity_threshold](const set<string>& kept_words) {
+			return ComputeJaccardSimilarity(words, kept_words) >= similarity_threshold;
+		})) {
+			duplicates.push_back(document_id);
+		}
+		else {
+			kept.push_back(move(words));
+		}
+	}
+	return duplicates;
+}
+
+void TestRemoveDuplicates() {
+	SearchServer search_server("and with"s);
+	mt19937 generator(47);
+	int next_unique_word = 0;
+	const auto make_words = [&next_unique_word](int count) {
+		vector<string> words;
+		for (int k = 0; k < count; ++k) {
+			words.push_back("u"s + to_string(next_unique_word++));
+		}
+		return words;
+	};
+	const auto join = [](const vector<string>& words) {
+		string text;
+		for (const string& word : words) {
+			text += (text.empty() ? ""s : " "s) + word;
+		}
+		return text;
+	};
+	// Groups have words of their own. Replacing one word of 20 leaves a similarity of 19/21 with the
+	// base and of 18/22 between two such variants, replacing five leaves 15/25
+	for (int group = 0; group < 30; ++group) {
+		const vector<string> base = make_words(20);
+		search_server.AddDocument(1000 + group * 10, join(base), DocumentStatus::ACTUAL, { 1 });
+		// Same words in another order, repeated and with stop words, under a lower id added later
+		vector<string> shuffled = base;
+		shuffle(shuffled.begin(), shuffled.end(), generator);
+		shuffled.push_back(base[0]);
+		shuffled.push_back("and"s);
+		if (group % 3 == 0) {
+			search_server.AddDocument(group, join(shuffled), DocumentStatus::BANNED, { 2 });
+		}
+		for (int variant = 1; variant <= 3; ++variant) {
+			vector<string> words = base;
+			const int replaced_count = group % 2 == 0 ? 1 : 5;
+			const vector<string> new_words = make_words(replaced_count);
+			copy(new_words.begin(), new_words.end(), words.begin() + variant);
+			search_server.AddDocument(1000 + group * 10 + variant, join(words), DocumentStatus::ACTUAL, { 3 });
+		}
+		if (group % 5 == 0) {
+			search_server.AddDocument(1000 + group * 10 + 5, join(shuffled), DocumentStatus::ACTUAL, { 4 });
+		}
+	}
+
+	const vector<int> expected_exact = FindDuplicatesReference(search_server, 1.0);
+	ASSERT(!expected_exact.empty());
+	ASSERT(FindDuplicates(search_server) == expected_exact);
+	// With a threshold of 1 near duplicates are exact ones, equal signatures share every band
+	ASSERT(FindDuplicates(search_server, DuplicateOptions(DuplicateMode::NEAR, 1.0)) == expected_exact);
+	const vector<int> expected_near = FindDuplicatesReference(search_server, 0.8);
+	ASSERT(expected_near.size() > expected_exact.size());
+	ASSERT(FindDuplicates(search_server, DuplicateOptions(DuplicateMode::NEAR, 0.8)) == expected_near);
+
+	// The lowest id of every set of equal words survives
+	for (int group = 0; group < 30; group += 3) {
+		ASSERT(!binary_search(expected_exact.begin(), expected_exact.end(), group));
+		ASSERT(binary_search(expected_exact.begin(), expected_exact.end(), 1000 + group * 10));
+	}
+
+	SearchServer near_server = search_server;
+	ostringstream report;
+	streambuf* const cout_buffer = cout.rdbuf(report.rdbuf());
+	RemoveDuplicates(search_server);
+	cout.rdbuf(cout_buffer);
+	string expected_report;
+	for (const int document_id : expected_exact) {
+		expected_report += "Found duplicate document id "s + to_string(document_id) + "\n"s;
+		ASSERT(search_server.GetWordFrequencies(document_id).empty());
+	}
+	ASSERT_EQUAL(report.str(), expected_report);
+	ASSERT(FindDuplicates(search_server).empty());
+
+	cout.rdbuf(report.rdbuf());
+	RemoveDuplicates(near_server, DuplicateOptions(DuplicateMode::NEAR, 0.8));
+	cout.rdbuf(cout_buffer);
+	ASSERT_EQUAL(static_cast<size_t>(near_server.GetDocumentCount()),
+		static_cast<size_t>(search_server.GetDocumentCount()) + expected_exact.size() - expected_near.size());
+	ASSERT(FindDuplicates(near_server, DuplicateOptions(DuplicateMode::NEAR, 0.8)).empty());
+}
+
+void TestMatchDocumentsMatchesMatchDocument() {
+	const TestCorpus corpus = GenerateTestCorpus(53, 1000);
+	SearchServer search_server("w4"s);
+	AddTestCorpus(search_server, corpus);
+	for (size_t i = 0; i < corpus.ids.size(); i += 9) {
+		search_server.RemoveDocument(corpus.ids[i]);
+	}
+	// Ids in descending order and repeated, the results follow them
+	vector<int> document_ids(search_server.begin(), search_server.end());
+	reverse(document_ids.begin(), document_ids.end());
+	document_ids.insert(document_ids.end(), document_ids.begin(), document_ids.begin() + 50);
+
+	vector<string> queries = corpus.queries;
+	queries.insert(queries.end(), { "w0 w1 -w2"s, "w4 w0"s, "-w0"s, "unknown w7"s });
+	bool is_minus_word_hit = false;
+	for (const string& query : queries) {
+		const auto seq_results = search_server.MatchDocuments(query, document_ids);
+		const auto par_results = search_server.MatchDocuments(execution::par, query, document_ids);
+		ASSERT_EQUAL(seq_results.size(), document_ids.size());
+		ASSERT_EQUAL(par_results.size(), document_ids.size());
+		for (size_t i = 0; i < document_ids.size(); ++i) {
+			const string hint = "query "s + query + ", document "s + to_string(document_ids[i]);
+			const auto expected = search_server.MatchDocument(query, document_ids[i]);
+			ASSERT_HINT(seq_results[i] == expected, hint);
+			ASSERT_HINT(par_results[i] == expected, hint);
+			ASSERT_HINT(search_server.MatchDocument(execution::par, query, document_ids[i]) == expected, hint);
+			const map<string_view, double>& word_frequencies = search_server.GetWordFrequencies(document_ids[i]);
+			is_minus_word_hit = is_minus_word_hit || (query == "w0 w1 -w2"s && get<0>(expected).empty()
+				&& word_frequencies.count("w0"sv) > 0 && word_frequencies.count("w2"sv) > 0);
+		}
+	}
+	ASSERT(is_minus_word_hit);
+
+	const int removed_id = corpus.ids[0];
+	for (const int unknown_id : { removed_id, -1, 1'000'000 }) {
+		const vector<int> ids_with_unknown = { document_ids[0], unknown_id, document_ids[1] };
+		const auto assert_throws = [&](const auto& match) {
+			bool is_thrown = false;
+			try {
+				match();
+			}
+			catch (const out_of_range&) {
+				is_thrown = true;
+			}
+			ASSERT_HINT(is_thrown, "id "s + to_string(unknown_id));
+		};
+		assert_throws([&]() { search_server.MatchDocuments("w0 w1"s, ids_with_unknown); });
+		assert_throws([&]() { search_server.MatchDocuments(execution::par, "w0 w1"s, ids_with_unknown); });
+		assert_throws([&]() { search_server.MatchDocument("w0 w1"s, unknown_id); });
+	}
+}
+
+void AssertEqualServers(const SearchServer& expected, const SearchServer& actual, const vector<string>& queries,
+	const string& hint) {
+	ASSERT_EQUAL_HINT(expected.GetDocumentCount(), actual.GetDocumentCount(), hint);
+	ASSERT_HINT(equal(expected.begin(), expected.end(), actual.begin(), actual.end()), hint);
+	for (const int document_id : expected) {
+		ASSERT_HINT(expected.GetWordFrequencies(document_id) == actual.GetWordFrequencies(document_id), hint);
+	}
+	for (const string& query : queries) {
+		ASSERT_EQUAL_DOCUMENTS(expected.FindTopDocuments(query, DocumentStatus::ACTUAL, UNBOUNDED),
+			actual.FindTopDocuments(query, DocumentStatus::ACTUAL, UNBOUNDED), hint + ", query "s + query);
+		ASSERT_EQUAL_DOCUMENTS(expected.FindTopDocuments(query, IsEvenRated, UNBOUNDED),
+			actual.FindTopDocuments(query, IsEvenRated, UNBOUNDED), hint + ", query "s + query);
+		for (const int document_id : expected) {
+			ASSERT_HINT(expected.MatchDocument(query, document_id) == actual.MatchDocument(query, document_id),
+				hint + ", query "s + query + ", document "s + to_string(document_id));
+		}
+	}
+}
+
+vector<DocumentInput> MakeDocumentInputs(const TestCorpus& corpus) {
+	vector<DocumentInput> documents;
+	for (size_t i = 0; i < corpus.ids.size(); ++i) {
+		documents.push_back({ corpus.ids[i], corpus.texts[i], corpus.statuses[i], corpus.ratings[i] });
+	}
+	return documents;
+}
+
+// Adds the documents one by one up to the first one rejected, as AddDocuments promises to
+SearchServer AddDocumentsOneByOne(const vector<DocumentInput>& documents) {
+	SearchServer search_server(""s);
+	for (const DocumentInput& document : documents) {
+		try {
+			search_server.AddDocument(document.id, document.text, document.status, document.ratings);
+		}
+		catch (const invalid_argument&) {
+			break;
+		}
+	}
+	return search_server;
+}
+
+void TestAddDocumentsMatchesAddDocument() {
+	const TestCorpus corpus = GenerateTestCorpus(11, 300);
+	const vector<DocumentInput> documents = MakeDocumentInputs(corpus);
+	const SearchServer expected = AddDocumentsOneByOne(documents);
+	SearchServer sequential_server(""s);
+	sequential_server.AddDocuments(execution::seq, documents);
+	AssertEqualServers(expected, sequential_server, corpus.queries, "sequential batch"s);
+	SearchServer parallel_server(""s);
+	parallel_server.AddDocuments(execution::par, documents);
+	AssertEqualServers(expected, parallel_server, corpus.queries, "parallel batch"s);
+
+	// A batch added to a server holding documents already
+	SearchServer split_server(""s);
+	split_server.AddDocuments(execution::par, vector<DocumentInput>(documents.begin(), documents.begin() + 100));
+	split_server.AddDocuments(execution::par, vector<DocumentInput>(documents.begin() + 100, documents.end()));
+	AssertEqualServers(expected, split_server, corpus.queries, "two batches"s);
+}
+
+void TestAddDocumentsKeepsValidPrefix() {
+	const TestCorpus corpus = GenerateTestCorpus(12, 300);
+	vector<DocumentInput> duplicate_id_batch = MakeDocumentInputs(corpus);
+	duplicate_id_batch[150].id = duplicate_id_batch[20].id;
+	vector<DocumentInput> invalid_word_batch = MakeDocumentInputs(corpus);
+	const string invalid_text = "w1 w\x01 w2"s;
+	invalid_word_batch[200].text = invalid_text;
+	vector<DocumentInput> negative_id_batch = MakeDocumentInputs(corpus);
+	negative_id_batch[0].id = -1;
+
+	for (const vector<DocumentInput>* documents : { &duplicate_id_batch, &invalid_word_batch, &negative_id_batch }) {
+		const SearchServer expected = AddDocumentsOneByOne(*documents);
+		for (const bool is_parallel : { false, true }) {
+			SearchServer search_server(""s);
+			bool is_thrown = false;
+			try {
+				if (is_parallel) {
+					search_server.AddDocuments(execution::par, *documents);
+				}
+				else {
+					search_server.AddDocuments(execution::seq, *documents);
+				}
+			}
+			catch (const invalid_argument&) {
+				is_thrown = true;
+			}
+			const string hint = "prefix of "s + to_string(expected.GetDocumentCount())
+				+ (is_parallel ? ", parallel"s : ", sequential"s);
+			ASSERT_HINT(is_thrown, hint);
+			AssertEqualServers(expected, search_server, corpus.queries, hint);
+		}
+	}
+}
+
+// Ids added in any order are listed and found as ids added in ascending order are, also after the
+// entries inserted out of order are merged with the others
+void TestDocumentIdsInAnyOrder() {
+	const TestCorpus corpus = GenerateTestCorpus(29, 1500);
+	const vector<DocumentInput> documents = MakeDocumentInputs(corpus);
+	const SearchServer expected = AddDocumentsOneByOne(documents);
+
+	vector<DocumentInput> shuffled = documents;
+	shuffle(shuffled.begin(), shuffled.end(), mt19937(29));
+	const SearchServer one_by_one = AddDocumentsOneByOne(shuffled);
+	AssertEqualServers(expected, one_by_one, corpus.queries, "one by one"s);
+
+	// Batches below, between and above the present ids
+	SearchServer batched(""s);
+	for (size_t first = 0; first < shuffled.size(); first += 250) {
+		const size_t last = min(first + 250, shuffled.size());
+		batched.AddDocuments(execution::seq, vector<DocumentInput>(shuffled.begin() + first, shuffled.begin() + last));
+	}
+	AssertEqualServers(expected, batched, corpus.queries, "batched"s);
+}
+
+// A batch of writes is published as one version, readers of the earlier version don't see it
+void TestVersionedBatches() {
+	const TestCorpus corpus = GenerateTestCorpus(23, 600);
+	const vector<DocumentInput> documents = MakeDocumentInputs(corpus);
+	const vector<DocumentInput> first_batch(documents.begin(), documents.begin() + 400);
+	SearchServer expected_server(""s);
+	expected_server.AddDocuments(execution::seq, first_batch);
+
+	VersionedSearchServer search_server{ SearchServer(""s) };
+	search_server.AddDocuments(execution::par, first_batch);
+	const shared_ptr<const SearchServer> first_version = search_server.Acquire();
+	AssertEqualServers(expected_server, *first_version, corpus.queries, "first batch"s);
+
+	vector<int> removed_ids;
+	for (size_t i = 0; i < first_batch.size(); i += 3) {
+		removed_ids.push_back(first_batch[i].id);
+	}
+	search_server.Update([&documents, &removed_ids](SearchServer& server) {
+		server.AddDocuments(execution::seq, vector<DocumentInput>(documents.begin() + 400, documents.end()));
+		server.RemoveDocuments(removed_ids);
+	});
+	search_server.RemoveDocuments({ documents.back().id });
+	expected_server.AddDocuments(execution::seq, vector<DocumentInput>(documents.begin() + 400, documents.end()));
+	expected_server.RemoveDocuments(removed_ids);
+	expected_server.RemoveDocument(documents.back().id);
+	AssertEqualServers(expected_server, *search_server.Acquire(), corpus.queries, "later batches"s);
+	ASSERT_EQUAL(first_version->GetDocumentCount(), first_batch.size());
+}
+
+// Removes the file when the test is done with it, also when it fails
+class TemporaryFile {
+public:
+	explicit TemporaryFile(const string& name)
+		: path_((filesystem::temp_directory_path() / name).string())
+	{}
+
+	~TemporaryFile() {
+		error_code error;
+		filesystem::remove(path_, error);
+	}
+
+	const string& GetPath() const { return path_; }
+
+private:
+	string path_;
+};
+
+void TestSnapshotRoundTrip() {
+	const TemporaryFile file("search_server_tests_round_trip.snapshot"s);
+	for (const IndexMode index_mode : { IndexMode::FLAT, IndexMode::COMPRESSED }) {
+		const TestCorpus corpus = GenerateTestCorpus(13, 400);
+		const vector<DocumentInput> documents = MakeDocumentInputs(corpus);
+		SearchServer search_server("w3 w5"s, index_mode);
+		search_server.AddDocuments(execution::seq, vector<DocumentInput>(documents.begin(), documents.begin() + 300));
+		for (size_t i = 0; i < 300; i += 5) {
+			search_server.RemoveDocument(documents[i].id);
+		}
+		search_server.Compact(20);
+		search_server.SaveSnapshot(file.GetPath());
+		SearchServer opened_server = SearchServer::OpenSnapshot(file.GetPath());
+		const string hint = index_mode == IndexMode::FLAT ? "flat"s : "compressed"s;
+		AssertEqualServers(search_server, opened_server, corpus.queries, hint);
+
+		// Writes copy the snapshot to the heap and go on from where the saved server was
+		for (SearchServer* server : { &search_server, &opened_server }) {
+			server->AddDocuments(execution::par, vector<DocumentInput>(documents.begin() + 300, documents.end()));
+			for (size_t i = 1; i < documents.size(); i += 9) {
+				server->RemoveDocument(documents[i].id);
+			}
+			server->AddDocument(documents[0].id, documents[1].text, documents[1].status, documents[1].ratings);
+			server->Compact();
+		}
+		AssertEqualServers(search_server, opened_server, corpus.queries, hint + " after writes"s);
+	}
+
+	// Quantization is scaled by the largest term frequency the index held, even when the term
+	// holding it is gone, so the opened server rounds impacts as the saved one does
+	const TestCorpus corpus = GenerateTestCorpus(17, 1000);
+	SearchServer search_server(""s);
+	AddTestCorpus(search_server, corpus);
+	search_server.AddDocument(1'000'000, "solitary"s, DocumentStatus::ACTUAL, { 1 });
+	search_server.RemoveDocument(1'000'000);
+	search_server.Compact();
+	search_server.SaveSnapshot(file.GetPath());
+	const SearchServer opened_server = SearchServer::OpenSnapshot(file.GetPath());
+	for (const EvaluationStrategy strategy : { EvaluationStrategy::QUANTIZED, EvaluationStrategy::IMPACT_ORDERED }) {
+		for (const string& query : corpus.queries) {
+			const SearchOptions options(3, strategy);
+			ASSERT_EQUAL_DOCUMENTS(search_server.FindTopDocuments(query, DocumentStatus::ACTUAL, options),
+				opened_server.FindTopDocuments(query, DocumentStatus::ACTUAL, options), "quantized, query "s + query);
+		}
+	}
+}
+
+void TestWritesAfterOpenSnapshot() {
+	const TemporaryFile file("search_server_tests_writes.snapshot"s);
+	{
+		SearchServer search_server("and in"s);
+		search_server.AddDocument(1, "white cat and fashionable collar"s, DocumentStatus::ACTUAL, { 8, -3 });
+		search_server.AddDocument(2, "fluffy cat fluffy tail"s, DocumentStatus::ACTUAL, { 7, 2, 7 });
+		search_server.SaveSnapshot(file.GetPath());
+	}
+	const map<string, double> expected_frequencies = { { "cat"s, 0.25 }, { "collar"s, 0.25 },
+		{ "fashionable"s, 0.25 }, { "white"s, 0.25 } };
+	const auto word_frequencies = [](const SearchServer& search_server, int document_id) {
+		const map<string_view, double>& frequencies = search_server.GetWordFrequencies(document_id);
+		return map<string, double>(frequencies.begin(), frequencies.end());
+	};
+
+	// Rejected writes leave the server reading the mapping, the next write copies the whole of it
+	SearchServer search_server = SearchServer::OpenSnapshot(file.GetPath());
+	bool is_thrown = false;
+	try {
+		search_server.AddDocument(1, "grey cat"s, DocumentStatus::ACTUAL, { 1 });
+	}
+	catch (const invalid_argument&) {
+		is_thrown = true;
+	}
+	ASSERT(is_thrown);
+	search_server.RemoveDocument(5);
+	search_server.RemoveDocuments({ 6, 7 });
+	ASSERT_EQUAL(search_server.Compact(), 0u);
+	ASSERT(word_frequencies(search_server, 1) == expected_frequencies);
+	search_server.AddDocument(3, "groomed dog expressive eyes"s, DocumentStatus::ACTUAL, { 5, -12, 2, 1 });
+	ASSERT(word_frequencies(search_server, 1) == expected_frequencies);
+	search_server.RemoveDocument(2);
+	ASSERT(word_frequencies(search_server, 1) == expected_frequencies);
+	ASSERT_EQUAL(search_server.GetDocumentCount(), 2u);
+	const vector<Document> documents = search_server.FindTopDocuments("fluffy groomed cat"s);
+	ASSERT_EQUAL(documents.size(), 2u);
+	// Equally relevant, the rating decides
+	ASSERT_EQUAL(documents[0].id, 1);
+	ASSERT_EQUAL(documents[1].id, 3);
+}
+
+// Removed documents and their compaction change no result of the exact strategies: the server
+// answers as one holding only the live documents does, also after removed ids are added again
+void WriteFile(const string& path, const string& contents) {
+	ofstream out(path, ios::binary);
+	out << contents;
+}
+
+void AssertEqualDocumentInputs(const vector<DocumentInput>& expected, const vector<DocumentInput>& actual,
+	const string& hint) {
+	ASSERT_EQUAL_HINT(expected.size(), actual.size(), hint);
+	for (size_t i = 0; i < expected.size(); ++i) {
+		ASSERT_EQUAL_HINT(expected[i].id, actual[i].id, hint);
+		ASSERT_EQUAL_HINT(expected[i].text, actual[i].text, hint);
+		ASSERT_HINT(expected[i].status == actual[i].status, hint);
+		ASSERT_HINT(expected[i].ratings == actual[i].ratings, hint);
+	}
+}
+
+void TestCorpusLoader() {
+	ASSERT(ParseCorpus(""sv).empty());
+	ASSERT(ParseCorpus("\n\r\n\n"sv).empty());
+
+	const string corpus = "1\tACTUAL\t5 -2\tfluffy cat\n"s
+		"\n"s
+		"7\tBANNED\t 3  4 \tgroomed dog\n"s
+		"3\tIRRELEVANT\t0\t\n"s
+		"2\tREMOVED\t-1\tlast line without a break"s;
+	const vector<DocumentInput> documents = ParseCorpus(corpus);
+	const vector<DocumentInput> expected = {
+		{ 1, "fluffy cat"sv, DocumentStatus::ACTUAL, { 5, -2 } },
+		{ 7, "groomed dog"sv, DocumentStatus::BANNED, { 3, 4 } },
+		{ 3, ""sv, DocumentStatus::IRRELEVANT, { 0 } },
+		{ 2, "last line without a break"sv, DocumentStatus::REMOVED, { -1 } },
+	};
+	AssertEqualDocumentInputs(expected, documents, "LF"s);
+	string crlf_corpus;
+	for (const char c : corpus) {
+		crlf_corpus += c == '\n' ? "\r\n"s : string(1, c);
+	}
+	AssertEqualDocumentInputs(expected, ParseCorpus(crlf_corpus), "CRLF"s);
+
+	const vector<pair<string, string>> malformed_lines = {
+		{ "1\tACTUAL\t5"s, "without text"s },
+		{ "1 ACTUAL 5 text"s, "without tabs"s },
+		{ "x1\tACTUAL\t5\ttext"s, "invalid id"s },
+		{ "99999999999\tACTUAL\t5\ttext"s, "id out of range"s },
+		{ "\tACTUAL\t5\ttext"s, "empty id"s },
+		{ "1\tactual\t5\ttext"s, "invalid status"s },
+		{ "1\tACTUAL\t5 x\ttext"s, "invalid rating"s },
+		{ "1\tACTUAL\t \ttext"s, "no ratings"s },
+	};
+	for (const auto& [line, hint] : malformed_lines) {
+		bool is_thrown = false;
+		try {
+			ParseCorpus("1\tACTUAL\t5\tfirst\r\n\r\n"s + line + "\r\n"s, 10);
+		}
+		catch (const invalid_argument& error) {
+			is_thrown = true;
+			ASSERT_HINT(string(error.what()).find("line 12"s) != string::npos, hint + ": "s + error.what());
+		}
+		ASSERT_HINT(is_thrown, hint);
+	}
+
+	const TemporaryFile file("search_server_tests_corpus.txt"s);
+	WriteFile(file.GetPath(), ""s);
+	SearchServer empty_server(""s);
+	const CorpusLoadStats empty_stats = LoadCorpus(empty_server, file.GetPath());
+	ASSERT_EQUAL(empty_stats.byte_count, 0u);
+	ASSERT_EQUAL(empty_stats.document_count, 0u);
+	ASSERT_EQUAL(empty_server.GetDocumentCount(), 0u);
+
+	SearchServer expected_server(""s);
+	for (const DocumentInput& document : expected) {
+		expected_server.AddDocument(document.id, document.text, document.status, document.ratings);
+	}
+	for (const string& contents : { corpus, crlf_corpus }) {
+		WriteFile(file.GetPath(), contents);
+		SearchServer search_server(""s);
+		const CorpusLoadStats stats = LoadCorpus(search_server, file.GetPath());
+		ASSERT_EQUAL(stats.byte_count, contents.size());
+		ASSERT_EQUAL(stats.document_count, expected.size());
+		AssertEqualServers(expected_server, search_server, { "fluffy groomed"s, "dog -cat"s, "line"s }, "loaded"s);
+	}
+
+	// The documents before a malformed line or an invalid document are added, and the error is thrown
+	for (const string& bad_line : { "8\tACTUAL\tfive\ttext\r\n"s, "8\tACTUAL\t5\tcontrol\x01 character\r\n"s,
+		"1\tACTUAL\t5\trepeated id\r\n"s }) {
+		WriteFile(file.GetPath(), crlf_corpus + "\r\n"s + bad_line + "9\tACTUAL\t1\tafter\r\n"s);
+		SearchServer search_server(""s);
+		bool is_thrown = false;
+		try {
+			LoadCorpus(search_server, file.GetPath());
+		}
+		catch (const invalid_argument&) {
+			is_thrown = true;
+		}
+		ASSERT_HINT(is_thrown, bad_line);
+		AssertEqualServers(expected_server, search_server, { "fluffy groomed"s, "after"s }, bad_line);
+	}
+}
+
+void TestCompactAndReAdd() {
+	const TestCorpus corpus = GenerateTestCorpus(17, 1500);
+	const vector<DocumentInput> documents = MakeDocumentInputs(corpus);
+	const auto make_fresh_server = [](const vector<DocumentInput>& live_documents) {
+		SearchServer search_server(""s);
+		search_server.AddDocuments(execution::seq, live_documents);
+		return search_server;
+	};
+
+	SearchServer search_server(""s);
+	search_server.AddDocuments(execution::seq, documents);
+	vector<DocumentInput> live_documents;
+	vector<DocumentInput> removed_documents;
+	// Every document holding the most frequent word goes away, which reorders the other words by frequency
+	for (size_t i = 0; i < documents.size(); ++i) {
+		if ((" "s + string(documents[i].text) + " "s).find(" w0 "s) != string::npos || i % 4 == 0) {
+			search_server.RemoveDocument(documents[i].id);
+			removed_documents.push_back(documents[i]);
+		}
+		else {
+			live_documents.push_back(documents[i]);
+		}
+	}
+	AssertEqualServers(make_fresh_server(live_documents), search_server, corpus.queries, "before compaction"s);
+	search_server.Compact(removed_documents.size() / 2);
+	AssertEqualServers(make_fresh_server(live_documents), search_server, corpus.queries, "partial compaction"s);
+	search_server.Compact();
+	AssertEqualServers(make_fresh_server(live_documents), search_server, corpus.queries, "full compaction"s);
+
+	// The removed ids come back with the texts of other documents
+	for (size_t i = 0; i < removed_documents.size(); ++i) {
+		DocumentInput& document = removed_documents[i];
+		document.text = documents[(i * 7 + 1) % documents.size()].text;
+		search_server.AddDocument(document.id, document.text, document.status, document.ratings);
+		live_documents.push_back(document);
+	}
+	sort(live_documents.begin(), live_documents.end(), [](const DocumentInput& lhs, const DocumentInput& rhs) {
+		return lhs.id < rhs.id;
+	});
+	AssertEqualServers(make_fresh_server(live_documents), search_server, corpus.queries, "re-added"s);
+}
+
+// Removed ids stay in the id index until Compact, listing skips them and adding them again takes
+// their entries over
+void TestReAddBeforeCompact() {
+	const TestCorpus corpus = GenerateTestCorpus(31, 600);
+	const vector<DocumentInput> documents = MakeDocumentInputs(corpus);
+	SearchServer search_server(""s);
+	search_server.AddDocuments(execution::seq, documents);
+	vector<DocumentInput> live_documents;
+	vector<DocumentInput> batch;
+	for (size_t i = 0; i < documents.size(); ++i) {
+		if (i % 2 == 1) {
+			live_documents.push_back(documents[i]);
+			continue;
+		}
+		search_server.RemoveDocument(documents[i].id);
+		DocumentInput document = documents[i];
+		document.text = documents[(i + 1) % documents.size()].text;
+		if (i % 8 == 0) {
+			search_server.AddDocument(document.id, document.text, document.status, document.ratings);
+			live_documents.push_back(document);
+		}
+		else if (i % 8 == 4) {
+			batch.push_back(document);
+		}
+	}
+	ASSERT_EQUAL(search_server.GetDocumentCount(), live_documents.size());
+	search_server.AddDocuments(execution::par, batch);
+	live_documents.insert(live_documents.end(), batch.begin(), batch.end());
+	sort(live_documents.begin(), live_documents.end(), [](const DocumentInput& lhs, const DocumentInput& rhs) {
+		return lhs.id < rhs.id;
+	});
+	SearchServer expected(""s);
+	expected.AddDocuments(execution::seq, live_documents);
+	AssertEqualServers(expected, search_server, corpus.queries, "before compaction"s);
+	search_server.Compact();
+	ASSERT_EQUAL(search_server.GetRemovedDocumentCount(), 0u);
+	AssertEqualServers(expected, search_server, corpus.queries, "after compaction"s);
+}
+
+// Words of documents that come and go don't pile up: a full compaction moves the live terms to a
+// new pool. Word maps built before it and copies of the server made before it stay valid
+void TestCompactReclaimsTerms() {
+	InvertedIndex index;
+	for (int cycle = 0; cycle < 50; ++cycle) {
+		vector<int> term_ids;
+		for (int i = 0; i < 1000; ++i) {
+			term_ids.push_back(index.AddTerm("cycle"s + to_string(cycle) + "_word"s + to_string(i)));
+			index.AddPosting(term_ids.back(), i, 1, 1);
+		}
+		for (int i = 0; i < 1000; ++i) {
+			index.MarkPostingRemoved(term_ids[i]);
+			index.PurgePostings(term_ids[i], { i });
+			index.RemoveTerm(term_ids[i]);
+		}
+		index.ReclaimTerms();
+	}
+	// The words of a single cycle take about 16 KB, of all the cycles about 800 KB
+	ASSERT(index.GetTermsMemoryUsage() <= 2 * 64 * 1024);
+
+	const TestCorpus corpus = GenerateTestCorpus(19, 500);
+	SearchServer fresh_server(""s);
+	AddTestCorpus(fresh_server, corpus);
+	SearchServer search_server(""s);
+	AddTestCorpus(search_server, corpus);
+	for (const int document_id : search_server) {
+		search_server.GetWordFrequencies(document_id);
+	}
+	optional<SearchServer> earlier_server(search_server);
+	for (int i = 0; i < 200; ++i) {
+		const int document_id = 100'000 + i;
+		search_server.AddDocument(document_id, "unique"s + to_string(i) + " w1 another_unique"s + to_string(i),
+			DocumentStatus::ACTUAL, { 1 });
+		search_server.RemoveDocument(document_id);
+	}
+	search_server.Compact();
+	AssertEqualServers(fresh_server, *earlier_server, corpus.queries, "copy made before compaction"s);
+	// Frees the old pool
+	earlier_server.reset();
+	AssertEqualServers(fresh_server, search_server, corpus.queries, "compacted"s);
+
+	// Without copies the maps are rebuilt in place, references taken before stay valid
+	SearchServer unshared_server(""s);
+	AddTestCorpus(unshared_server, corpus);
+	vector<const map<string_view, double>*> word_frequencies;
+	for (const int document_id : unshared_server) {
+		word_frequencies.push_back(&unshared_server.GetWordFrequencies(document_id));
+	}
+	for (int i = 0; i < 200; ++i) {
+		const int document_id = 100'000 + i;
+		unshared_server.AddDocument(document_id, "unique"s + to_string(i) + " w1"s, DocumentStatus::ACTUAL, { 1 });
+		unshared_server.RemoveDocument(document_id);
+	}
+	unshared_server.Compact();
+	size_t position = 0;
+	for (const int document_id : fresh_server) {
+		ASSERT_HINT(*word_frequencies[position] == fresh_server.GetWordFrequencies(document_id),
+			"word frequencies of document "s + to_string(document_id));
+		ASSERT(word_frequencies[position] == &unshared_server.GetWordFrequencies(document_id));
+		++position;
+	}
+}
+
+void TestPagesFollowFullRanking() {
+	for (uint32_t seed = 1; seed <= 10; ++seed) {
+		const TestCorpus corpus = GenerateTestCorpus(seed, 2000);
+		SearchServer search_server(""s);
+		AddTestCorpus(search_server, corpus);
+		for (const string& query : corpus.queries) {
+			const vector<Document> expected = search_server.FindTopDocuments(query, DocumentStatus::ACTUAL, UNBOUNDED);
+			for (const size_t page_size : { 3, 7 }) {
+				vector<Document> paged;
+				for (const auto page : search_server.PaginateTopDocuments(query, DocumentStatus::ACTUAL, page_size)) {
+					paged.insert(paged.end(), page.begin(), page.end());
+				}
+				ASSERT_EQUAL_DOCUMENTS(expected, paged, "seed "s + to_string(seed) + ", query "s + query
+					+ ", page size "s + to_string(page_size));
+			}
+
+			optional<SearchCursor> cursor;
+			vector<Document> parallel_paged;
+			do {
+				ResultPage page = search_server.FindTopDocumentsPage(execution::par, query, DocumentStatus::ACTUAL, 5, cursor);
+				parallel_paged.insert(parallel_paged.end(), page.documents.begin(), page.documents.end());
+				cursor = page.next;
+			} while (cursor);
+			ASSERT_EQUAL_DOCUMENTS(expected, parallel_paged, "parallel pages, query "s + query);
+		}
+	}
+}
+
+}  // namespace
+
+int main() {
+	RUN_TEST(TestTokenizerMatchesReference);
+	RUN_TEST(TestConcurrentMap);
+	RUN_TEST(TestMaxScoreMatchesExhaustive);
+	RUN_TEST(TestQuantizedMatchesExhaustive);
+	RUN_TEST(TestCompressedMatchesFlat);
+	RUN_TEST(TestIntersectionMatchesSetIntersection);
+	RUN_TEST(TestConjunctiveMatchesFilteredExhaustive);
+	RUN_TEST(TestParallelMatchesSequential);
+	RUN_TEST(TestProcessQueriesMatchesFindTopDocuments);
+	RUN_TEST(TestQueryCache);
+	RUN_TEST(TestRemoveDuplicates);
+	RUN_TEST(TestMatchDocumentsMatchesMatchDocument);
+	RUN_TEST(TestAddDocumentsMatchesAddDocument);
+	RUN_TEST(TestAddDocumentsKeepsValidPrefix);
+	RUN_TEST(TestDocumentIdsInAnyOrder);
+	RUN_TEST(TestVersionedBatches);
+	RUN_TEST(TestSnapshotRoundTrip);
+	RUN_TEST(TestWritesAfterOpenSnapshot);
+	RUN_TEST(TestCorpusLoader);
+	RUN_TEST(TestCompactAndReAdd);
+	RUN_TEST(TestReAddBeforeCompact);
+	RUN_TEST(TestCompactReclaimsTerms);
+	RUN_TEST(TestPagesFollowFullRanking);
+	cerr << "All tests passed"s << endl;
+	return 0;
+}
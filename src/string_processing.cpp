@@ -1,20 +1,104 @@
 ﻿#include <cstddef>
 
+#if defined(__AVX2__) || defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define SEARCH_SERVER_SSE2
+#include <immintrin.h>
+#endif
+#if defined(_MSC_VER)
+#include <intrin.h>
+#endif
+
 #include "string_processing.h"
 
-std::vector<std::string_view> SplitIntoWords(std::string_view text) {
-	std::vector<std::string_view> result;
+namespace {
+
+#if defined(SEARCH_SERVER_SSE2)
+int CountTrailingZeros(unsigned int mask) {
+#if defined(_MSC_VER)
+	unsigned long index;
+	_BitScanForward(&index, mask);
+	return static_cast<int>(index);
+#else
+	return __builtin_ctz(mask);
+#endif
+}
+#endif
+
+// First space or control character, that is the first byte not above the space as unsigned
+const char* FindDelimiter(const char* first, const char* last) {
+#if defined(__AVX2__)
+	const __m256i space32 = _mm256_set1_epi8(' ');
+	for (; last - first >= 32; first += 32) {
+		const __m256i bytes = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(first));
+		const unsigned int mask = static_cast<unsigned int>(
+			_mm256_movemask_epi8(_mm256_cmpeq_epi8(_mm256_min_epu8(bytes, space32), bytes)));
+		if (mask != 0) {
+			return first + CountTrailingZeros(mask);
+		}
+	}
+#endif
+#if defined(SEARCH_SERVER_SSE2)
+	const __m128i space16 = _mm_set1_epi8(' ');
+	for (; last - first >= 16; first += 16) {
+		const __m128i bytes = _mm_loadu_si128(reinterpret_cast<const __m128i*>(first));
+		const unsigned int mask = static_cast<unsigned int>(
+			_mm_movemask_epi8(_mm_cmpeq_epi8(_mm_min_epu8(bytes, space16), bytes)));
+		if (mask != 0) {
+			return first + CountTrailingZeros(mask);
+		}
+	}
+#endif
+	for (; first != last; ++first) {
+		if (static_cast<unsigned char>(*first) <= ' ') {
+			return first;
+		}
+	}
+	return last;
+}
+
+}  // namespace
+
+bool WordTokenizer::Next() {
+	while (position_ != end_ && *position_ == ' ') {
+		++position_;
+	}
+	if (position_ == end_) {
+		return false;
+	}
+	const char* const word_begin = position_;
+	is_word_valid_ = true;
 	while (true) {
-		const std::string_view::size_type space = text.find(' ');
-		if (space == text.npos) {
-			result.push_back(text.substr());
+		position_ = FindDelimiter(position_, end_);
+		if (position_ == end_ || *position_ == ' ') {
 			break;
 		}
-		else {
-			result.push_back(text.substr(0, space));
-			text.remove_prefix(space + 1);
+		is_word_valid_ = false;
+		++position_;
+	}
+	word_ = std::string_view(word_begin, static_cast<std::size_t>(position_ - word_begin));
+	return true;
+}
+
+bool IsValidWord(std::string_view word) {
+	// Spaces are the only delimiters that a valid word may hold
+	const char* const last = word.data() + word.size();
+	for (const char* it = FindDelimiter(word.data(), last); it != last; it = FindDelimiter(it + 1, last)) {
+		if (*it != ' ') {
+			return false;
 		}
 	}
+	return true;
+}
 
+std::vector<std::string_view> SplitIntoWords(std::string_view text) {
+	std::vector<std::string_view> result;
+	SplitIntoWords(text, result);
 	return result;
+}
+
+void SplitIntoWords(std::string_view text, std::vector<std::string_view>& words) {
+	words.clear();
+	for (WordTokenizer tokenizer(text); tokenizer.Next();) {
+		words.push_back(tokenizer.GetWord());
+	}
 }
\ No newline at end of file
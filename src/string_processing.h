@@ -3,4 +3,34 @@
 #include <vector>
 #include <string_view>
 
-std::vector<std::string_view> SplitIntoWords(std::string_view text);
\ No newline at end of file
+// Splits a text into the words between spaces without allocating. Empty words are skipped, and
+// control characters are found in the same pass over the text
+class WordTokenizer {
+public:
+	explicit WordTokenizer(std::string_view text)
+		: position_(text.data())
+		, end_(text.data() + text.size())
+	{}
+
+	// Moves to the next word, returns false when there are no words left
+	bool Next();
+
+	std::string_view GetWord() const { return word_; }
+
+	// False when the word holds control characters
+	bool IsWordValid() const { return is_word_valid_; }
+
+private:
+	const char* position_;
+	const char* end_;
+	std::string_view word_;
+	bool is_word_valid_ = true;
+};
+
+// A word is valid when it holds no control characters
+bool IsValidWord(std::string_view word);
+
+std::vector<std::string_view> SplitIntoWords(std::string_view text);
+
+// Replaces the contents of words, so the buffer can be reused between texts
+void SplitIntoWords(std::string_view text, std::vector<std::string_view>& words);
\ No newline at end of file
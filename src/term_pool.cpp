@@ -0,0 +1,27 @@
+#include <algorithm>
+
+#include "term_pool.h"
+
+TermPool::TermPool(const TermPool& other)
+	: blocks_(other.blocks_)
+	, memory_usage_(other.memory_usage_)
+	, size_(other.size_)
+{
+	// The rest of the last block may be filled by the other pool later
+}
+
+std::string_view TermPool::Add(std::string_view term) {
+	if (term.size() > free_size_) {
+		const std::size_t block_size = std::max(BLOCK_SIZE, term.size());
+		blocks_.emplace_back(new char[block_size]);
+		free_ = blocks_.back().get();
+		free_size_ = block_size;
+		memory_usage_ += block_size;
+	}
+	char* const stored_term = free_;
+	std::copy(term.begin(), term.end(), stored_term);
+	free_ += term.size();
+	free_size_ -= term.size();
+	size_ += term.size();
+	return { stored_term, term.size() };
+}
@@ -0,0 +1,35 @@
+#pragma once
+
+#include <cstddef>
+#include <memory>
+#include <string_view>
+#include <vector>
+
+// Append-only storage of term strings. Strings are bump allocated from large blocks and never
+// move. Copies of a pool share the blocks filled so far and append to blocks of their own. Space
+// of strings no longer needed is reclaimed only by moving the needed ones to a new pool.
+class TermPool {
+public:
+	TermPool() = default;
+
+	TermPool(const TermPool& other);
+
+	TermPool& operator=(const TermPool&) = delete;
+
+	// The returned view stays valid while any copy of the pool is alive
+	std::string_view Add(std::string_view term);
+
+	std::size_t GetMemoryUsage() const { return memory_usage_; }
+
+	// Total length of the added strings
+	std::size_t GetSize() const { return size_; }
+
+private:
+	static constexpr std::size_t BLOCK_SIZE = 64 * 1024;
+
+	std::vector<std::shared_ptr<char[]>> blocks_;
+	char* free_ = nullptr;
+	std::size_t free_size_ = 0;
+	std::size_t memory_usage_ = 0;
+	std::size_t size_ = 0;
+};
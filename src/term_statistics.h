@@ -0,0 +1,9 @@
+#pragma once
+
+// Statistics of a term for the current document count, computed on demand from the live posting
+// count and the largest term frequency the index keeps for every term
+struct TermStatistics {
+	double inverse_document_freq = 0.0;
+	// Upper bound of the contribution of the term to the relevance of a document
+	double max_score = 0.0;
+};
@@ -0,0 +1,101 @@
+#include <algorithm>
+#include <cmath>
+#include <numeric>
+#include <thread>
+
+#include "top_documents.h"
+
+namespace {
+
+const std::size_t MIN_DOCUMENTS_PER_CHUNK = 4096;
+// Larger heaps, e.g. of unbounded result counts, grow as documents come
+const std::size_t MAX_RESERVED_COUNT = 1024;
+
+}  // namespace
+
+bool IsMoreRelevant(const Document& lhs, const Document& rhs) {
+	const double lhs_step = std::floor(lhs.relevance / RELEVANCE_EPSILON);
+	const double rhs_step = std::floor(rhs.relevance / RELEVANCE_EPSILON);
+	if (lhs_step != rhs_step) {
+		return lhs_step > rhs_step;
+	}
+	if (lhs.rating != rhs.rating) {
+		return lhs.rating > rhs.rating;
+	}
+	return lhs.id < rhs.id;
+}
+
+TopDocuments::TopDocuments(std::size_t max_count)
+	: max_count_(max_count)
+{
+	heap_.reserve(std::min(max_count, MAX_RESERVED_COUNT));
+}
+
+void TopDocuments::Add(const Document& document) {
+	if (heap_.size() < max_count_) {
+		heap_.push_back(document);
+		std::push_heap(heap_.begin(), heap_.end(), IsMoreRelevant);
+	}
+	else if (max_count_ > 0 && IsMoreRelevant(document, heap_.front())) {
+		std::pop_heap(heap_.begin(), heap_.end(), IsMoreRelevant);
+		heap_.back() = document;
+		std::push_heap(heap_.begin(), heap_.end(), IsMoreRelevant);
+	}
+}
+
+void TopDocuments::Merge(const TopDocuments& other) {
+	for (const Document& document : other.heap_) {
+		Add(document);
+	}
+}
+
+bool TopDocuments::IsFull() const {
+	return heap_.size() == max_count_;
+}
+
+const Document& TopDocuments::GetLeastRelevant() const {
+	return heap_.front();
+}
+
+std::vector<Document> TopDocuments::Extract() && {
+	std::sort_heap(heap_.begin(), heap_.end(), IsMoreRelevant);
+	return std::move(heap_);
+}
+
+std::vector<Document> SelectTopDocuments(std::execution::sequenced_policy,
+	const std::vector<Document>& documents, std::size_t max_count) {
+	TopDocuments top_documents(max_count);
+	for (const Document& document : documents) {
+		top_documents.Add(document);
+	}
+	return std::move(top_documents).Extract();
+}
+
+std::vector<Document> SelectTopDocuments(std::execution::parallel_policy policy,
+	const std::vector<Document>& documents, std::size_t max_count) {
+	const std::size_t chunk_count = std::min<std::size_t>(
+		std::max(1u, std::thread::hardware_concurrency()),
+		documents.size() / MIN_DOCUMENTS_PER_CHUNK + 1);
+	if (chunk_count == 1) {
+		return SelectTopDocuments(std::execution::seq, documents, max_count);
+	}
+
+	std::vector<std::size_t> chunks(chunk_count);
+	std::iota(chunks.begin(), chunks.end(), 0);
+	std::vector<TopDocuments> chunk_tops(chunk_count, TopDocuments(max_count));
+	std::for_each(policy, chunks.begin(), chunks.end(),
+		[&documents, &chunk_tops, chunk_count](std::size_t chunk) {
+			const std::size_t first = documents.size() * chunk / chunk_count;
+			const std::size_t last = documents.size() * (chunk + 1) / chunk_count;
+			for (std::size_t i = first; i < last; ++i) {
+				chunk_tops[chunk].Add(documents[i]);
+			}
+		}
+	);
+
+	TopDocuments top_documents(max_count);
+	for (const TopDocuments& chunk_top : chunk_tops) {
+		top_documents.Merge(chunk_top);
+	}
+	return std::move(top_documents).Extract();
+}
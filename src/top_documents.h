@@ -0,0 +1,43 @@
+#pragma once
+
+#include <cstddef>
+#include <execution>
+#include <vector>
+
+#include "document.h"
+
+const double RELEVANCE_EPSILON = 1e-6;
+
+// Result ranking order: relevance rounded down to a multiple of RELEVANCE_EPSILON first, rating
+// breaks the ties within a step, id makes the order total. Unlike treating any two relevances
+// closer than RELEVANCE_EPSILON as equal, the order is transitive, so heaps, merges and search-after
+// cursors split the results consistently
+bool IsMoreRelevant(const Document& lhs, const Document& rhs);
+
+// Bounded heap keeping the max_count most relevant documents seen so far
+class TopDocuments {
+public:
+	explicit TopDocuments(std::size_t max_count);
+
+	void Add(const Document& document);
+
+	void Merge(const TopDocuments& other);
+
+	bool IsFull() const;
+
+	// Document that the next added one has to beat once the heap is full
+	const Document& GetLeastRelevant() const;
+
+	std::vector<Document> Extract() &&;
+
+private:
+	std::size_t max_count_;
+	// The least relevant of the kept documents is at the front
+	std::vector<Document> heap_;
+};
+
+std::vector<Document> SelectTopDocuments(std::execution::sequenced_policy,
+	const std::vector<Document>& documents, std::size_t max_count);
+
+std::vector<Document> SelectTopDocuments(std::execution::parallel_policy policy,
+	const std::vector<Document>& documents, std::size_t max_count);
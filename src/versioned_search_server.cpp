@@ -0,0 +1,39 @@
+#include <algorithm>
+#include <atomic>
+#include <utility>
+
+#include "versioned_search_server.h"
+
+VersionedSearchServer::VersionedSearchServer(SearchServer search_server)
+	: current_version_(std::make_shared<const SearchServer>(std::move(search_server)))
+{}
+
+std::shared_ptr<const SearchServer> VersionedSearchServer::Acquire() const {
+	return std::atomic_load(&current_version_);
+}
+
+void VersionedSearchServer::AddDocuments(const std::vector<DocumentInput>& documents) {
+	AddDocuments(std::execution::seq, documents);
+}
+
+void VersionedSearchServer::RemoveDocuments(const std::vector<int>& document_ids) {
+	Update([&document_ids](SearchServer& search_server) {
+		search_server.RemoveDocuments(document_ids);
+	});
+}
+
+std::future<void> VersionedSearchServer::CompactInBackground(std::size_t documents_per_step) {
+	documents_per_step = std::max<std::size_t>(documents_per_step, 1);
+	return std::async(std::launch::async, [this, documents_per_step]() {
+		while (Acquire()->GetRemovedDocumentCount() > 0) {
+			Update([documents_per_step](SearchServer& search_server) {
+				search_server.Compact(documents_per_step);
+			});
+		}
+	});
+}
+
+void VersionedSearchServer::Publish(std::shared_ptr<const SearchServer> version) {
+	// The previous version is freed here or by its last reader
+	std::atomic_store(&current_version_, std::move(version));
+}
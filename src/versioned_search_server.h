@@ -0,0 +1,61 @@
+#pragma once
+
+#include <cstddef>
+#include <execution>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <type_traits>
+#include <vector>
+
+#include "document.h"
+#include "search_server.h"
+
+// Readers take a reference to an immutable version of the server and keep querying it while
+// writers publish new versions. A new version shares the posting lists and documents it doesn't
+// change with the previous one, and a version is freed when its last reader releases it.
+// Publishing still copies the document columns, the sorted ids, the removed documents and the
+// posting list pointers and rebuilds the term statistics, O(documents + terms) per version, so
+// writes are published in batches: the server has no single-document writes.
+class VersionedSearchServer {
+public:
+	explicit VersionedSearchServer(SearchServer search_server);
+
+	// Never blocks on writers, the version stays unchanged while it is held
+	std::shared_ptr<const SearchServer> Acquire() const;
+
+	// Applies function to a copy of the current version and publishes the copy. Writers are
+	// serialized, and nothing is published when function throws. Every call pays for a whole
+	// version, function should make all the changes at hand
+	template <typename Function>
+	void Update(Function function) {
+		std::lock_guard<std::mutex> guard(writer_mutex_);
+		auto next_version = std::make_shared<SearchServer>(*Acquire());
+		function(*next_version);
+		Publish(std::move(next_version));
+	}
+
+	void AddDocuments(const std::vector<DocumentInput>& documents);
+
+	template <typename ExecutionPolicy>
+	void AddDocuments(ExecutionPolicy policy, const std::vector<DocumentInput>& documents) {
+		static_assert(std::is_same_v<ExecutionPolicy, std::execution::sequenced_policy> || std::is_same_v<ExecutionPolicy, std::execution::parallel_policy>);
+		Update([policy, &documents](SearchServer& search_server) {
+			search_server.AddDocuments(policy, documents);
+		});
+	}
+
+	void RemoveDocuments(const std::vector<int>& document_ids);
+
+	// Purges removed documents on another thread until none is left. Every step of at most
+	// documents_per_step documents is published on its own, so other writers get in between.
+	// The server must stay alive until the returned future is ready
+	std::future<void> CompactInBackground(std::size_t documents_per_step);
+
+private:
+	std::mutex writer_mutex_;
+	// Accessed through std::atomic_load and std::atomic_store only
+	std::shared_ptr<const SearchServer> current_version_;
+
+	void Publish(std::shared_ptr<const SearchServer> version);
+};